@@ -28,15 +28,11 @@ EchoServer::EchoServer(DBus::Connection &connection)
     ::DBus::debug_log("re-registering method\n");
     //remap to forwarding stub
 
-    ::DBus::RequestPiper::origMethodTable = EchoDemo_adaptor::_methods;
-
-    ::DBus::debug_log("Registering using methods %p\n", &(EchoDemo_adaptor::_methods));
-    ::DBus::MethodTable::iterator it;
-    for(it = EchoDemo_adaptor::_methods.begin(); it != EchoDemo_adaptor::_methods.end(); it++) {
-        // iterator->first = key
-        // iterator->second = value
-        // Repeat if you also want to iterate through the second map.
-        register_method_sub(EchoServer, it->first, _Forwarding_stub);
+    // the generated stubs are still found by _call_orig_method()
+    ::DBus::debug_log("Registering using methods %p\n", EchoDemo_adaptor::method_table());
+    const ::DBus::MethodEntry *me;
+    for(me = EchoDemo_adaptor::method_table(); me->name; me++) {
+        register_method_sub(EchoServer, me->name, _Forwarding_stub);
     }
 }
 
@@ -111,12 +107,18 @@ static void other_thread_sum(void* data) {
 
     const std::vector<int32_t>& ints(call_data->_ints);
 
-    for (size_t i = 0; i < ints.size(); ++i)
+    // stop early if the caller left the bus, see Tag::tag_cancelled()
+    for (size_t i = 0; i < ints.size() && !call_data->cancelled(); ++i)
         sum += ints[i];
 
     call_data->_echo_server.SumSignal(sum, (int64_t)time(NULL));
     const ::DBus::CallMessage* call_msg = call_data->_echo_server.find_continuation_call_message(call_data);
     ::DBus::debug_log("%s find call_msg %p for tag %p", __func__, call_msg, call_data);
+    if (!call_msg) {
+        // cancelled: nobody is waiting for the reply anymore
+        delete call_data;
+        return;
+    }
     ::DBus::ReturnMessage reply(*call_msg);
     ::DBus::MessageIter wi = reply.writer();
     wi << sum;
@@ -127,7 +129,8 @@ static void other_thread_sum(void* data) {
 int32_t EchoServer::Sum(const std::vector<int32_t>& ints)
 {
   TagThreadStarter* call_data = new TagThreadStarter(ints, *this);
-  return_later(call_data);
+  defer_return(call_data);
+  return 0; // ignored, the reply is sent by other_thread_sum()
 }
 
 
@@ -0,0 +1,273 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_ADMISSION_H
+#define __DBUSXX_ADMISSION_H
+
+#include <string>
+#include <map>
+#include <deque>
+#include <list>
+
+#include "api.h"
+#include "eventloop.h" // for DefaultMutex
+#include "message.h"
+
+namespace DBus
+{
+
+class Tag;
+
+/*!
+ * \brief Limits applied to incoming method calls before they are dispatched.
+ *
+ * A limit of zero means "unlimited". Calls exceeding a limit are rejected
+ * immediately with org.freedesktop.DBus.Error.LimitsExceeded, or with
+ * error_name if one is given.
+ */
+struct DXXAPI AdmissionLimits
+{
+  AdmissionLimits(unsigned int in_flight = 0, unsigned int queued = 0, const char *error = NULL);
+
+  // calls being handled or waiting for a deferred reply (see return_later())
+  unsigned int max_in_flight;
+
+  // calls waiting in a worker queue (see RequestPiper)
+  unsigned int max_queued;
+
+  // parameter MUST be a static string, like for Error::set()
+  const char *error_name;
+};
+
+/*!
+ * \brief Quotas applied to each caller, keyed on the unique name of the sender.
+ *
+ * A limit of zero means "unlimited".
+ */
+struct DXXAPI SenderLimits
+{
+  SenderLimits(unsigned int in_flight = 0, size_t queued_bytes = 0);
+
+  // calls from one sender being handled or waiting for a deferred reply
+  unsigned int max_in_flight;
+
+  // size on the wire of the calls from one sender waiting in a worker queue
+  size_t max_queued_bytes;
+};
+
+struct DXXAPI AdmissionCounters
+{
+  AdmissionCounters();
+
+  unsigned long admitted;
+  unsigned long rejected;
+  unsigned int in_flight;
+  unsigned int queued;
+  size_t queued_bytes;
+};
+
+/*!
+ * \brief Per-object and per-method concurrency accounting for ObjectAdaptor.
+ *
+ * Every ObjectAdaptor owns one of these. The dispatcher thread calls admit()
+ * before invoking a method and release() once the reply (immediate or
+ * deferred) has been sent; RequestPiper does the same for its request queue
+ * with admit_queued() and release_queued(), from the worker thread too, so
+ * all the accounting is done under a mutex.
+ */
+class DXXAPI AdmissionControl
+{
+public:
+
+  AdmissionControl();
+
+  /*!
+   * \brief Sets the limits shared by all the methods of the object.
+   */
+  void limits(const AdmissionLimits &l);
+
+  AdmissionLimits limits() const;
+
+  /*!
+   * \brief Sets additional limits for a single method, the member of an
+   *        interface: methods of the same name in other interfaces have
+   *        their own.
+   *
+   * A call must satisfy both the object-wide and the method limits.
+   */
+  void method_limits(const std::string &interface, const std::string &member, const AdmissionLimits &l);
+
+  /*!
+   * \brief Sets the quotas every single sender is subject to.
+   */
+  void sender_limits(const SenderLimits &l);
+
+  SenderLimits sender_limits() const;
+
+  /*!
+   * \return true if queued calls have to be sized, i.e. if some byte quota is set.
+   */
+  bool counts_bytes() const;
+
+  /*!
+   * \return false if the call has to be rejected; the call is accounted for
+   *         as in flight otherwise and release() must be called eventually.
+   */
+  bool admit(const char *interface, const char *member, const char *sender);
+
+  void release(const char *interface, const char *member, const char *sender);
+
+  /*!
+   * \return false if the call has to be rejected; the call is accounted for
+   *         as queued otherwise and release_queued() must be called eventually
+   *         with the same arguments.
+   */
+  bool admit_queued(const char *interface, const char *member, const char *sender, size_t bytes = 0);
+
+  void release_queued(const char *interface, const char *member, const char *sender, size_t bytes = 0);
+
+  /*!
+   * \return The error name to reply with when rejecting a call to
+   *         interface.member.
+   */
+  const char *error_name(const char *interface, const char *member) const;
+
+  AdmissionCounters counters() const;
+
+  AdmissionCounters counters(const std::string &interface, const std::string &member) const;
+
+  /*!
+   * \return The current usage of a sender; only senders with calls in
+   *         flight or queued are tracked, admitted/rejected are not kept.
+   */
+  AdmissionCounters sender_counters(const std::string &sender) const;
+
+  /*!
+   * \brief Zeroes the admitted and rejected totals of the object and of
+   *        its methods; the in flight and queued counts follow the calls
+   *        actually pending and are kept.
+   */
+  void reset_totals();
+
+private:
+
+  struct Entry
+  {
+    AdmissionLimits limits;
+    AdmissionCounters counters;
+  };
+
+  typedef std::map<std::string, Entry> EntryTable;
+  typedef std::map<std::string, AdmissionCounters> SenderTable;
+
+  // the methods are keyed on "interface.member"
+  DXXAPILOCAL Entry *find_method(const char *interface, const char *member);
+
+  DXXAPILOCAL const Entry *find_method(const char *interface, const char *member) const;
+
+  DXXAPILOCAL void forget_sender(SenderTable::iterator si);
+
+private:
+
+  Entry _object;
+  EntryTable _methods;
+  SenderLimits _sender_limits;
+  SenderTable _senders;
+  mutable DefaultMutex _mutex;
+};
+
+/*!
+ * \brief A queue of method calls served fairly among their senders.
+ *
+ * Calls are kept in one FIFO per sender and the FIFOs are served with
+ * deficit round-robin: on its turn each sender earns `quantum' credits and
+ * may dequeue calls as long as their cost fits in its credit. With a cost of
+ * one per call this is plain round-robin; with the size of the calls as cost
+ * it shares bytes instead. A single noisy peer therefore only delays itself.
+ *
+ * The queue is not synchronized, RequestPiper protects it with its own mutex.
+ */
+class DXXAPI FairRequestQueue
+{
+public:
+
+  struct Request
+  {
+    Request(const CallMessage &c, Tag *t, size_t b, size_t co, double e);
+
+    CallMessage call;
+    Tag *tag;
+    size_t bytes;
+    size_t cost;
+    double expiration; // see CallContext::expiration()
+  };
+
+  FairRequestQueue(size_t quantum = 1);
+
+  void quantum(size_t q);
+
+  void push(const CallMessage &call, Tag *tag, size_t bytes = 0, size_t cost = 1, double expiration = 0);
+
+  /*!
+   * \brief Selects the next request to serve.
+   *
+   * \return The request, which stays in the queue until pop() is called,
+   *         or NULL if the queue is empty.
+   */
+  Request *front();
+
+  /*!
+   * \brief Removes the request returned by the last call to front().
+   */
+  void pop();
+
+  /*!
+   * \brief Removes all the requests of a sender, handing them to the caller.
+   */
+  void drop(const std::string &sender, std::deque<Request> &dropped);
+
+  size_t size() const;
+
+  bool empty() const;
+
+private:
+
+  struct Flow
+  {
+    Flow() : deficit(0) {}
+
+    std::deque<Request> requests;
+    size_t deficit;
+  };
+
+  typedef std::map<std::string, Flow> FlowTable;
+
+  FlowTable _flows;
+  std::list<FlowTable::iterator> _round;
+  size_t _quantum;
+  size_t _size;
+  bool _granted; // the head of the round has had its quantum for this turn
+};
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_ADMISSION_H
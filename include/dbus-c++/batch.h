@@ -0,0 +1,92 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_BATCH_H
+#define __DBUSXX_BATCH_H
+
+#include <string>
+#include <vector>
+
+#include "api.h"
+#include "types.h"
+#include "interface.h"
+
+namespace DBus
+{
+
+/*!
+ * \brief One call of a batch: object path, interface, member and the in
+ *        arguments, each wrapped in a variant.
+ */
+typedef Struct< Path, std::string, std::string, std::vector<Variant> > BatchCall;
+
+/*!
+ * \brief The outcome of one call of a batch: an empty error name and the
+ *        out arguments, or the error name and its message.
+ */
+typedef Struct< std::string, std::vector<Variant> > BatchResult;
+
+/*!
+ * \brief The org.dbuscxx.Batch interface, running many calls in one
+ *        message.
+ *
+ * Call(a(ossav)) -> a(sav) dispatches each call to the objects this
+ * connection exports, in order, as if it came from the batch's sender,
+ * and returns all the outcomes in one reply. A failing call doesn't stop
+ * the others. Methods which defer their reply (see
+ * ObjectAdaptor::return_later()) can't be batched, they fail with
+ * org.freedesktop.DBus.Error.NotSupported: those forwarded by a
+ * RequestPiper and those marked with InterfaceAdaptor::deferred_method()
+ * without being invoked, the others with their tag cancelled (see
+ * CallContext::batched()).
+ *
+ * Add it to any object, e.g. the root one, along with the others:
+ *
+ *   class Root : public DBus::BatchAdaptor, public DBus::ObjectAdaptor
+ */
+class DXXAPI BatchAdaptor : public InterfaceAdaptor
+{
+public:
+
+  BatchAdaptor();
+
+  Message Call(const CallMessage &);
+
+protected:
+
+  IntrospectedInterface *introspect() const;
+
+  const MethodEntry *method_table() const;
+};
+
+class DXXAPI BatchProxy : public InterfaceProxy
+{
+public:
+
+  BatchProxy();
+
+  std::vector<BatchResult> Call(const std::vector<BatchCall> &calls);
+};
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_BATCH_H
@@ -0,0 +1,124 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_COMPLETION_QUEUE_H
+#define __DBUSXX_COMPLETION_QUEUE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "api.h"
+#include "pendingcall.h"
+
+namespace DBus
+{
+
+/*!
+ * \brief Collects PendingCalls as they complete.
+ *
+ * Attach any number of outstanding calls with add(), then wait for the
+ * first of them (wait_any()) or for all of them (wait_all()) and harvest
+ * the completed ones in batches with take(). Foreign event loops can
+ * poll fd() instead of waiting.
+ *
+ * Completions are still delivered by whoever dispatches the connection:
+ * wait from another thread than the dispatcher's, or the wait only ends
+ * with its timeout. Cancelled calls never complete. Thread safe.
+ */
+class DXXAPI CompletionQueue
+{
+public:
+
+  struct Private;
+
+  /*!
+   * \throw ErrorFailed If no pipe is available for fd().
+   */
+  CompletionQueue();
+
+  /*!
+   * \brief Detaches the calls still outstanding, their completions are
+   *        dropped.
+   */
+  ~CompletionQueue();
+
+  /*!
+   * \brief Attaches `call' to the queue, it is queued once completed.
+   *
+   * This replaces the call's handler (see PendingCall::handler()), the
+   * slot is not called any more. A call attached after it completed is
+   * queued right away. Attach a call once, to one queue.
+   */
+  void add(PendingCall &call);
+
+  /*!
+   * \brief Waits until at least one completed call is queued.
+   *
+   * \param timeout In milliseconds, -1 to wait forever.
+   * \return false If the timeout expired first.
+   */
+  bool wait_any(int timeout = -1);
+
+  /*!
+   * \brief Waits until every attached call completed.
+   *
+   * \param timeout In milliseconds, -1 to wait forever.
+   * \return false If the timeout expired first.
+   */
+  bool wait_all(int timeout = -1);
+
+  /*!
+   * \brief Moves the completed calls to `calls', without waiting.
+   *
+   * \param max Moves at most that many calls, 0 for no limit.
+   * \return The number of calls appended to `calls'.
+   */
+  size_t take(std::vector<PendingCall> &calls, size_t max = 0);
+
+  /*!
+   * \return The number of attached calls not completed yet.
+   */
+  size_t outstanding() const;
+
+  /*!
+   * \return The number of completed calls waiting for take().
+   */
+  size_t ready() const;
+
+  /*!
+   * \return A descriptor which is readable as long as ready() is not
+   *         zero. Read nothing from it, take() resets it.
+   */
+  int fd() const;
+
+private:
+
+  CompletionQueue(const CompletionQueue &);
+
+  CompletionQueue &operator = (const CompletionQueue &);
+
+  Private *_pvt;
+};
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_COMPLETION_QUEUE_H
@@ -26,6 +26,7 @@
 #define __DBUSXX_CONNECTION_H
 
 #include <list>
+#include <vector>
 
 #include "api.h"
 #include "types.h"
@@ -382,6 +383,27 @@ public:
    */
   Message send_blocking(Message &msg, int timeout = -1);
 
+  /*!
+   * \brief Sends all the calls, flushes once and blocks until every
+   *        reply arrived or the timeout expired.
+   *
+   * The calls are pipelined: the whole batch costs about one round trip
+   * instead of one per call. The timeout applies to the batch as a whole,
+   * it starts once the calls are queued.
+   *
+   * The same warning as for send_blocking() applies. Also, a call which
+   * times out while another thread dispatches the connection may keep
+   * libdbus blocked on it, so don't rely on the timeout in that case.
+   *
+   * \param calls The calls to send.
+   * \param timeout Timeout in milliseconds (omit for default).
+   * \return One reply per call, in the same order. Calls which failed,
+   *         timed out or could not be sent get an error reply, see
+   *         Message::is_error().
+   * \throw ErrorNoMemory
+   */
+  std::vector<Message> send_batch(std::vector<CallMessage> &calls, int timeout = -1);
+
   /*!
    * \brief Queues a message to send, as with send(), but also
    *        returns a DBusPendingCall used to receive a reply to the message.
@@ -409,6 +431,21 @@ public:
    */
   PendingCall send_async(Message &msg, int timeout = -1);
 
+  /*!
+   * \brief Same as send_async(msg, timeout), calling `handler' with the
+   *        completed PendingCall and `object'.
+   *
+   * The handler and `data' (see PendingCall::data()) are in place before
+   * the reply can arrive, so none is missed even if another thread
+   * dispatches the connection. The handler runs in the thread dispatching
+   * the connection, or in the calling thread if the reply was dispatched
+   * before send_async() returned. Nothing is allocated for them.
+   *
+   * \throw ErrorNoMemory
+   */
+  PendingCall send_async(Message &msg, int timeout, PendingCall::Handler handler, void *object,
+                         void *data = NULL);
+
   void request_name(const char *name, int flags = 0);
 
   unsigned long sender_unix_uid(const char *sender);
@@ -462,6 +499,8 @@ private:
   int _timeout;
 
   friend class ObjectAdaptor; // needed in order to register object paths for a connection
+  friend class ObjectProxy;
+  friend class SubtreeAdaptor;
 };
 
 } /* namespace DBus */
@@ -0,0 +1,776 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_COROUTINE_H
+#define __DBUSXX_COROUTINE_H
+
+/*
+ * COROUTINES
+ * ----------
+ *
+ * With a C++20 compiler, adaptor methods can be coroutines returning a
+ * DBus::Task<T>: the reply is sent when the coroutine returns, and
+ * meanwhile it can co_await
+ *
+ *   - a PendingCall, e.g. co_await conn().send_async(call), which gives
+ *     the reply Message or throws the DBus::Error it carries,
+ *   - DBus::sleep_for(milliseconds),
+ *   - pool.run(function) to run some blocking work in a DBus::ThreadPool,
+ *   - another DBus::Task.
+ *
+ * without blocking the dispatcher thread. A coroutine starts running in
+ * the thread which dispatched the call and, once it awaited something,
+ * goes on in the dispatcher thread like any other handler. This needs the
+ * default_dispatcher to be a BusDispatcher.
+ *
+ * xml2cpp generates such methods for the ones annotated with
+ * org.dbuscxx.Method.Coroutine; a hand written stub does
+ *
+ *   return DBus::CoroutineBridge::start(object(), call, Method(args));
+ *
+ * Task<T> replies with T as single out argument, Task<std::tuple<...>>
+ * with several ones and Task<void> with none.
+ *
+ * Mind that a coroutine outlives its caller: it must take its arguments
+ * by value, not by reference.
+ *
+ * With older compilers this header declares nothing.
+ */
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define DBUSXX_HAS_COROUTINES 1
+#endif
+#endif
+
+#ifdef DBUSXX_HAS_COROUTINES
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "api.h"
+#include "error.h"
+#include "eventloop-integration.h"
+#include "message.h"
+#include "object.h"
+#include "pendingcall.h"
+#include "pipe.h"
+
+namespace DBus
+{
+
+/*!
+ * \brief Resumes coroutines in the dispatcher thread.
+ *
+ * Awaitables completing in other threads hand the coroutine over through
+ * a Pipe of the default BusDispatcher. The pipe is created on first use,
+ * which must happen in the dispatcher thread or before entering the loop.
+ */
+class CoroutineResumer
+{
+public:
+
+  static CoroutineResumer &instance()
+  {
+    // never destroyed, coroutines may be resumed until the very end
+    static CoroutineResumer *resumer = new CoroutineResumer;
+
+    return *resumer;
+  }
+
+  void post(std::coroutine_handle<> h)
+  {
+    void *address = h.address();
+
+    _pipe->write(&address, sizeof(address));
+  }
+
+private:
+
+  CoroutineResumer()
+  {
+    BusDispatcher *dispatcher = dynamic_cast<BusDispatcher *>(default_dispatcher);
+
+    if (!dispatcher)
+      throw ErrorFailed("coroutines need a BusDispatcher as default_dispatcher");
+
+    _pipe = dispatcher->add_pipe(&CoroutineResumer::resume, this);
+  }
+
+  static void resume(const void *, void *buffer, unsigned int nbyte)
+  {
+    void *address;
+
+    if (nbyte != sizeof(address))
+      return;
+
+    std::memcpy(&address, buffer, sizeof(address));
+    std::coroutine_handle<>::from_address(address).resume();
+  }
+
+  Pipe *_pipe;
+};
+
+/*
+*/
+
+template <class T> class Task;
+
+class TaskPromiseBase
+{
+public:
+
+  struct FinalAwaiter
+  {
+    bool await_ready() noexcept
+    {
+      return false;
+    }
+
+    template <class P>
+    void await_suspend(std::coroutine_handle<P> h) noexcept
+    {
+      h.promise().completed();
+    }
+
+    void await_resume() noexcept
+    {}
+  };
+
+  // run eagerly, until the first suspension
+  std::suspend_never initial_suspend() noexcept
+  {
+    return {};
+  }
+
+  FinalAwaiter final_suspend() noexcept
+  {
+    return {};
+  }
+
+  void unhandled_exception()
+  {
+    _exception = std::current_exception();
+  }
+
+  /*!
+   * \brief Arranges for `f' to be called when the coroutine completes.
+   *
+   * Safe against the coroutine completing meanwhile in another thread.
+   * `f' may destroy the coroutine.
+   *
+   * \return false if the coroutine already completed, `f' is not called then.
+   */
+  bool when_done(std::function<void()> f)
+  {
+    _when_done = std::move(f);
+
+    int expected = RUNNING;
+    return _state.compare_exchange_strong(expected, WAITING);
+  }
+
+  void completed()
+  {
+    int expected = RUNNING;
+
+    if (!_state.compare_exchange_strong(expected, DONE))
+      _when_done();
+  }
+
+  void rethrow()
+  {
+    if (_exception)
+      std::rethrow_exception(_exception);
+  }
+
+private:
+
+  enum { RUNNING, WAITING, DONE };
+
+  std::exception_ptr _exception;
+  std::function<void()> _when_done;
+  std::atomic<int> _state { RUNNING };
+};
+
+template <class T>
+class TaskPromise : public TaskPromiseBase
+{
+public:
+
+  Task<T> get_return_object();
+
+  template <class V>
+  void return_value(V &&value)
+  {
+    _value.emplace(std::forward<V>(value));
+  }
+
+  T result()
+  {
+    rethrow();
+    return std::move(*_value);
+  }
+
+private:
+
+  std::optional<T> _value;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase
+{
+public:
+
+  Task<void> get_return_object();
+
+  void return_void()
+  {}
+
+  void result()
+  {
+    rethrow();
+  }
+};
+
+/*!
+ * \brief The result of a coroutine, which runs until its first suspension
+ *        as soon as it is called.
+ */
+template <class T = void>
+class Task
+{
+public:
+
+  typedef TaskPromise<T> promise_type;
+
+  explicit Task(std::coroutine_handle<promise_type> h)
+    : _handle(h)
+  {}
+
+  Task(Task &&t) noexcept
+    : _handle(std::exchange(t._handle, nullptr))
+  {}
+
+  Task &operator = (Task &&t) noexcept
+  {
+    if (this != &t)
+    {
+      if (_handle) _handle.destroy();
+      _handle = std::exchange(t._handle, nullptr);
+    }
+    return *this;
+  }
+
+  Task(const Task &) = delete;
+
+  Task &operator = (const Task &) = delete;
+
+  ~Task()
+  {
+    if (_handle) _handle.destroy();
+  }
+
+  bool done() const
+  {
+    return _handle.done();
+  }
+
+  promise_type &promise()
+  {
+    return _handle.promise();
+  }
+
+  /*!
+   * \brief The value the coroutine returned, or the exception it threw.
+   */
+  T result()
+  {
+    return _handle.promise().result();
+  }
+
+  // awaiting a Task from another coroutine
+
+  bool await_ready() const
+  {
+    return _handle.done();
+  }
+
+  bool await_suspend(std::coroutine_handle<> awaiting)
+  {
+    return _handle.promise().when_done([awaiting]() { awaiting.resume(); });
+  }
+
+  T await_resume()
+  {
+    return result();
+  }
+
+private:
+
+  std::coroutine_handle<promise_type> _handle;
+};
+
+template <class T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+  return Task<T>(std::coroutine_handle<TaskPromise<T> >::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+  return Task<void>(std::coroutine_handle<TaskPromise<void> >::from_promise(*this));
+}
+
+/*!
+ * \brief Turns a Task into the reply to a call, deferring it if the
+ *        coroutine is still running.
+ */
+class CoroutineBridge
+{
+public:
+
+  /*!
+   * \return The reply if the coroutine already completed, otherwise the
+   *         call is deferred (see ObjectAdaptor::return_later()) and the
+   *         reply is sent when the coroutine returns.
+   */
+  template <class T>
+  static Message start(const ObjectAdaptor *object, const CallMessage &call, Task<T> task)
+  {
+    if (task.done())
+      return reply(call, task);
+
+    ObjectAdaptor *o = const_cast<ObjectAdaptor *>(object);
+
+    o->defer_return(new CoroutineTag<T>(o, call, std::move(task)));
+
+    return Message();
+  }
+
+private:
+
+  template <class T>
+  class CoroutineTag : public Tag
+  {
+  public:
+
+    CoroutineTag(ObjectAdaptor *object, const CallMessage &call, Task<T> &&task)
+      : _object(object), _call(call, false), _task(std::move(task))
+    {}
+
+    // the continuation exists from now on, the reply can be sent
+    void tag_registered() const
+    {
+      CoroutineTag *self = const_cast<CoroutineTag *>(this);
+
+      if (!self->_task.promise().when_done([self]() { self->finish(); }))
+        self->finish();
+    }
+
+  private:
+
+    void finish()
+    {
+      Message r;
+
+      try
+      {
+        r = CoroutineBridge::reply(_call, _task);
+      }
+      catch (Error &e)
+      {
+        r = ErrorMessage(_call, e.name(), e.message());
+      }
+      catch (std::exception &e)
+      {
+        r = ErrorMessage(_call, "org.freedesktop.DBus.Error.Failed", e.what());
+      }
+
+      // nothing is sent if the caller left meanwhile
+      _object->return_now(this, r);
+
+      delete this;
+    }
+
+    ObjectAdaptor *_object;
+    CallMessage _call;
+    Task<T> _task;
+  };
+
+  template <class T>
+  static Message reply(const CallMessage &call, Task<T> &task)
+  {
+    ReturnMessage r(call);
+
+    if constexpr (std::is_void_v<T>)
+    {
+      task.result();
+    }
+    else
+    {
+      MessageIter wi = r.writer();
+
+      marshal(wi, task.result());
+    }
+
+    return r;
+  }
+
+  template <class V>
+  static void marshal(MessageIter &wi, const V &value)
+  {
+    wi << value;
+  }
+
+  template <class... V>
+  static void marshal(MessageIter &wi, const std::tuple<V...> &values)
+  {
+    std::apply([&wi](const V &... v) { ((wi << v), ...); }, values);
+  }
+};
+
+/*
+*/
+
+/*!
+ * \brief Awaits the reply to a call sent with Connection::send_async().
+ *
+ * Resumes with the reply, or throws the DBus::Error it carries.
+ */
+class PendingCallAwaiter
+{
+public:
+
+  explicit PendingCallAwaiter(const PendingCall &call)
+    : _call(call), _claimed(false)
+  {}
+
+  bool await_ready()
+  {
+    return _call.completed();
+  }
+
+  bool await_suspend(std::coroutine_handle<> h)
+  {
+    _handle = h;
+    _call.slot() = new Callback<PendingCallAwaiter, void, PendingCall &>(this, &PendingCallAwaiter::notified);
+
+    // the reply may have arrived before the slot was set
+    return !(_call.completed() && claim());
+  }
+
+  Message await_resume()
+  {
+    Message reply = _call.steal_reply();
+
+    if (reply.is_error())
+      throw Error(reply);
+
+    return reply;
+  }
+
+private:
+
+  void notified(PendingCall &)
+  {
+    if (claim())
+      _handle.resume();
+  }
+
+  bool claim()
+  {
+    return !_claimed.exchange(true);
+  }
+
+  PendingCall _call;
+  std::coroutine_handle<> _handle;
+  std::atomic<bool> _claimed;
+};
+
+inline PendingCallAwaiter operator co_await(const PendingCall &call)
+{
+  return PendingCallAwaiter(call);
+}
+
+/*!
+ * \brief One thread waking up all the sleeping coroutines.
+ */
+class CoroutineTimer
+{
+public:
+
+  typedef std::chrono::steady_clock Clock;
+
+  static CoroutineTimer &instance()
+  {
+    // never destroyed, its thread runs until the process exits
+    static CoroutineTimer *timer = new CoroutineTimer;
+
+    return *timer;
+  }
+
+  void schedule(Clock::time_point when, CoroutineResumer &resumer, std::coroutine_handle<> h)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _sleepers.insert(std::make_pair(when, std::make_pair(&resumer, h)));
+    _wakeup.notify_one();
+  }
+
+private:
+
+  CoroutineTimer()
+  {
+    std::thread(&CoroutineTimer::run, this).detach();
+  }
+
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    for (;;)
+    {
+      if (_sleepers.empty())
+      {
+        _wakeup.wait(lock);
+        continue;
+      }
+
+      SleeperMap::iterator si = _sleepers.begin();
+
+      if (Clock::now() < si->first)
+      {
+        _wakeup.wait_until(lock, si->first);
+        continue;
+      }
+
+      si->second.first->post(si->second.second);
+      _sleepers.erase(si);
+    }
+  }
+
+  typedef std::multimap<Clock::time_point, std::pair<CoroutineResumer *, std::coroutine_handle<> > > SleeperMap;
+
+  SleeperMap _sleepers;
+  std::mutex _mutex;
+  std::condition_variable _wakeup;
+};
+
+class SleepAwaiter
+{
+public:
+
+  explicit SleepAwaiter(int millis)
+    : _millis(millis)
+  {}
+
+  bool await_ready() const
+  {
+    return _millis <= 0;
+  }
+
+  void await_suspend(std::coroutine_handle<> h)
+  {
+    CoroutineTimer::instance().schedule(
+      CoroutineTimer::Clock::now() + std::chrono::milliseconds(_millis),
+      CoroutineResumer::instance(), h);
+  }
+
+  void await_resume()
+  {}
+
+private:
+
+  int _millis;
+};
+
+/*!
+ * \brief Suspends the coroutine for `millis' milliseconds.
+ */
+inline SleepAwaiter sleep_for(int millis)
+{
+  return SleepAwaiter(millis);
+}
+
+/*!
+ * \brief A fixed set of threads running blocking work for coroutines.
+ */
+class ThreadPool
+{
+public:
+
+  template <class R> class RunAwaiter;
+
+  explicit ThreadPool(unsigned int threads = std::thread::hardware_concurrency())
+    : _stopping(false)
+  {
+    if (!threads) threads = 1;
+
+    for (unsigned int i = 0; i < threads; ++i)
+      _threads.push_back(std::thread(&ThreadPool::work, this));
+  }
+
+  // runs the work already submitted, then joins the threads
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopping = true;
+    }
+    _wakeup.notify_all();
+
+    for (size_t i = 0; i < _threads.size(); ++i)
+      _threads[i].join();
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+
+  ThreadPool &operator = (const ThreadPool &) = delete;
+
+  void submit(std::function<void()> work)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _work.push_back(std::move(work));
+    }
+    _wakeup.notify_one();
+  }
+
+  /*!
+   * \brief Runs `f' in the pool.
+   *
+   * Awaiting the result resumes the coroutine in the dispatcher thread,
+   * with what `f' returned or threw.
+   */
+  template <class F>
+  RunAwaiter<std::invoke_result_t<F> > run(F f)
+  {
+    return RunAwaiter<std::invoke_result_t<F> >(*this, std::move(f));
+  }
+
+private:
+
+  void work()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    for (;;)
+    {
+      if (_work.empty())
+      {
+        if (_stopping)
+          return;
+
+        _wakeup.wait(lock);
+        continue;
+      }
+
+      std::function<void()> work = std::move(_work.front());
+      _work.pop_front();
+
+      lock.unlock();
+      work();
+      lock.lock();
+    }
+  }
+
+  std::vector<std::thread> _threads;
+  std::deque<std::function<void()> > _work;
+  std::mutex _mutex;
+  std::condition_variable _wakeup;
+  bool _stopping;
+};
+
+template <class R>
+class ThreadPool::RunAwaiter
+{
+public:
+
+  RunAwaiter(ThreadPool &pool, std::function<R()> f)
+    : _pool(pool), _f(std::move(f))
+  {}
+
+  bool await_ready() const
+  {
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<> h)
+  {
+    CoroutineResumer *resumer = &CoroutineResumer::instance();
+
+    _pool.submit([this, h, resumer]()
+    {
+      try
+      {
+        if constexpr (std::is_void_v<R>)
+          _f();
+        else
+          _result.emplace(_f());
+      }
+      catch (...)
+      {
+        _exception = std::current_exception();
+      }
+
+      resumer->post(h);
+    });
+  }
+
+  R await_resume()
+  {
+    if (_exception)
+      std::rethrow_exception(_exception);
+
+    if constexpr (!std::is_void_v<R>)
+      return std::move(*_result);
+  }
+
+private:
+
+  typedef std::conditional_t<std::is_void_v<R>, bool, R> Value;
+
+  ThreadPool &_pool;
+  std::function<R()> _f;
+  std::optional<Value> _result;
+  std::exception_ptr _exception;
+};
+
+} /* namespace DBus */
+
+#endif//DBUSXX_HAS_COROUTINES
+
+#endif//__DBUSXX_COROUTINE_H
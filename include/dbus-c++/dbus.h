@@ -26,8 +26,11 @@
 #define __DBUSXX_DBUS_H
 
 #include "types.h"
+#include "admission.h"
 #include "interface.h"
 #include "object.h"
+#include "object-manager.h"
+#include "subtree.h"
 #include "property.h"
 #include "connection.h"
 #include "server.h"
@@ -35,12 +38,15 @@
 #include "message.h"
 #include "debug.h"
 #include "pendingcall.h"
+#include "completion-queue.h"
 #include "server.h"
 #include "util.h"
 #include "dispatcher.h"
 #include "eventloop.h"
 #include "eventloop-integration.h"
 #include "introspection.h"
+#include "batch.h"
 #include "pipe.h"
+#include "coroutine.h"
 
 #endif//__DBUSXX_DBUS_H
@@ -27,15 +27,47 @@
 
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
 #include "api.h"
 #include "util.h"
 #include "types.h"
+#include "eventloop.h" // for DefaultMutex
 
 #include "message.h"
+#include "pendingcall.h"
 
 namespace DBus
 {
 
+/*!
+ * \brief The storage of a property, whatever its type; see
+ *        PropertyAdaptor.
+ */
+class DXXAPI PropertyBase
+{
+public:
+
+  virtual ~PropertyBase()
+  {}
+
+  /*!
+   * \brief The value wrapped in a Variant, kept until the next
+   *        assignment.
+   */
+  virtual const Variant &encoded() = 0;
+
+  /*!
+   * \brief Appends the value as a variant.
+   */
+  virtual void append(MessageIter &iter) = 0;
+
+  /*!
+   * \brief Sets the value from `value', of the property's signature.
+   */
+  virtual void assign(const Variant &value) = 0;
+};
+
 //todo: this should belong to to properties.h
 struct DXXAPI PropertyData
 {
@@ -43,6 +75,10 @@ struct DXXAPI PropertyData
   bool		write;
   std::string	sig;
   Variant		value;
+  PropertyBase	*storage;	// holds the value instead, see bind_property()
+
+  PropertyData() : read(false), write(false), storage(NULL)
+  {}
 };
 
 typedef std::map<std::string, PropertyData>	PropertyTable;
@@ -65,6 +101,12 @@ protected:
 
   InterfaceAdaptor *find_interface(const std::string &name);
 
+  /*!
+   * \brief Same as find_interface(const std::string &) without building a
+   *        string, as objects only have a handful of interfaces.
+   */
+  InterfaceAdaptor *find_interface(const char *name);
+
   virtual ~AdaptorBase()
   {}
 
@@ -92,6 +134,8 @@ protected:
 
   InterfaceProxy *find_interface(const std::string &name);
 
+  InterfaceProxy *find_interface(const char *name);
+
   virtual ~ProxyBase()
   {}
 
@@ -99,6 +143,12 @@ protected:
 
   virtual bool _invoke_method_noreply(CallMessage &call) = 0;
 
+  virtual PendingCall _invoke_method_async(CallMessage &call, PendingCall::Handler handler, void *object,
+                                           void *data) = 0;
+
+  // the signals handled or their constraints changed, see InterfaceProxy::match_signal()
+  virtual void _resubscribe() = 0;
+
   InterfaceProxyTable _interfaces;
 };
 
@@ -130,6 +180,52 @@ const std::string &Interface::name() const
 
 typedef std::map< std::string, Slot<Message, const CallMessage &> > MethodTable;
 
+/*!
+ * \brief A method of an adaptor class, shared by all its instances.
+ *
+ * `call' runs the method on the adaptor it is given, see method_member().
+ * Tables of entries end with a NULL name.
+ */
+struct DXXAPI MethodEntry
+{
+  const char *name;
+  Message (*call)(InterfaceAdaptor *, const CallMessage &);
+};
+
+/*!
+ * \brief A property of an adaptor class, shared by all its instances.
+ *
+ * `value' returns the storage of the property in the adaptor it is
+ * given, see property_member(). Tables of entries end with a NULL name.
+ */
+struct DXXAPI PropertyEntry
+{
+  const char *name;
+  const char *sig;
+  bool read;
+  bool write;
+  PropertyBase *(*value)(InterfaceAdaptor *);
+};
+
+/*!
+ * \brief Calls M on `self', a C; for the `call' of a MethodEntry.
+ */
+template <class C, Message (C::*M)(const CallMessage &)>
+Message method_member(InterfaceAdaptor *self, const CallMessage &call)
+{
+  return (static_cast<C *>(self)->*M)(call);
+}
+
+/*!
+ * \brief M, a PropertyAdaptor<> of `self', a C; for the `value' of a
+ *        PropertyEntry.
+ */
+template <class C, class P, P C::*M>
+PropertyBase *property_member(InterfaceAdaptor *self)
+{
+  return &(static_cast<C *>(self)->*M);
+}
+
 class DXXAPI InterfaceAdaptor : public Interface, public virtual AdaptorBase
 {
 public:
@@ -140,19 +236,175 @@ public:
 
   void emit_signal(const SignalMessage &);
 
-  Variant *get_property(const std::string &name);
+  /*!
+   * \brief The value of property `name', or NULL if there is none.
+   *
+   * A PropertyAdaptor only encodes its value when asked for it here,
+   * then keeps the encoding until it is assigned again: copy it to change
+   * it.
+   */
+  const Variant *get_property(const std::string &name);
 
   void set_property(const std::string &name, Variant &value);
 
+  /*!
+   * \brief Appends the readable properties which have a value, as an
+   *        a{sv} dictionary; for GetAll and the ObjectManager.
+   */
+  void append_properties(MessageIter &iter);
+
   virtual IntrospectedInterface *introspect() const
   {
     return NULL;
   }
 
+  /*!
+   * \brief The <interface> element of the introspection data, or NULL to
+   *        build it from introspect().
+   *
+   * Generated adaptors return a string constant written by
+   * dbusxx-xml2cpp.
+   */
+  virtual const char *introspect_xml() const
+  {
+    return NULL;
+  }
+
+  /*!
+   * \brief The methods of this adaptor's class, or NULL.
+   *
+   * Generated adaptors return a static table shared by all their
+   * instances, so registering their methods costs nothing per object.
+   * Methods registered at run time in _methods take precedence over it.
+   */
+  virtual const MethodEntry *method_table() const
+  {
+    return NULL;
+  }
+
+  /*!
+   * \brief The properties of this adaptor's class, or NULL; see
+   *        method_table().
+   */
+  virtual const PropertyEntry *property_table() const
+  {
+    return NULL;
+  }
+
+  /*!
+   * \brief Finds `member' in method_table(), or NULL.
+   *
+   * This one compares the names in turn. Generated adaptors override it
+   * with a switch on the length and characters of the name.
+   */
+  virtual const MethodEntry *find_method_entry(const char *member) const;
+
+  const PropertyEntry *find_property_entry(const char *name) const;
+
+  /*!
+   * \brief Coalesces identical concurrent calls to a method.
+   *
+   * While a deferred call to `method' (see ObjectAdaptor::return_later())
+   * is pending, calls with the same arguments are not dispatched: they wait
+   * for the pending one and get a copy of its reply. Only suitable for
+   * methods whose result depends on nothing but their arguments.
+   *
+   * Enabled by the org.dbuscxx.Method.SingleFlight annotation in generated
+   * adaptors.
+   */
+  void single_flight(const std::string &method, bool enable = true);
+
+  bool is_single_flight(const char *method) const;
+
+  /*!
+   * \brief Declares that `method' defers its reply (see
+   *        ObjectAdaptor::return_later()), such as the methods a
+   *        RequestPiper forwards to its worker thread.
+   *
+   * Batches (see BatchAdaptor) reject calls to it without invoking it.
+   *
+   * Enabled by the org.dbuscxx.Method.Deferred annotation in generated
+   * adaptors.
+   */
+  void deferred_method(const std::string &method, bool enable = true);
+
+  bool is_deferred(const char *method) const;
+
+  /*!
+   * \brief Caches the replies of a method.
+   *
+   * Once `method' replied successfully, calls with the same arguments are
+   * answered with a copy of that reply, without invoking the handler, for
+   * `ttl' milliseconds (0 means until invalidated). At most `max_entries'
+   * distinct argument lists are remembered. Only suitable for methods whose
+   * result depends on nothing but their arguments and the state which
+   * invalidates the cache when it changes.
+   *
+   * Enabled by the org.dbuscxx.Method.Cache annotation in generated
+   * adaptors, its value being the ttl.
+   */
+  void cache_method(const std::string &method, unsigned int ttl, size_t max_entries = 256);
+
+  /*!
+   * \brief Forgets the cached replies of all the methods, or of one.
+   *
+   * Can be called from any thread. Calls pending at that time don't fill
+   * the cache when they complete.
+   */
+  void invalidate_cache();
+
+  void invalidate_cache(const std::string &method);
+
+  bool is_cached(const char *method) const;
+
 protected:
 
+  /*!
+   * \brief Finds the handler of `member' among the methods registered at
+   *        run time, or NULL.
+   */
+  virtual MethodTable::mapped_type *find_method(const char *member);
+
   MethodTable	_methods;
   PropertyTable	_properties;
+
+private:
+
+  /*	used by ObjectAdaptor, `args' being the signature and body of the call
+  */
+  DXXAPILOCAL bool cached_reply(const char *method, const std::string &args, Message &reply);
+
+  DXXAPILOCAL void cache_reply(const char *method, const std::string &args, const Message &reply,
+                               unsigned long generation);
+
+  DXXAPILOCAL unsigned long cache_generation() const;
+
+  struct CachedReply
+  {
+    Message reply;
+    double expiration; // 0 if it never expires
+  };
+
+  typedef std::map<std::string, CachedReply> CachedReplyTable;
+
+  struct CachedMethod
+  {
+    unsigned int ttl;
+    size_t max_entries;
+    CachedReplyTable replies;
+  };
+
+  typedef std::map<std::string, CachedMethod> CachedMethodTable;
+
+  std::set<std::string> _single_flight;
+  std::set<std::string> _deferred;
+
+  CachedMethodTable _cache;
+  unsigned long _cache_generation;
+  mutable volatile int _caching; // some method is cached, read with __sync_*
+  mutable DefaultMutex _cache_mutex;
+
+  friend class ObjectAdaptor;
 };
 
 /*
@@ -160,6 +412,83 @@ protected:
 
 typedef std::map< std::string, Slot<void, const SignalMessage &> > SignalTable;
 
+/*!
+ * \brief Narrows down the emissions of a signal a proxy receives, see
+ *        InterfaceProxy::match_signal().
+ *
+ * Each constraint is a key of the proxy's match rule for the signal, so the
+ * bus daemon drops the other emissions before they reach the process. They
+ * are checked again on arrival, since a broader rule, e.g. another proxy's,
+ * may let them through.
+ */
+class DXXAPI SignalMatch
+{
+public:
+
+  SignalMatch();
+
+  /*!
+   * \brief Only the emissions whose argument `n', a string, is `value'
+   *        (key argN).
+   *
+   * \throw ErrorInvalidArgs If `n' is beyond what the bus supports.
+   */
+  SignalMatch &arg(unsigned int n, const std::string &value);
+
+  /*!
+   * \brief Only the emissions whose argument `n', a string or an object
+   *        path, is `path', or is below it or above it if either ends with a
+   *        '/' (key argNpath).
+   *
+   * \throw ErrorInvalidArgs If `n' is beyond what the bus supports.
+   */
+  SignalMatch &arg_path(unsigned int n, const std::string &path);
+
+  /*!
+   * \brief Only the emissions whose first argument, a string, is the bus
+   *        name `ns' or one in its namespace, e.g. `ns'.Foo (key
+   *        arg0namespace).
+   */
+  SignalMatch &arg0_namespace(const std::string &ns);
+
+  /*!
+   * \brief The emissions of the objects below the proxy's path as well
+   *        (key path_namespace).
+   */
+  SignalMatch &path_namespace();
+
+  inline bool below() const;
+
+  /*!
+   * \brief The keys of the constraints on the arguments, each preceded by a
+   *        comma, to append to a match rule.
+   */
+  std::string keys() const;
+
+  /*!
+   * \brief Whether the arguments of `sig' meet the constraints.
+   */
+  bool matches(const SignalMessage &sig) const;
+
+private:
+
+  struct Arg
+  {
+    unsigned int n;
+    bool path;
+    std::string value;
+  };
+
+  std::vector<Arg> _args;
+  std::string _arg0_namespace;
+  bool _below;
+};
+
+bool SignalMatch::below() const
+{
+  return _below;
+}
+
 class DXXAPI InterfaceProxy : public Interface, public virtual ProxyBase
 {
 public:
@@ -170,11 +499,54 @@ public:
 
   bool invoke_method_noreply(const CallMessage &call);
 
+  /*!
+   * \brief Sends the call without waiting for the reply.
+   *
+   * `handler' gets the completed PendingCall, with `data' attached, and
+   * `object' in the dispatcher thread. Generated proxies build their
+   * Method_async() variants on it.
+   */
+  PendingCall invoke_method_async(const CallMessage &call, PendingCall::Handler handler, void *object,
+                                  void *data = NULL);
+
   bool dispatch_signal(const SignalMessage &);
 
+  /*!
+   * \brief Narrows down the emissions of signal `member' the proxy gets,
+   *        replacing the constraints given before, if any.
+   *
+   * The proxy asks the bus for each signal it handles on its own, or for
+   * the whole interface as long as it handles all of its signals without
+   * constraints.
+   */
+  void match_signal(const char *member, const SignalMatch &match);
+
+  /*!
+   * \brief Stops handling signal `member': the bus no longer sends it for
+   *        this proxy.
+   */
+  void disconnect_signal(const char *member);
+
 protected:
 
+  /*!
+   * \brief Finds the handler of signal `member', or NULL; overridden by
+   *        generated proxies as InterfaceAdaptor::find_method() is.
+   */
+  virtual SignalTable::mapped_type *find_signal(const char *member);
+
   SignalTable	_signals;
+
+private:
+
+  // the constraints given by match_signal(), if any
+  const SignalMatch *find_match(const char *member) const;
+
+  typedef std::map<std::string, SignalMatch> SignalMatchTable;
+
+  SignalMatchTable _matches;
+
+  friend class ObjectProxy;
 };
 
 # define register_method(interface, method, callback) \
@@ -71,6 +71,8 @@ public:
 protected:
 
   IntrospectedInterface *introspect() const;
+
+  const MethodEntry *method_table() const;
 };
 
 class DXXAPI IntrospectableProxy : public InterfaceProxy
@@ -131,6 +131,11 @@ public:
 
   void copy_data(MessageIter &to);
 
+  /*!
+   * \brief Copies the current value only, copy_data() copies up to the end.
+   */
+  void copy_value(MessageIter &to);
+
   Message &msg() const
   {
     return *_msg;
@@ -178,6 +183,12 @@ public:
 
   int serial() const;
 
+  /*!
+   * \brief Numbers a message which is dispatched locally rather than sent,
+   *        so it can be replied to; sending a message numbers it.
+   */
+  void serial(int);
+
   int reply_serial() const;
 
   bool reply_serial(int);
@@ -194,6 +205,21 @@ public:
 
   bool is_signal(const char *interface, const char *member) const;
 
+  /*!
+   * \brief Size of the message on the wire, in bytes.
+   *
+   * The message is marshalled to find out, so this is not cheap.
+   */
+  size_t size() const;
+
+  /*!
+   * \brief The arguments of the message, serialized as on the wire.
+   *
+   * Two messages with the same signature and byte order carry the same
+   * arguments if and only if their bodies are equal.
+   */
+  std::string body() const;
+
   MessageIter reader() const;
 
   MessageIter writer();
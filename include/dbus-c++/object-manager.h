@@ -0,0 +1,170 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_OBJECT_MANAGER_H
+#define __DBUSXX_OBJECT_MANAGER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "api.h"
+#include "types.h"
+#include "interface.h"
+
+namespace DBus
+{
+
+class ObjectAdaptor;
+
+/*!
+ * \brief The properties of an interface, by name: a{sv}.
+ */
+typedef std::map<std::string, Variant> PropertyValues;
+
+/*!
+ * \brief The interfaces of an object and their properties: a{sa{sv}}.
+ */
+typedef std::map<std::string, PropertyValues> InterfaceValues;
+
+/*!
+ * \brief The objects below a manager: a{oa{sa{sv}}}.
+ */
+typedef std::map<Path, InterfaceValues> ManagedObjects;
+
+/*!
+ * \brief The org.freedesktop.DBus.ObjectManager interface, handing out a
+ *        whole tree of objects in one message.
+ *
+ * GetManagedObjects() -> a{oa{sa{sv}}} returns every object this
+ * connection exports below the manager's path, with all their interfaces
+ * and the values of their readable properties, instead of a client
+ * walking the tree with Introspect and Properties.Get.
+ *
+ * InterfacesAdded is emitted when an object below the manager calls
+ * ObjectAdaptor::announce(), once its properties are set, and
+ * InterfacesRemoved when an announced object unregisters. Each manager
+ * above an object reports it, the objects of a SubtreeAdaptor are not.
+ * GetManagedObjects() lists the registered objects, announced or not.
+ *
+ * Add it to the object at the root of the tree to manage:
+ *
+ *   class Root : public DBus::ObjectManagerAdaptor, public DBus::ObjectAdaptor
+ */
+class DXXAPI ObjectManagerAdaptor : public InterfaceAdaptor
+{
+public:
+
+  ObjectManagerAdaptor();
+
+  ~ObjectManagerAdaptor();
+
+  Message GetManagedObjects(const CallMessage &);
+
+protected:
+
+  IntrospectedInterface *introspect() const;
+
+  const MethodEntry *method_table() const;
+
+private:
+
+  /*	the managers in the objects above `object' on its connection, the
+  	closest first
+  */
+  DXXAPILOCAL static std::vector<ObjectManagerAdaptor *> managers_of(ObjectAdaptor &object);
+
+  // from ObjectAdaptor, signal the managers above `object'
+  DXXAPILOCAL static void registered(ObjectAdaptor &object);
+
+  DXXAPILOCAL static void unregistered(ObjectAdaptor &object);
+
+  DXXAPILOCAL void interfaces_added(ObjectAdaptor &object);
+
+  DXXAPILOCAL void interfaces_removed(ObjectAdaptor &object);
+
+  // the interfaces of `object' with their properties, a{sa{sv}}
+  DXXAPILOCAL static void append_interfaces(MessageIter &iter, ObjectAdaptor &object);
+
+  friend class ObjectAdaptor;
+};
+
+/*!
+ * \brief A client of org.freedesktop.DBus.ObjectManager, mirroring the
+ *        objects of the remote manager.
+ *
+ * refresh() fills the mirror with one GetManagedObjects() call, the
+ * InterfacesAdded and InterfacesRemoved signals keep it up to date from
+ * then on. Use it from the dispatcher thread.
+ *
+ *   class Objects : public DBus::ObjectManagerProxy, public DBus::ObjectProxy
+ */
+class DXXAPI ObjectManagerProxy : public InterfaceProxy
+{
+public:
+
+  ObjectManagerProxy();
+
+  ManagedObjects GetManagedObjects();
+
+  /*!
+   * \brief Replaces the mirror with what GetManagedObjects() returns.
+   */
+  void refresh();
+
+  /*!
+   * \brief The objects of the manager as last known.
+   */
+  inline const ManagedObjects &objects() const;
+
+protected:
+
+  /*!
+   * \brief Called once the mirror gained `interfaces' for `path'.
+   */
+  virtual void InterfacesAdded(const Path &/*path*/, const InterfaceValues &/*interfaces*/)
+  {}
+
+  /*!
+   * \brief Called once the mirror lost `interfaces' for `path', and the
+   *        object itself if none are left.
+   */
+  virtual void InterfacesRemoved(const Path &/*path*/, const std::vector<std::string> &/*interfaces*/)
+  {}
+
+private:
+
+  void _InterfacesAdded_stub(const SignalMessage &);
+
+  void _InterfacesRemoved_stub(const SignalMessage &);
+
+  ManagedObjects _objects;
+};
+
+const ManagedObjects &ObjectManagerProxy::objects() const
+{
+  return _objects;
+}
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_OBJECT_MANAGER_H
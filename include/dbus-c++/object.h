@@ -27,11 +27,14 @@
 
 #include <string>
 #include <list>
+#include <vector>
 
 #include "api.h"
+#include "admission.h"
 #include "interface.h"
 #include "connection.h"
 #include "message.h"
+#include "tag-table.h"
 #include "types.h"
 
 namespace DBus
@@ -101,20 +104,305 @@ class DXXAPI Tag
 {
 public:
 
+  Tag() : _cancelled(0)
+  {}
+
   // This will be called when the tag is added to continuation
   // tracking. This can be used as a callback when it is "safe" to
   // send "return_later()" work to another thread that can use the
   // continuation.
   virtual void tag_registered(void) const {
   }
+
+  // This will be called, in the dispatcher thread, when the caller
+  // left the bus before the reply was sent. The continuation is
+  // already gone (find_continuation_call_message() returns NULL), so
+  // the work can be abandoned. Must not call back into the adaptor.
+  // The library only cancels tags in the dispatcher thread, a
+  // RequestPiper worker which finds its call cancelled hands the tags
+  // back to the dispatcher thread instead of cancelling them itself.
+  virtual void tag_cancelled(void) const {
+  }
+
+  // Cancellation token, safe to poll from any thread.
+  bool cancelled(void) const
+  {
+    return __sync_fetch_and_add(&_cancelled, 0) != 0;
+  }
+
+  // Runs tag_cancelled() the first time only, in the calling thread.
+  void cancel(void) const
+  {
+    if (__sync_bool_compare_and_swap(&_cancelled, 0, 1))
+      tag_cancelled();
+  }
+
   virtual ~Tag()
   {}
+
+private:
+
+  mutable volatile int _cancelled;
+};
+
+/*!
+ * \brief The method call being handled by the current thread.
+ *
+ * The library sets one up around each method handler, in the dispatcher
+ * thread as well as in RequestPiper worker threads, so that a handler can
+ * reach its call without it being passed through the generated code.
+ *
+ * It also settles the call without exceptions: a handler calls defer()
+ * or fail() and returns, instead of throwing from return_later() or
+ * throwing an Error, which is much cheaper when calls often fail.
+ */
+class DXXAPI CallContext
+{
+public:
+
+  CallContext(const CallMessage &call, const Tag *tag = NULL);
+
+  ~CallContext();
+
+  /*!
+   * \return The innermost call handled by this thread, or NULL.
+   */
+  static CallContext *current();
+
+  inline const CallMessage &call() const;
+
+  inline const char *sender() const;
+
+  inline const Tag *tag() const;
+
+  /*!
+   * \return true once the caller has left the bus; long running handlers
+   *         should poll it and give up, the reply can't be delivered.
+   */
+  inline bool cancelled() const;
+
+  /*!
+   * \brief Defers the reply, as ObjectAdaptor::return_later() does but
+   *        without throwing.
+   *
+   * The handler then returns normally, what it returns is ignored. The
+   * reply is sent later with ObjectAdaptor::return_now(tag, ...).
+   */
+  void defer(const Tag *tag);
+
+  /*!
+   * \brief Fails the call, as throwing the error does but without unwinding.
+   *
+   * The handler then returns normally, what it returns is ignored and the
+   * caller gets the error.
+   */
+  void fail(const char *name, const char *message);
+
+  void fail(const Error &error);
+
+  /*!
+   * \return The tag given to defer(), or NULL.
+   */
+  inline const Tag *deferred() const;
+
+  inline bool failed() const;
+
+  inline const char *error_name() const;
+
+  inline const char *error_message() const;
+
+  /*!
+   * \brief Gives the call `timeout' milliseconds from now to complete.
+   *
+   * Calls the handler makes through proxies inherit what is left of it,
+   * see Deadline.
+   */
+  void expires_in(int timeout);
+
+  /*!
+   * \return Milliseconds left before the call's deadline, 0 once it
+   *         passed, -1 if it has none.
+   */
+  int remaining() const;
+
+  inline bool expired() const;
+
+  /*!
+   * \brief The deadline, on the clock of Deadline::now(), or 0 if none;
+   *        to carry it along with the call to another thread.
+   */
+  inline double expiration() const;
+
+  inline void expiration(double e);
+
+  /*!
+   * \return true for the sub-calls of a batch (see BatchAdaptor), which
+   *         must be answered right away: they can't be deferred.
+   */
+  inline bool batched() const;
+
+  inline void batched(bool b);
+
+  /*!
+   * \return true if the handler of the current call deferred or failed
+   *         it, generated stubs then skip building the reply.
+   */
+  static bool settled();
+
+private:
+
+  CallContext(const CallContext &);
+
+  CallContext &operator = (const CallContext &);
+
+  const CallMessage &_call;
+  const Tag *_tag;
+  CallContext *_previous;
+
+  const Tag *_deferred;
+  bool _failed;
+  std::string _error_name;
+  std::string _error_message;
+
+  double _expiration;
+  bool _batched;
 };
 
+/*!
+ * \brief Bounds the method calls the current thread makes while in scope.
+ *
+ * D-Bus doesn't carry deadlines to the callee, so they are enforced on
+ * the calling side: proxy calls made in the scope time out when it
+ * expires, and fail right away with ErrorTimeout once it has. Scopes
+ * nest, the earliest deadline wins, and so does the deadline of the call
+ * being handled (see CallContext::expires_in()): a handler's outgoing
+ * calls don't outlive its own caller's budget.
+ *
+ *   {
+ *     DBus::Deadline d(500);
+ *     proxy.Foo();
+ *     proxy.Bar(); // gets what Foo() left of the 500ms
+ *   }
+ */
+class DXXAPI Deadline
+{
+public:
+
+  /*!
+   * \param timeout In milliseconds from now.
+   */
+  Deadline(int timeout);
+
+  ~Deadline();
+
+  /*!
+   * \return Milliseconds left, 0 once expired.
+   */
+  int remaining() const;
+
+  bool expired() const;
+
+  /*!
+   * \return The innermost scope of the current thread, or NULL.
+   */
+  static Deadline *current();
+
+  /*!
+   * \brief Bounds the timeout of an outgoing call by the deadlines of
+   *        the current thread.
+   *
+   * \param timeout In milliseconds, -1 for the default.
+   * \return `timeout' or less, -1 if nothing bounds it.
+   * \throw ErrorTimeout If a deadline already passed.
+   */
+  static int bound(int timeout);
+
+  /*!
+   * \return A monotonic clock, in milliseconds.
+   */
+  static double now();
+
+private:
+
+  Deadline(const Deadline &);
+
+  Deadline &operator = (const Deadline &);
+
+  double _expiration;
+  Deadline *_previous;
+};
+
+const CallMessage &CallContext::call() const
+{
+  return _call;
+}
+
+const char *CallContext::sender() const
+{
+  return _call.sender();
+}
+
+const Tag *CallContext::tag() const
+{
+  return _tag;
+}
+
+bool CallContext::cancelled() const
+{
+  return _tag && _tag->cancelled();
+}
+
+const Tag *CallContext::deferred() const
+{
+  return _deferred;
+}
+
+bool CallContext::failed() const
+{
+  return _failed;
+}
+
+const char *CallContext::error_name() const
+{
+  return _error_name.c_str();
+}
+
+const char *CallContext::error_message() const
+{
+  return _error_message.c_str();
+}
+
+bool CallContext::expired() const
+{
+  return _expiration && _expiration <= Deadline::now();
+}
+
+double CallContext::expiration() const
+{
+  return _expiration;
+}
+
+void CallContext::expiration(double e)
+{
+  _expiration = e;
+}
+
+bool CallContext::batched() const
+{
+  return _batched;
+}
+
+void CallContext::batched(bool b)
+{
+  _batched = b;
+}
+
 /*
 */
 
 class ObjectAdaptor;
+class SubtreeAdaptor;
+class ObjectManagerAdaptor;
 
 typedef std::list<ObjectAdaptor *> ObjectAdaptorPList;
 typedef std::list<std::string> ObjectPathList;
@@ -123,20 +411,102 @@ class DXXAPI ObjectAdaptor : public Object, public virtual AdaptorBase
 {
 public:
 
+  /*!
+   * \brief The object exported at `path' on `conn', or NULL.
+   *
+   * Each connection indexes its objects by path segment, this costs the
+   * depth of the path. Thread safe.
+   */
+  static ObjectAdaptor *from_path(Connection &conn, const Path &path);
+
+  /*!
+   * \brief The names of the nodes right under `path' on `conn', sorted;
+   *        each leads to at least one object. Thread safe.
+   */
+  static ObjectPathList child_nodes(Connection &conn, const Path &path);
+
+  /*!
+   * \brief The objects exported on `conn' whose path starts with the
+   *        string `prefix'. Thread safe.
+   */
+  static ObjectAdaptorPList from_path_prefix(Connection &conn, const std::string &prefix);
+
+  /*!
+   * \brief Same as from_path(Connection &, const Path &), searching the
+   *        objects of every connection.
+   */
   static ObjectAdaptor *from_path(const Path &path);
 
+  /*!
+   * \brief The objects of every connection whose path starts with the
+   *        string `prefix'.
+   */
   static ObjectAdaptorPList from_path_prefix(const std::string &prefix);
 
+  /*!
+   * \brief The segments after `prefix' of the objects' paths starting
+   *        with it, on every connection; see child_nodes().
+   */
   static ObjectPathList child_nodes_from_prefix(const std::string &prefix);
 
   struct Private;
 
   ObjectAdaptor(Connection &conn, const Path &path);
 
+  /*!
+   * \brief An object of `subtree', as returned by
+   *        SubtreeAdaptor::resolve(): it is not registered with the
+   *        connection, the subtree dispatches its calls.
+   */
+  ObjectAdaptor(SubtreeAdaptor &subtree, const Path &path);
+
   ~ObjectAdaptor();
 
   inline const ObjectAdaptor *object() const;
 
+  /*!
+   * \brief Admission control for the calls dispatched to this object.
+   *
+   * Use it to set concurrency and queue limits and to read the
+   * admitted/rejected counters.
+   */
+  inline AdmissionControl &admission();
+
+  /*!
+   * \brief Gives the calls dispatched to this object `timeout'
+   *        milliseconds from their arrival to complete, -1 for no limit.
+   *
+   * Handlers see the deadline in CallContext, their own outgoing calls
+   * are bounded by it and RequestPiper drops the calls which expired
+   * while queued.
+   */
+  void call_budget(int timeout);
+
+  inline int call_budget() const;
+
+  /*!
+   * \brief The introspection data of the object, see
+   *        IntrospectableAdaptor.
+   *
+   * The document is assembled on first request and kept until the object
+   * gains interfaces or nodes appear or vanish right below it. Thread
+   * safe.
+   */
+  std::string introspection();
+
+  /*!
+   * \brief Emits InterfacesAdded for this object from the
+   *        ObjectManagerAdaptors above it, with the current values of its
+   *        properties.
+   *
+   * Registering the object does not emit it, the constructors of the
+   * derived classes not having set the properties yet: call it once they
+   * did, at the end of the most derived constructor for instance, and
+   * again whenever the values reported should be refreshed. Only announced
+   * objects emit InterfacesRemoved when they unregister.
+   */
+  void announce();
+
 protected:
 
   struct ReturnLaterError
@@ -148,7 +518,11 @@ protected:
   {
   public:
 
-    inline MessageIter &writer();
+    /*!
+     * \brief Where to append the out arguments of the reply, created on
+     *        first use: calls ending in an error never build it.
+     */
+    MessageIter &writer();
 
     inline Tag *tag();
 
@@ -156,19 +530,51 @@ protected:
 
     Continuation(Connection &conn, const CallMessage &call, const Tag *tag);
 
+    ~Continuation();
+
+    Continuation(const Continuation &);
+
+    Continuation &operator = (const Continuation &);
+
     Connection _conn;
     CallMessage _call;
+    ReturnMessage *_return;
     MessageIter _writer;
-    ReturnMessage _return;
     const Tag *_tag;
 
+    // identical calls waiting for this one, see InterfaceAdaptor::single_flight()
+    std::string _flight;
+    std::vector<CallMessage> _waiters;
+    bool _orphaned; // _call's sender left, only the _waiters want the reply
+
+    // where to keep the reply, see InterfaceAdaptor::cache_method()
+    InterfaceAdaptor *_cache;
+    std::string _cache_args;
+    unsigned long _cache_generation;
+
     friend class ObjectAdaptor;
   };
 
   void return_later(const Tag *tag);
 
+  /*!
+   * \brief Like return_later(), but returns instead of throwing: the
+   *        handler must then return, with any value.
+   *
+   * Falls back to throwing outside of a dispatched call.
+   */
+  void defer_return(const Tag *tag);
+
   void return_now(Continuation *ret);
 
+  /*!
+   * \brief Sends the reply to the call deferred with `tag'.
+   *
+   * A method return or error message is sent as is, without copying its
+   * arguments: build it with the out arguments of the call, e.g. from
+   * find_continuation_call_message(tag). Alternatively fill in
+   * find_continuation(tag)->writer() and call return_now(continuation).
+   */
   virtual void return_now(const Tag *tag, Message _return);
   virtual const CallMessage* find_continuation_call_message(const Tag *tag);
 
@@ -176,6 +582,15 @@ protected:
 
   Continuation *find_continuation(const Tag *tag);
 
+  /*!
+   * \brief Called when `sender' left the bus while some of its calls
+   *        were pending.
+   *
+   * Frees their continuations and cancels their tags. Subclasses keeping
+   * calls elsewhere override it to drop them too.
+   */
+  virtual void caller_vanished(const std::string &sender);
+
 protected:
 
   virtual void _emit_signal(SignalMessage &);
@@ -184,13 +599,56 @@ private:
 
   bool handle_message(const Message &);
 
+  /*	runs `call', which has its arguments and sender, through interface
+  	and member of this object and returns the reply instead of sending it
+  */
+  Message dispatch_local(CallMessage &call, const std::string &interface, const std::string &member);
+
   void register_obj();
   void unregister_obj(bool throw_on_error = true);
 
-  typedef std::map<const Tag *, Continuation *> ContinuationMap;
-  ContinuationMap _continuations;
+  void complete(Continuation *ret, Message &reply);
+
+  void watch_caller(const char *sender);
+  void unwatch_caller(const char *sender);
+  bool caller_filter(const Message &);
+
+  Continuation *new_continuation(const CallMessage &call, const Tag *tag);
+  void delete_continuation(Continuation *c);
+
+  // deferred calls, indexed by tag; a service may hold a great many
+  TagTable<Continuation> _continuations;
+  SlabPool<Continuation> _continuation_pool;
+
+  AdmissionControl _admission;
+  int _call_budget;
+
+  // not registered, see SubtreeAdaptor
+  SubtreeAdaptor *_subtree;
+
+  // InterfacesAdded was emitted, see announce()
+  bool _announced;
+
+  // see introspection(); interfaces are only ever added
+  std::string _introspection;
+  unsigned long _introspection_stamp;
+  size_t _introspection_interfaces;
+  DefaultMutex _introspection_mutex;
+
+  // pending single flight calls, keyed on interface, member and arguments
+  typedef std::map<std::string, Continuation *> FlightTable;
+  FlightTable _flights;
+
+  // senders of pending calls, with the number of their continuations
+  typedef std::map<std::string, unsigned int> CallerTable;
+  CallerTable _callers;
+  MessageSlot _caller_filter;
 
   friend struct Private;
+  friend class CoroutineBridge;
+  friend class BatchAdaptor;
+  friend class SubtreeAdaptor;
+  friend class ObjectManagerAdaptor;
 };
 
 const ObjectAdaptor *ObjectAdaptor::object() const
@@ -198,16 +656,22 @@ const ObjectAdaptor *ObjectAdaptor::object() const
   return this;
 }
 
-Tag *ObjectAdaptor::Continuation::tag()
+AdmissionControl &ObjectAdaptor::admission()
 {
-  return const_cast<Tag *>(_tag);
+  return _admission;
 }
 
-MessageIter &ObjectAdaptor::Continuation::writer()
+int ObjectAdaptor::call_budget() const
 {
-  return _writer;
+  return _call_budget;
 }
 
+Tag *ObjectAdaptor::Continuation::tag()
+{
+  return const_cast<Tag *>(_tag);
+}
+
+
 /*
 */
 
@@ -231,14 +695,24 @@ private:
 
   bool _invoke_method_noreply(CallMessage &call);
 
+  PendingCall _invoke_method_async(CallMessage &call, PendingCall::Handler handler, void *object, void *data);
+
   bool handle_message(const Message &);
 
   void register_obj();
   void unregister_obj(bool throw_on_error = true);
 
-private:
+  void _resubscribe();
+
+  /*	the match rules for the signals the interfaces handle, and the
+  	interfaces asking for the objects below the path
+  */
+  void subscriptions(std::vector<std::string> &rules, std::vector<std::string> &below) const;
+
+  std::vector<std::string> _rules;
+  std::vector<std::string> _below;
 
-  MessageSlot _filtered;
+  friend class SignalRouter;
 };
 
 const ObjectProxy *ObjectProxy::object() const
@@ -34,12 +34,26 @@ namespace DBus
 
 class Connection;
 
+/*!
+ * \brief A method call waiting for its reply.
+ *
+ * Copies share the same call. The completion handler and the user data
+ * are kept in a pooled object tied to the underlying DBusPendingCall, so
+ * an asynchronous call allocates nothing on its own when it uses
+ * handler() rather than slot().
+ */
 class DXXAPI PendingCall
 {
 public:
 
   struct Private;
 
+  /*!
+   * \brief Completion handler, called with the completed call and the
+   *        `object' given along with it.
+   */
+  typedef void (*Handler)(PendingCall &call, void *object);
+
   PendingCall(Private *);
 
   PendingCall(const PendingCall &);
@@ -83,31 +97,32 @@ public:
   void block();
 
   /*!
-   * \brief Stores a pointer on a PendingCall, along with an optional function to
-   *        be used for freeing the data when the data is set again, or when the
-   *        pending call is finalized.
-   *
-   * The slot is allocated automatic.
+   * \brief Stores a pointer on a PendingCall, shared by all its copies.
    *
    * \param data The data to store.
-   * \throw ErrorNoMemory
    */
   void data(void *data);
 
   /*!
-   * \brief Retrieves data previously set with dbus_pending_call_set_data().
-   *
-   * The slot must still be allocated (must not have been freed).
-   *
-   * \return The data, or NULL if not found.
+   * \return The data stored with data(void *), or NULL.
    */
   void *data();
 
   /*!
-   * \return The data slot.
+   * \return The slot called when the call completes, unless a handler()
+   *         is set.
    */
   Slot<void, PendingCall &>& slot();
 
+  /*!
+   * \brief Sets the function called when the call completes.
+   *
+   * Takes precedence over slot(). If the completion was dispatched
+   * already the handler is called right away, in the calling thread:
+   * either way it is called exactly once. Set it only once per call.
+   */
+  void handler(Handler handler, void *object);
+
   /*!
    * \brief Gets the reply
    *
@@ -122,12 +137,25 @@ public:
 
 private:
 
-  RefPtrI<Private> _pvt;
+  // adopts a reference to the call
+  PendingCall(Private *, bool);
+
+  Private *_pvt;
 
   friend struct Private;
   friend class Connection;
 };
 
+/*!
+ * \brief A PendingCall::Handler calling member function M of the object,
+ *        e.g. pending_call_member< Proxy, &Proxy::on_reply >.
+ */
+template <class C, void (C::*M)(PendingCall &)>
+void pending_call_member(PendingCall &call, void *object)
+{
+  (static_cast<C *>(object)->*M)(call);
+}
+
 } /* namespace DBus */
 
 #endif//__DBUSXX_PENDING_CALL_H
@@ -32,35 +32,130 @@
 namespace DBus
 {
 
+/*!
+ * \brief A property of an adaptor.
+ *
+ * The value is kept as a T: reading it locally costs what reading a
+ * member does, it is only marshalled when Properties.Get, GetAll or an
+ * ObjectManager serve it. Get keeps the encoding until the next
+ * assignment, cache() does so for the others too, for large values read
+ * more often than written.
+ */
 template <typename T>
-class PropertyAdaptor
+class PropertyAdaptor : public PropertyBase
 {
 public:
 
-  PropertyAdaptor() : _data(0)
+  PropertyAdaptor() : _value(), _encoded(NULL), _cache(false)
+  {}
+
+  PropertyAdaptor(const PropertyAdaptor &p)
+    : PropertyBase(), _value(p._value), _encoded(NULL), _cache(p._cache)
   {}
 
+  ~PropertyAdaptor()
+  {
+    delete _encoded;
+  }
+
+  /*!
+   * \brief Makes `data', an entry of InterfaceAdaptor::_properties, refer
+   *        to this value; see bind_property().
+   */
   void bind(PropertyData &data)
   {
-    _data = &data;
+    data.storage = this;
   }
 
-  T operator()(void) const
+  const T &operator()(void) const
   {
-    return _data->value.operator T();
+    return _value;
   }
 
   PropertyAdaptor &operator = (const T &t)
   {
-    _data->value.clear();
-    MessageIter wi = _data->value.writer();
-    wi << t;
+    _value = t;
+    forget();
+    return *this;
+  }
+
+  PropertyAdaptor &operator = (const PropertyAdaptor &p)
+  {
+    if (&p != this)
+    {
+      _value = p._value;
+      forget();
+    }
     return *this;
   }
 
+  /*!
+   * \brief Keeps the encoding of the value for every request, not only
+   *        Get, until the next assignment.
+   */
+  void cache(bool enable = true)
+  {
+    _cache = enable;
+
+    if (!enable)
+      forget();
+  }
+
+  const Variant &value() const
+  {
+    return const_cast<PropertyAdaptor *>(this)->encoded();
+  }
+
+  const Variant &encoded()
+  {
+    if (!_encoded)
+    {
+      _encoded = new Variant;
+
+      MessageIter wi = _encoded->writer();
+      wi << _value;
+    }
+    return *_encoded;
+  }
+
+  void append(MessageIter &iter)
+  {
+    if (_encoded || _cache)
+    {
+      iter << encoded();
+      return;
+    }
+
+    MessageIter vi = iter.new_variant(type<T>::sig().c_str());
+    vi << _value;
+    iter.close_container(vi);
+  }
+
+  void assign(const Variant &value)
+  {
+    MessageIter ri = value.reader();
+    ri >> _value;
+    forget();
+
+    // what was received is the encoding already
+    if (_cache)
+    {
+      _encoded = new Variant;
+      *_encoded = value;
+    }
+  }
+
 private:
 
-  PropertyData *_data;
+  void forget()
+  {
+    delete _encoded;
+    _encoded = NULL;
+  }
+
+  T _value;
+  Variant *_encoded;
+  bool _cache;
 };
 
 struct IntrospectedInterface;
@@ -75,6 +170,12 @@ public:
 
   Message Set(const CallMessage &);
 
+  /*!
+   * \brief Returns all the readable properties of an interface at once;
+   *        on_get_property() is not called for them.
+   */
+  Message GetAll(const CallMessage &);
+
 protected:
 
   virtual void on_get_property(InterfaceAdaptor &/*interface*/, const std::string &/*property*/, Variant &/*value*/)
@@ -84,6 +185,8 @@ protected:
   {}
 
   IntrospectedInterface *introspect() const;
+
+  const MethodEntry *method_table() const;
 };
 
 class DXXAPI PropertiesProxy : public InterfaceProxy
@@ -26,6 +26,7 @@
 #include "eventloop.h" //for DefaultMutex
 #include "message.h" //for Message
 #include "util.h" //for Slot
+#include "tag-table.h"
 #include <vector>
 #include <utility>
 
@@ -53,9 +54,12 @@
 
   Your RequestPiper subclass instance needs to know the correct,
   original method to call once your Service Worker Thread receives
-  notification via the pipe and request queue, so prior to remapping
-  to the _Forwarding_stub you must copy the original __methods table
-  map into the origMethodTable instance variable.
+  notification via the pipe and request queue. Generated adaptors
+  list their stubs in a static table, see
+  InterfaceAdaptor::method_table(), and _call_orig_method() finds them
+  there. Methods registered at run time in _methods must be copied
+  into the origMethodTable instance variable prior to remapping them
+  to the _Forwarding_stub.
 
   During runtime, when your re-mapped method is called, (1) Diagram A
   below, the _Forwarding_stub defers processing of the request by
@@ -63,8 +67,8 @@
   (2) in the below diagram, and the service worker thread is alerted
   by using the RequestPipe as the notification mechanism, (3) in the
   diagram below. Finally the initial dispatcher thread processing
-  finishes by calling Object::return_later() method which tells DBus
-  C++ that this call will responded to in the future.
+  finishes by calling ObjectAdaptor::defer_return() method which tells
+  DBus C++ that this call will responded to in the future.
 
   Your worker thread is altered to queued requests by characters
   written to the request_pipefd, (4) in the following diagram, so
@@ -133,6 +137,49 @@
 
   Diagram B: Signal Sending From Worker Thread
 
+
+  LOAD SHEDDING
+  -------------
+
+  The request_queue is bounded by the max_queued limits of the
+  object's AdmissionControl (see ObjectAdaptor::admission()). When
+  the queue is full the _Forwarding_stub rejects the call right away
+  with org.freedesktop.DBus.Error.LimitsExceeded (or the configured
+  error) instead of queueing it, and the rejection is counted in the
+  AdmissionControl counters.
+
+  Each sender can also be held to quotas (see
+  AdmissionControl::sender_limits()): a number of calls in flight and
+  a number of bytes waiting in the request_queue, so that one peer
+  flooding the service is rejected while the others are still served.
+
+
+  FAIR QUEUING
+  ------------
+
+  The request_queue is not a plain FIFO: calls are kept in one FIFO
+  per sender (its unique bus name) and the worker thread serves the
+  senders in turn with deficit round-robin (see FairRequestQueue).
+  By default every call costs the same; fair_queue_quantum() makes
+  the cost of a call its size on the wire, so that senders of large
+  calls do not get more than their share of the worker thread.
+
+
+  CANCELLATION
+  ------------
+
+  When a caller leaves the bus its queued calls are dropped, the
+  continuations of its pending calls are freed and their tags are
+  cancelled (see Tag::cancelled() and Tag::tag_cancelled()). A
+  handler running in the worker thread can poll
+  CallContext::current()->cancelled() to give up early.
+
+  With a call budget (see ObjectAdaptor::call_budget()) the calls keep
+  the deadline they got on arrival: those which expired while queued
+  are answered with org.freedesktop.DBus.Error.Timeout without running
+  the handler, and CallContext::current()->remaining() tells a running
+  handler how much time it has left.
+
  */
 
 namespace DBus
@@ -151,6 +198,8 @@ public:
     */
     RequestPiper(Connection &connection, const std::string&  server_path, pthread_t dispatcher_thread);
 
+    ~RequestPiper();
+
     // For sending a response piped with send_later
     virtual void return_now(const Tag *tag, Message _return);
     virtual const CallMessage* find_continuation_call_message(const Tag *tag);
@@ -166,6 +215,12 @@ public:
     void dispatcher_pipe_handler(void *buffer, unsigned int nbyte);
     int get_request_read_fd(void) const;
 
+    /* Calls are served round-robin among their senders; with a
+       non-zero quantum the round-robin shares bytes instead of calls,
+       each sender being allowed about `bytes' per turn.
+    */
+    void fair_queue_quantum(size_t bytes);
+
     // stub for subclass use
     Message _Forwarding_stub(const CallMessage &call);
     Message _call_orig_method(const CallMessage &call);
@@ -176,14 +231,35 @@ protected:
 
     virtual void _emit_signal(SignalMessage &sig);
 
+    // also drops the queued calls and pipe continuations of the sender
+    virtual void caller_vanished(const std::string &sender);
+
 private:
 
-    typedef std::map<const Tag *, std::pair<CallMessage, const Tag*> > PipeContinuationMap;
-    PipeContinuationMap _pipe_continuations;
+    // a call the worker deferred, indexed by the worker's tag
+    struct PipeContinuation {
+        PipeContinuation(const CallMessage &msg, const Tag *later, const Tag *orig)
+            : call(msg, false), tag(later), orig_tag(orig) {}
+
+        CallMessage call;
+        const Tag *tag;      // the worker's tag
+        const Tag *orig_tag; // the forwarding stub's tag
+    };
+
+    void delete_pipe_continuation(PipeContinuation *pc);
+
+    /* frees the continuations whose caller left and cancels the
+       worker's tags, in the dispatcher thread only
+    */
+    void cancel_pipe_continuations(void);
+
+    TagTable<PipeContinuation> _pipe_continuations;
+    SlabPool<PipeContinuation> _pipe_continuation_pool;
     DefaultMutex _pipe_continuations_mutex;
 
-    std::vector< std::pair<CallMessage, Tag*> > request_queue;
+    FairRequestQueue request_queue;
     DefaultMutex request_mutex;
+    size_t _fair_quantum;
 
     //Tag* will be passed via pipe
     std::vector< std::pair<CallMessage, Message > > response_queue;
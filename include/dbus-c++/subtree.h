@@ -0,0 +1,187 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_SUBTREE_H
+#define __DBUSXX_SUBTREE_H
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "api.h"
+#include "connection.h"
+#include "message.h"
+#include "types.h"
+
+namespace DBus
+{
+
+class ObjectAdaptor;
+
+/*!
+ * \brief Serves every object path under a prefix, creating the objects on
+ *        demand.
+ *
+ * The prefix is registered as a fallback with the connection: calls to
+ * any path below it, which no object registered on its own, reach the
+ * subtree. It asks resolve() for the object at that path, dispatches the
+ * call to it and keeps the most recently used objects for the next calls.
+ * Millions of objects, e.g. one per database row, can be exported this
+ * way, only those being called exist at a time.
+ *
+ * The subtree answers org.freedesktop.DBus.Introspectable.Introspect
+ * itself, listing the interfaces of the resolved object, if any, and the
+ * child nodes given by children(), up to max_nodes() of them.
+ *
+ * Use it from the dispatcher thread.
+ */
+class DXXAPI SubtreeAdaptor
+{
+public:
+
+  struct Private;
+
+  /*!
+   * \param cache_size How many resolved objects are kept around, the
+   *        least recently used are destroyed first; with 0 each object is
+   *        destroyed once its call returned.
+   *
+   * \throw ErrorNoMemory If the prefix can't be registered.
+   */
+  SubtreeAdaptor(Connection &conn, const Path &prefix, size_t cache_size = 64);
+
+  /*!
+   * \brief Unregisters the prefix and destroys the objects still kept.
+   */
+  virtual ~SubtreeAdaptor();
+
+  inline Connection &conn();
+
+  inline const Path &prefix() const;
+
+  /*!
+   * \brief Destroys the object kept for `path', if any, e.g. once its
+   *        database row changed or vanished: resolve() is asked again on
+   *        the next call.
+   */
+  void invalidate(const Path &path);
+
+  /*!
+   * \brief Destroys all the objects kept.
+   */
+  void invalidate();
+
+  /*!
+   * \brief How many names Introspect asks children() for at once.
+   */
+  void page_size(size_t size);
+
+  /*!
+   * \brief How many nodes given by children() one Introspect reply lists
+   *        at most, 1024 by default.
+   *
+   * Introspect has no way to ask for the next nodes: beyond that, the
+   * reply lists the first ones in the order of children() and ends with
+   * an XML comment saying it was truncated. The nodes left out are still
+   * served, clients reach them by their path.
+   */
+  void max_nodes(size_t max);
+
+protected:
+
+  /*!
+   * \brief Creates the object at `path', the prefix or a path below it,
+   *        or returns NULL if there is none there.
+   *
+   * Build it with ObjectAdaptor(SubtreeAdaptor &, const Path &) and new:
+   * the subtree owns it, destroying it once evicted or invalidated. An
+   * object with deferred calls pending is only destroyed after they
+   * completed.
+   */
+  virtual ObjectAdaptor *resolve(const Path &path) = 0;
+
+  /*!
+   * \brief Appends to `names' the names of at most `max' nodes right
+   *        under `path', in a stable order, starting with the one after
+   *        `after' (the first one if empty).
+   *
+   * \return true If more nodes follow.
+   */
+  virtual bool children(const Path &path, const std::string &after, size_t max,
+                        std::vector<std::string> &names);
+
+private:
+
+  SubtreeAdaptor(const SubtreeAdaptor &);
+
+  SubtreeAdaptor &operator = (const SubtreeAdaptor &);
+
+  DXXAPILOCAL bool handle_message(const Message &);
+
+  DXXAPILOCAL Message introspect(const CallMessage &call, ObjectAdaptor *object);
+
+  // the object at `path', kept or just resolved, or NULL
+  DXXAPILOCAL ObjectAdaptor *lookup(const Path &path);
+
+  /*	destroys the least recently used objects beyond the cache size and
+  	the retired ones, unless busy
+  */
+  DXXAPILOCAL void trim();
+
+  DXXAPILOCAL static bool busy(ObjectAdaptor *object);
+
+  Connection _conn;
+  Path _prefix;
+  size_t _cache_size;
+  size_t _page_size;
+  size_t _max_nodes;
+
+  // the objects kept, the most recently used first
+  typedef std::list< std::pair<Path, ObjectAdaptor *> > ObjectList;
+  typedef std::map<Path, ObjectList::iterator> ObjectTable;
+
+  ObjectList _lru;
+  ObjectTable _objects;
+
+  // invalidated while handling a call or with deferred calls pending
+  std::vector<ObjectAdaptor *> _retired;
+
+  ObjectAdaptor *_dispatching;
+
+  friend struct Private;
+};
+
+Connection &SubtreeAdaptor::conn()
+{
+  return _conn;
+}
+
+const Path &SubtreeAdaptor::prefix() const
+{
+  return _prefix;
+}
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_SUBTREE_H
@@ -0,0 +1,286 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_TAG_TABLE_H
+#define __DBUSXX_TAG_TABLE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "api.h"
+
+namespace DBus
+{
+
+class Tag;
+
+/*!
+ * \brief Fixed size blocks for objects of type T, carved out of slabs.
+ *
+ * Freed blocks are kept on a free list and reused, slabs are only given
+ * back when the pool is destroyed: once a service reached its peak number
+ * of deferred calls, tracking more of them allocates nothing.
+ *
+ * The pool hands out raw memory, use placement new and call the
+ * destructor before release(). Not thread safe.
+ */
+template <class T, size_t SlabSize = 64>
+class SlabPool
+{
+public:
+
+  SlabPool() : _free(NULL)
+  {}
+
+  ~SlabPool()
+  {
+    for (typename std::vector<Block *>::iterator si = _slabs.begin(); si != _slabs.end(); ++si)
+      delete [] *si;
+  }
+
+  void *allocate()
+  {
+    if (!_free)
+      grow();
+
+    Block *b = _free;
+    _free = b->next;
+    return b->storage;
+  }
+
+  void release(void *p)
+  {
+    Block *b = static_cast<Block *>(p);
+
+    b->next = _free;
+    _free = b;
+  }
+
+private:
+
+  SlabPool(const SlabPool &);
+
+  SlabPool &operator = (const SlabPool &);
+
+  union Block
+  {
+    Block *next;
+    char storage[sizeof(T)];
+
+    // for alignment only
+    long double _ld;
+    void *_p;
+    void (*_f)();
+  };
+
+  void grow()
+  {
+    Block *slab = new Block[SlabSize];
+
+    _slabs.push_back(slab);
+
+    for (size_t i = 0; i < SlabSize; ++i)
+      release(slab + i);
+  }
+
+  std::vector<Block *> _slabs;
+  Block *_free;
+};
+
+/*!
+ * \brief Maps tags to the objects tracking them.
+ *
+ * An open addressing hash table with linear probing: finding, inserting
+ * and erasing are constant time and don't allocate, except when the
+ * table grows. Values are not owned. Not thread safe.
+ */
+template <class T>
+class TagTable
+{
+public:
+
+  TagTable() : _slots(NULL), _mask(0), _size(0)
+  {}
+
+  ~TagTable()
+  {
+    delete [] _slots;
+  }
+
+  size_t size() const
+  {
+    return _size;
+  }
+
+  bool empty() const
+  {
+    return _size == 0;
+  }
+
+  T *find(const Tag *tag) const
+  {
+    if (!_slots)
+      return NULL;
+
+    for (size_t i = hash(tag) & _mask; _slots[i].tag; i = (i + 1) & _mask)
+    {
+      if (_slots[i].tag == tag)
+        return _slots[i].value;
+    }
+    return NULL;
+  }
+
+  /*!
+   * \brief Maps `tag' to `value', replacing what it was mapped to.
+   */
+  void insert(const Tag *tag, T *value)
+  {
+    // keep the load under one half, probe sequences stay short
+    if (2 * (_size + 1) > capacity())
+      grow();
+
+    size_t i = hash(tag) & _mask;
+
+    while (_slots[i].tag && _slots[i].tag != tag)
+      i = (i + 1) & _mask;
+
+    if (!_slots[i].tag)
+      ++_size;
+
+    _slots[i].tag = tag;
+    _slots[i].value = value;
+  }
+
+  /*!
+   * \return What `tag' was mapped to, or NULL.
+   */
+  T *erase(const Tag *tag)
+  {
+    if (!_slots)
+      return NULL;
+
+    size_t i = hash(tag) & _mask;
+
+    while (_slots[i].tag != tag)
+    {
+      if (!_slots[i].tag)
+        return NULL;
+
+      i = (i + 1) & _mask;
+    }
+
+    T *value = _slots[i].value;
+
+    // shift back the entries which probed past the freed slot
+    for (size_t j = (i + 1) & _mask; _slots[j].tag; j = (j + 1) & _mask)
+    {
+      size_t home = hash(_slots[j].tag) & _mask;
+
+      // move j to i unless its home lies cyclically in (i, j]
+      if ((i <= j) ? (home <= i || home > j) : (home <= i && home > j))
+      {
+        _slots[i] = _slots[j];
+        i = j;
+      }
+    }
+
+    _slots[i].tag = NULL;
+    _slots[i].value = NULL;
+    --_size;
+
+    return value;
+  }
+
+  /*!
+   * \brief Appends all the values to `values', e.g. to walk them while
+   *        erasing some.
+   */
+  void values(std::vector<T *> &values) const
+  {
+    for (size_t i = 0; i < capacity(); ++i)
+    {
+      if (_slots[i].tag)
+        values.push_back(_slots[i].value);
+    }
+  }
+
+private:
+
+  TagTable(const TagTable &);
+
+  TagTable &operator = (const TagTable &);
+
+  struct Slot
+  {
+    const Tag *tag;
+    T *value;
+  };
+
+  size_t capacity() const
+  {
+    return _slots ? _mask + 1 : 0;
+  }
+
+  static size_t hash(const Tag *tag)
+  {
+    // tags are heap pointers, their low bits are mostly zero
+    size_t h = reinterpret_cast<size_t>(tag);
+
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h;
+  }
+
+  void grow()
+  {
+    Slot *old = _slots;
+    size_t old_capacity = capacity();
+    size_t new_capacity = old_capacity ? 2 * old_capacity : 16;
+
+    _slots = new Slot[new_capacity];
+    _mask = new_capacity - 1;
+    _size = 0;
+
+    for (size_t i = 0; i < new_capacity; ++i)
+    {
+      _slots[i].tag = NULL;
+      _slots[i].value = NULL;
+    }
+
+    for (size_t i = 0; i < old_capacity; ++i)
+    {
+      if (old[i].tag)
+        insert(old[i].tag, old[i].value);
+    }
+
+    delete [] old;
+  }
+
+  Slot *_slots;
+  size_t _mask;
+  size_t _size;
+};
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_TAG_TABLE_H
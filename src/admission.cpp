@@ -0,0 +1,439 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/admission.h>
+#include <dbus-c++/debug.h>
+
+#include <dbus/dbus.h>
+
+#include <algorithm>
+
+using namespace DBus;
+
+AdmissionLimits::AdmissionLimits(unsigned int in_flight, unsigned int queued, const char *error)
+  : max_in_flight(in_flight), max_queued(queued), error_name(error)
+{
+}
+
+SenderLimits::SenderLimits(unsigned int in_flight, size_t queued_bytes)
+  : max_in_flight(in_flight), max_queued_bytes(queued_bytes)
+{
+}
+
+AdmissionCounters::AdmissionCounters()
+  : admitted(0), rejected(0), in_flight(0), queued(0), queued_bytes(0)
+{
+}
+
+AdmissionControl::AdmissionControl()
+{
+}
+
+void AdmissionControl::limits(const AdmissionLimits &l)
+{
+  _mutex.lock();
+  _object.limits = l;
+  _mutex.unlock();
+}
+
+AdmissionLimits AdmissionControl::limits() const
+{
+  _mutex.lock();
+  AdmissionLimits l = _object.limits;
+  _mutex.unlock();
+  return l;
+}
+
+void AdmissionControl::method_limits(const std::string &interface, const std::string &member,
+                                     const AdmissionLimits &l)
+{
+  _mutex.lock();
+  _methods[interface + '.' + member].limits = l;
+  _mutex.unlock();
+}
+
+void AdmissionControl::sender_limits(const SenderLimits &l)
+{
+  _mutex.lock();
+  _sender_limits = l;
+  _mutex.unlock();
+}
+
+SenderLimits AdmissionControl::sender_limits() const
+{
+  _mutex.lock();
+  SenderLimits l = _sender_limits;
+  _mutex.unlock();
+  return l;
+}
+
+bool AdmissionControl::counts_bytes() const
+{
+  _mutex.lock();
+  bool b = _sender_limits.max_queued_bytes != 0;
+  _mutex.unlock();
+  return b;
+}
+
+AdmissionControl::Entry *AdmissionControl::find_method(const char *interface, const char *member)
+{
+  // don't build a temporary string for each call unless some method is limited
+  if (_methods.empty() || !interface || !member)
+    return NULL;
+
+  std::string key(interface);
+
+  key += '.';
+  key += member;
+
+  EntryTable::iterator ei = _methods.find(key);
+
+  return ei != _methods.end() ? &(ei->second) : NULL;
+}
+
+const AdmissionControl::Entry *AdmissionControl::find_method(const char *interface, const char *member) const
+{
+  return const_cast<AdmissionControl *>(this)->find_method(interface, member);
+}
+
+void AdmissionControl::forget_sender(SenderTable::iterator si)
+{
+  // only keep track of senders which currently hold resources
+  if (!si->second.in_flight && !si->second.queued)
+    _senders.erase(si);
+}
+
+bool AdmissionControl::admit(const char *interface, const char *member, const char *sender)
+{
+  _mutex.lock();
+
+  Entry *me = find_method(interface, member);
+  SenderTable::iterator si = _senders.end();
+
+  if (sender && _sender_limits.max_in_flight)
+    si = _senders.insert(SenderTable::value_type(sender, AdmissionCounters())).first;
+
+  if ((_object.limits.max_in_flight && _object.counters.in_flight >= _object.limits.max_in_flight)
+      || (me && me->limits.max_in_flight && me->counters.in_flight >= me->limits.max_in_flight)
+      || (si != _senders.end() && si->second.in_flight >= _sender_limits.max_in_flight))
+  {
+    ++_object.counters.rejected;
+    if (me) ++me->counters.rejected;
+    if (si != _senders.end()) forget_sender(si);
+
+    _mutex.unlock();
+
+    debug_log("rejecting call to %s.%s from %s, too many calls in flight", interface, member, sender);
+    return false;
+  }
+
+  ++_object.counters.admitted;
+  ++_object.counters.in_flight;
+  if (me)
+  {
+    ++me->counters.admitted;
+    ++me->counters.in_flight;
+  }
+  if (si != _senders.end())
+  {
+    ++si->second.in_flight;
+  }
+
+  _mutex.unlock();
+  return true;
+}
+
+void AdmissionControl::release(const char *interface, const char *member, const char *sender)
+{
+  _mutex.lock();
+
+  Entry *me = find_method(interface, member);
+
+  if (_object.counters.in_flight) --_object.counters.in_flight;
+  if (me && me->counters.in_flight) --me->counters.in_flight;
+
+  if (sender && !_senders.empty())
+  {
+    SenderTable::iterator si = _senders.find(sender);
+
+    if (si != _senders.end())
+    {
+      if (si->second.in_flight) --si->second.in_flight;
+      forget_sender(si);
+    }
+  }
+
+  _mutex.unlock();
+}
+
+bool AdmissionControl::admit_queued(const char *interface, const char *member, const char *sender, size_t bytes)
+{
+  _mutex.lock();
+
+  Entry *me = find_method(interface, member);
+  SenderTable::iterator si = _senders.end();
+
+  if (sender && _sender_limits.max_queued_bytes)
+    si = _senders.insert(SenderTable::value_type(sender, AdmissionCounters())).first;
+
+  if ((_object.limits.max_queued && _object.counters.queued >= _object.limits.max_queued)
+      || (me && me->limits.max_queued && me->counters.queued >= me->limits.max_queued)
+      || (si != _senders.end() && si->second.queued_bytes + bytes > _sender_limits.max_queued_bytes
+          && si->second.queued)) // always let a single call through, however big
+  {
+    ++_object.counters.rejected;
+    if (me) ++me->counters.rejected;
+    if (si != _senders.end()) forget_sender(si);
+
+    _mutex.unlock();
+
+    debug_log("rejecting call to %s.%s from %s, request queue is full", interface, member, sender);
+    return false;
+  }
+
+  ++_object.counters.queued;
+  _object.counters.queued_bytes += bytes;
+  if (me)
+  {
+    ++me->counters.queued;
+    me->counters.queued_bytes += bytes;
+  }
+  if (si != _senders.end())
+  {
+    ++si->second.queued;
+    si->second.queued_bytes += bytes;
+  }
+
+  _mutex.unlock();
+  return true;
+}
+
+void AdmissionControl::release_queued(const char *interface, const char *member, const char *sender,
+                                      size_t bytes)
+{
+  _mutex.lock();
+
+  Entry *me = find_method(interface, member);
+
+  if (_object.counters.queued) --_object.counters.queued;
+  _object.counters.queued_bytes -= std::min(bytes, _object.counters.queued_bytes);
+  if (me)
+  {
+    if (me->counters.queued) --me->counters.queued;
+    me->counters.queued_bytes -= std::min(bytes, me->counters.queued_bytes);
+  }
+
+  if (sender && !_senders.empty())
+  {
+    SenderTable::iterator si = _senders.find(sender);
+
+    if (si != _senders.end())
+    {
+      if (si->second.queued) --si->second.queued;
+      si->second.queued_bytes -= std::min(bytes, si->second.queued_bytes);
+      forget_sender(si);
+    }
+  }
+
+  _mutex.unlock();
+}
+
+const char *AdmissionControl::error_name(const char *interface, const char *member) const
+{
+  _mutex.lock();
+
+  const Entry *me = find_method(interface, member);
+  const char *name = me && me->limits.error_name
+                     ? me->limits.error_name
+                     : _object.limits.error_name;
+
+  _mutex.unlock();
+
+  return name ? name : DBUS_ERROR_LIMITS_EXCEEDED;
+}
+
+AdmissionCounters AdmissionControl::counters() const
+{
+  _mutex.lock();
+  AdmissionCounters c = _object.counters;
+  _mutex.unlock();
+  return c;
+}
+
+AdmissionCounters AdmissionControl::counters(const std::string &interface, const std::string &member) const
+{
+  _mutex.lock();
+
+  AdmissionCounters c;
+  EntryTable::const_iterator ei = _methods.find(interface + '.' + member);
+
+  if (ei != _methods.end())
+    c = ei->second.counters;
+
+  _mutex.unlock();
+  return c;
+}
+
+AdmissionCounters AdmissionControl::sender_counters(const std::string &sender) const
+{
+  _mutex.lock();
+
+  AdmissionCounters c;
+  SenderTable::const_iterator si = _senders.find(sender);
+
+  if (si != _senders.end())
+    c = si->second;
+
+  _mutex.unlock();
+  return c;
+}
+
+void AdmissionControl::reset_totals()
+{
+  _mutex.lock();
+
+  _object.counters.admitted = 0;
+  _object.counters.rejected = 0;
+
+  for (EntryTable::iterator ei = _methods.begin(); ei != _methods.end(); ++ei)
+  {
+    ei->second.counters.admitted = 0;
+    ei->second.counters.rejected = 0;
+  }
+
+  _mutex.unlock();
+}
+
+FairRequestQueue::Request::Request(const CallMessage &c, Tag *t, size_t b, size_t co, double e)
+  : call(c), tag(t), bytes(b), cost(co), expiration(e)
+{
+}
+
+FairRequestQueue::FairRequestQueue(size_t quantum)
+  : _quantum(quantum ? quantum : 1), _size(0), _granted(false)
+{
+}
+
+void FairRequestQueue::quantum(size_t q)
+{
+  _quantum = q ? q : 1;
+}
+
+void FairRequestQueue::push(const CallMessage &call, Tag *tag, size_t bytes, size_t cost, double expiration)
+{
+  const char *sender = call.sender();
+
+  std::pair<FlowTable::iterator, bool> ins =
+    _flows.insert(FlowTable::value_type(sender ? sender : "", Flow()));
+
+  ins.first->second.requests.push_back(Request(call, tag, bytes, cost, expiration));
+  ++_size;
+
+  // a sender joins the back of the round when it has something queued
+  if (ins.second)
+    _round.push_back(ins.first);
+}
+
+FairRequestQueue::Request *FairRequestQueue::front()
+{
+  if (_round.empty())
+    return NULL;
+
+  /* deficit round-robin: the flow at the head of the round is granted one
+   * quantum when its turn begins and keeps the turn as long as its credit
+   * covers its next request, then goes to the back of the round with what
+   * is left of its credit
+   */
+  for (;;)
+  {
+    Flow &flow = _round.front()->second;
+    Request &r = flow.requests.front();
+
+    if (!_granted)
+    {
+      flow.deficit += _quantum;
+      _granted = true;
+    }
+
+    if (r.cost <= flow.deficit)
+      return &r;
+
+    _round.push_back(_round.front());
+    _round.pop_front();
+    _granted = false;
+  }
+}
+
+void FairRequestQueue::pop()
+{
+  if (_round.empty())
+    return;
+
+  FlowTable::iterator fi = _round.front();
+  Flow &flow = fi->second;
+
+  flow.deficit -= std::min(flow.requests.front().cost, flow.deficit);
+  flow.requests.pop_front();
+  --_size;
+
+  if (flow.requests.empty())
+  {
+    _round.pop_front();
+    _flows.erase(fi);
+    _granted = false;
+  }
+}
+
+void FairRequestQueue::drop(const std::string &sender, std::deque<Request> &dropped)
+{
+  FlowTable::iterator fi = _flows.find(sender);
+
+  if (fi == _flows.end())
+    return;
+
+  std::list<FlowTable::iterator>::iterator ri = _round.begin();
+
+  while (*ri != fi)
+    ++ri;
+
+  if (ri == _round.begin())
+    _granted = false;
+
+  _round.erase(ri);
+
+  _size -= fi->second.requests.size();
+  dropped.swap(fi->second.requests);
+  _flows.erase(fi);
+}
+
+size_t FairRequestQueue::size() const
+{
+  return _size;
+}
+
+bool FairRequestQueue::empty() const
+{
+  return _size == 0;
+}
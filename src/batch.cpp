@@ -0,0 +1,198 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/batch.h>
+#include <dbus-c++/introspection.h>
+#include <dbus-c++/object.h>
+#include <dbus-c++/message.h>
+#include <dbus-c++/debug.h>
+
+#include <dbus/dbus.h>
+
+#include <cstdlib>
+
+using namespace DBus;
+
+static const char *batch_name = "org.dbuscxx.Batch";
+
+BatchAdaptor::BatchAdaptor()
+  : InterfaceAdaptor(batch_name)
+{}
+
+Message BatchAdaptor::Call(const CallMessage &call)
+{
+  std::vector<BatchCall> calls;
+  MessageIter ri = call.reader();
+
+  ri >> calls;
+
+  debug_log("running a batch of %u calls", (unsigned) calls.size());
+
+  ObjectAdaptor *self = const_cast<ObjectAdaptor *>(object());
+  const char *sender = call.sender();
+
+  ReturnMessage reply(call);
+  MessageIter wi = reply.writer();
+  MessageIter ai = wi.new_array("(sav)");
+
+  for (std::vector<BatchCall>::iterator ci = calls.begin(); ci != calls.end(); ++ci)
+  {
+    CallMessage sub;
+
+    // replies to the sub-calls refer to the batch
+    sub.serial(call.serial());
+
+    if (sender)
+      sub.sender(sender);
+
+    MessageIter si = sub.writer();
+
+    for (std::vector<Variant>::iterator vi = ci->_4.begin(); vi != ci->_4.end(); ++vi)
+    {
+      MessageIter vr = vi->reader();
+      vr.copy_data(si);
+    }
+
+    // another connection's objects are out of reach, as over the bus
+    ObjectAdaptor *target = ObjectAdaptor::from_path(self->conn(), ci->_1);
+    Message ret;
+
+    if (target)
+      ret = target->dispatch_local(sub, ci->_2, ci->_3);
+    else
+      ret = ErrorMessage(sub, DBUS_ERROR_UNKNOWN_METHOD, ("No such object " + ci->_1).c_str());
+
+    MessageIter oi = ret.reader();
+    MessageIter ei = ai.new_struct();
+
+    if (ret.is_error())
+    {
+      const ErrorMessage &err = static_cast<const ErrorMessage &>(ret);
+
+      ei.append_string(err.name());
+
+      MessageIter vi = ei.new_array("v");
+
+      // the message, if any
+      if (!oi.at_end())
+      {
+        MessageIter mi = vi.new_variant("s");
+        oi.copy_value(mi);
+        vi.close_container(mi);
+      }
+      ei.close_container(vi);
+    }
+    else
+    {
+      ei.append_string("");
+
+      MessageIter vi = ei.new_array("v");
+
+      for (; !oi.at_end(); ++oi)
+      {
+        char *sig = oi.signature();
+
+        // the signature of what is left, the current value comes first
+        DBusSignatureIter dsi;
+        dbus_signature_iter_init(&dsi, sig);
+        char *single = dbus_signature_iter_get_signature(&dsi);
+
+        MessageIter mi = vi.new_variant(single);
+        oi.copy_value(mi);
+        vi.close_container(mi);
+
+        dbus_free(single);
+        free(sig);
+      }
+      ei.close_container(vi);
+    }
+    ai.close_container(ei);
+  }
+  wi.close_container(ai);
+
+  return reply;
+}
+
+const MethodEntry *BatchAdaptor::method_table() const
+{
+  static const MethodEntry Batch_method_table[] =
+  {
+    { "Call", &method_member< BatchAdaptor, &BatchAdaptor::Call > },
+    { 0, 0 }
+  };
+  return Batch_method_table;
+}
+
+IntrospectedInterface *BatchAdaptor::introspect() const
+{
+  static IntrospectedArgument Call_args[] =
+  {
+    { "calls", "a(ossav)", true },
+    { "results", "a(sav)", false },
+    { 0, 0, 0 }
+  };
+  static IntrospectedMethod Batch_methods[] =
+  {
+    { "Call", Call_args },
+    { 0, 0 }
+  };
+  static IntrospectedMethod Batch_signals[] =
+  {
+    { 0, 0 }
+  };
+  static IntrospectedProperty Batch_properties[] =
+  {
+    { 0, 0, 0, 0 }
+  };
+  static IntrospectedInterface Batch_interface =
+  {
+    batch_name,
+    Batch_methods,
+    Batch_signals,
+    Batch_properties
+  };
+  return &Batch_interface;
+}
+
+BatchProxy::BatchProxy()
+  : InterfaceProxy(batch_name)
+{}
+
+std::vector<BatchResult> BatchProxy::Call(const std::vector<BatchCall> &calls)
+{
+  DBus::CallMessage call;
+  DBus::MessageIter wi = call.writer();
+
+  wi << calls;
+  call.member("Call");
+
+  DBus::Message ret = invoke_method(call);
+  DBus::MessageIter ri = ret.reader();
+
+  std::vector<BatchResult> results;
+  ri >> results;
+
+  return results;
+}
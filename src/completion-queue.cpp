@@ -0,0 +1,279 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/completion-queue.h>
+#include <dbus-c++/error.h>
+
+#include <deque>
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+using namespace DBus;
+
+/*	shared with the handlers of the attached calls, the last of them or
+	the queue frees it
+*/
+struct DXXAPILOCAL CompletionQueue::Private
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  std::deque<PendingCall> completed;
+  size_t outstanding;
+
+  // the queue plus one per outstanding call
+  size_t refs;
+  bool detached;
+
+  int fd_read;
+  int fd_write;
+
+  Private();
+
+  ~Private();
+
+  // drops a reference, with the mutex held; true if it was the last
+  bool unref();
+
+  // pthread_cond_wait() until `done' holds or the deadline passed
+  bool wait(bool (*done)(const Private *), int timeout);
+
+  static void complete(PendingCall &call, void *object);
+
+  static bool any_completed(const Private *);
+
+  static bool all_completed(const Private *);
+};
+
+CompletionQueue::Private::Private()
+  : outstanding(0), refs(1), detached(false), fd_read(-1), fd_write(-1)
+{
+  int fds[2];
+
+  if (pipe(fds) == -1)
+    throw ErrorFailed("Unable to create the completion queue pipe");
+
+  fd_read = fds[0];
+  fd_write = fds[1];
+
+  fcntl(fd_read, F_SETFL, O_NONBLOCK);
+  fcntl(fd_write, F_SETFL, O_NONBLOCK);
+  fcntl(fd_read, F_SETFD, FD_CLOEXEC);
+  fcntl(fd_write, F_SETFD, FD_CLOEXEC);
+
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  pthread_mutex_init(&mutex, NULL);
+}
+
+CompletionQueue::Private::~Private()
+{
+  pthread_mutex_destroy(&mutex);
+  pthread_cond_destroy(&cond);
+  close(fd_read);
+  close(fd_write);
+}
+
+bool CompletionQueue::Private::unref()
+{
+  return --refs == 0;
+}
+
+bool CompletionQueue::Private::wait(bool (*done)(const Private *), int timeout)
+{
+  struct timespec deadline;
+
+  if (timeout >= 0)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  }
+
+  pthread_mutex_lock(&mutex);
+
+  bool ok;
+  int err = 0;
+
+  while (!(ok = done(this)) && err != ETIMEDOUT)
+  {
+    if (timeout < 0)
+      err = pthread_cond_wait(&cond, &mutex);
+    else
+      err = pthread_cond_timedwait(&cond, &mutex, &deadline);
+  }
+
+  pthread_mutex_unlock(&mutex);
+  return ok;
+}
+
+void CompletionQueue::Private::complete(PendingCall &call, void *object)
+{
+  Private *p = static_cast<Private *>(object);
+
+  pthread_mutex_lock(&p->mutex);
+
+  if (!p->detached)
+  {
+    --p->outstanding;
+
+    // the descriptor turns readable along with the first queued call
+    if (p->completed.empty())
+    {
+      char c = 0;
+
+      while (write(p->fd_write, &c, 1) == -1 && errno == EINTR)
+        ;
+    }
+    p->completed.push_back(call);
+
+    pthread_cond_broadcast(&p->cond);
+  }
+
+  bool last = p->unref();
+
+  pthread_mutex_unlock(&p->mutex);
+
+  if (last)
+    delete p;
+}
+
+bool CompletionQueue::Private::any_completed(const Private *p)
+{
+  return !p->completed.empty();
+}
+
+bool CompletionQueue::Private::all_completed(const Private *p)
+{
+  return p->outstanding == 0;
+}
+
+CompletionQueue::CompletionQueue()
+  : _pvt(new Private)
+{
+}
+
+CompletionQueue::~CompletionQueue()
+{
+  pthread_mutex_lock(&_pvt->mutex);
+
+  _pvt->detached = true;
+  _pvt->completed.clear();
+
+  bool last = _pvt->unref();
+
+  pthread_mutex_unlock(&_pvt->mutex);
+
+  if (last)
+    delete _pvt;
+}
+
+void CompletionQueue::add(PendingCall &call)
+{
+  pthread_mutex_lock(&_pvt->mutex);
+
+  ++_pvt->outstanding;
+  ++_pvt->refs;
+
+  pthread_mutex_unlock(&_pvt->mutex);
+
+  // runs complete() right away if the call is done already
+  call.handler(Private::complete, _pvt);
+}
+
+bool CompletionQueue::wait_any(int timeout)
+{
+  return _pvt->wait(Private::any_completed, timeout);
+}
+
+bool CompletionQueue::wait_all(int timeout)
+{
+  return _pvt->wait(Private::all_completed, timeout);
+}
+
+size_t CompletionQueue::take(std::vector<PendingCall> &calls, size_t max)
+{
+  pthread_mutex_lock(&_pvt->mutex);
+
+  size_t n = _pvt->completed.size();
+
+  if (max && max < n)
+    n = max;
+
+  calls.insert(calls.end(), _pvt->completed.begin(), _pvt->completed.begin() + n);
+  _pvt->completed.erase(_pvt->completed.begin(), _pvt->completed.begin() + n);
+
+  if (n && _pvt->completed.empty())
+  {
+    char buf[16];
+
+    while (read(_pvt->fd_read, buf, sizeof(buf)) > 0)
+      ;
+  }
+
+  pthread_mutex_unlock(&_pvt->mutex);
+  return n;
+}
+
+size_t CompletionQueue::outstanding() const
+{
+  pthread_mutex_lock(&_pvt->mutex);
+
+  size_t n = _pvt->outstanding;
+
+  pthread_mutex_unlock(&_pvt->mutex);
+  return n;
+}
+
+size_t CompletionQueue::ready() const
+{
+  pthread_mutex_lock(&_pvt->mutex);
+
+  size_t n = _pvt->completed.size();
+
+  pthread_mutex_unlock(&_pvt->mutex);
+  return n;
+}
+
+int CompletionQueue::fd() const
+{
+  return _pvt->fd_read;
+}
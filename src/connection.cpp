@@ -38,6 +38,7 @@
 #include "server_p.h"
 #include "message_p.h"
 #include "pendingcall_p.h"
+#include "match-rules.h"
 
 using namespace DBus;
 
@@ -388,6 +389,60 @@ Message Connection::send_blocking(Message &msg, int timeout)
   return Message(new Message::Private(reply), false);
 }
 
+std::vector<Message> Connection::send_batch(std::vector<CallMessage> &calls, int timeout)
+{
+  if (this->_timeout != -1)
+  {
+    timeout = this->_timeout;
+  }
+
+  std::vector<DBusPendingCall *> pending(calls.size(), (DBusPendingCall *) NULL);
+  size_t i;
+
+  for (i = 0; i < calls.size(); ++i)
+  {
+    if (!dbus_connection_send_with_reply(_pvt->conn, calls[i]._pvt->msg, &pending[i], timeout))
+    {
+      for (size_t j = 0; j < i; ++j)
+      {
+        if (pending[j])
+        {
+          dbus_pending_call_cancel(pending[j]);
+          dbus_pending_call_unref(pending[j]);
+        }
+      }
+      throw ErrorNoMemory("Unable to send batch");
+    }
+  }
+
+  // one write for the whole batch, then every call waits concurrently
+  dbus_connection_flush(_pvt->conn);
+
+  std::vector<Message> replies;
+
+  replies.reserve(calls.size());
+
+  for (i = 0; i < calls.size(); ++i)
+  {
+    DBusMessage *reply = NULL;
+
+    // NULL if the connection is closed
+    if (pending[i])
+    {
+      dbus_pending_call_block(pending[i]);
+      reply = dbus_pending_call_steal_reply(pending[i]);
+      dbus_pending_call_unref(pending[i]);
+    }
+
+    if (reply)
+      replies.push_back(Message(new Message::Private(reply), false));
+    else
+      replies.push_back(ErrorMessage(calls[i], DBUS_ERROR_DISCONNECTED, "Connection is closed"));
+  }
+
+  return replies;
+}
+
 PendingCall Connection::send_async(Message &msg, int timeout)
 {
   DBusPendingCall *pending;
@@ -399,6 +454,25 @@ PendingCall Connection::send_async(Message &msg, int timeout)
   return PendingCall(new PendingCall::Private(pending));
 }
 
+PendingCall Connection::send_async(Message &msg, int timeout, PendingCall::Handler handler, void *object,
+                                   void *data)
+{
+  DBusPendingCall *pending;
+
+  if (!dbus_connection_send_with_reply(_pvt->conn, msg._pvt->msg, &pending, timeout))
+  {
+    throw ErrorNoMemory("Unable to start asynchronous call");
+  }
+
+  PendingCall::Private *p = new PendingCall::Private(pending);
+
+  p->handler = handler;
+  p->object = object;
+  p->data = data;
+
+  return PendingCall(p);
+}
+
 void Connection::request_name(const char *name, int flags)
 {
   InternalError e;
@@ -423,7 +497,11 @@ void Connection::request_name(const char *name, int flags)
   {
     _pvt->names.push_back(name);
     std::string match = "destination='" + _pvt->names.back() + "'";
-    add_match(match.c_str());
+
+    MatchRules *rules = MatchRules::of(_pvt->conn);
+
+    if (rules)
+      rules->add(match);
   }
 }
 
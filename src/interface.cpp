@@ -27,9 +27,13 @@
 
 #include <dbus-c++/debug.h>
 #include <dbus-c++/interface.h>
+#include <dbus-c++/object.h>
 
 #include "internalerror.h"
 
+#include <cstdio>
+#include <cstring>
+
 using namespace DBus;
 
 Interface::Interface(const std::string &name)
@@ -46,8 +50,23 @@ InterfaceAdaptor *AdaptorBase::find_interface(const std::string &name)
   return ii != _interfaces.end() ? ii->second : NULL;
 }
 
+InterfaceAdaptor *AdaptorBase::find_interface(const char *name)
+{
+  if (!name)
+    return NULL;
+
+  size_t len = strlen(name);
+
+  for (InterfaceAdaptorTable::const_iterator ii = _interfaces.begin(); ii != _interfaces.end(); ++ii)
+  {
+    if (ii->first.size() == len && !memcmp(ii->first.data(), name, len))
+      return ii->second;
+  }
+  return NULL;
+}
+
 InterfaceAdaptor::InterfaceAdaptor(const std::string &name)
-  : Interface(name)
+  : Interface(name), _cache_generation(0), _caching(0)
 {
   debug_log("adding interface %s", name.c_str());
 
@@ -58,10 +77,17 @@ Message InterfaceAdaptor::dispatch_method(const CallMessage &msg)
 {
   const char *name = msg.member();
 
-  MethodTable::iterator mi = _methods.find(name);
-  if (mi != _methods.end())
+  // the methods registered at run time override the class' ones
+  MethodTable::mapped_type *method = find_method(name);
+  if (method)
+  {
+    return method->call(msg);
+  }
+
+  const MethodEntry *entry = find_method_entry(name);
+  if (entry)
   {
-    return mi->second.call(msg);
+    return entry->call(this, msg);
   }
   else
   {
@@ -69,6 +95,216 @@ Message InterfaceAdaptor::dispatch_method(const CallMessage &msg)
   }
 }
 
+MethodTable::mapped_type *InterfaceAdaptor::find_method(const char *member)
+{
+  // don't build a temporary string for each call unless needed
+  if (_methods.empty() || !member)
+    return NULL;
+
+  MethodTable::iterator mi = _methods.find(member);
+
+  return mi != _methods.end() ? &mi->second : NULL;
+}
+
+const MethodEntry *InterfaceAdaptor::find_method_entry(const char *member) const
+{
+  const MethodEntry *me = method_table();
+
+  if (!me || !member)
+    return NULL;
+
+  for (; me->name; ++me)
+  {
+    if (!strcmp(me->name, member))
+      return me;
+  }
+  return NULL;
+}
+
+const PropertyEntry *InterfaceAdaptor::find_property_entry(const char *name) const
+{
+  const PropertyEntry *pe = property_table();
+
+  if (!pe || !name)
+    return NULL;
+
+  for (; pe->name; ++pe)
+  {
+    if (!strcmp(pe->name, name))
+      return pe;
+  }
+  return NULL;
+}
+
+void InterfaceAdaptor::single_flight(const std::string &method, bool enable)
+{
+  if (enable)
+    _single_flight.insert(method);
+  else
+    _single_flight.erase(method);
+}
+
+bool InterfaceAdaptor::is_single_flight(const char *method) const
+{
+  // don't build a temporary string for each call unless needed
+  return !_single_flight.empty() && method
+         && _single_flight.find(method) != _single_flight.end();
+}
+
+void InterfaceAdaptor::deferred_method(const std::string &method, bool enable)
+{
+  if (enable)
+    _deferred.insert(method);
+  else
+    _deferred.erase(method);
+}
+
+bool InterfaceAdaptor::is_deferred(const char *method) const
+{
+  return !_deferred.empty() && method
+         && _deferred.find(method) != _deferred.end();
+}
+
+void InterfaceAdaptor::cache_method(const std::string &method, unsigned int ttl, size_t max_entries)
+{
+  _cache_mutex.lock();
+
+  CachedMethod &cm = _cache[method];
+
+  cm.ttl = ttl;
+  cm.max_entries = max_entries;
+  cm.replies.clear();
+
+  __sync_bool_compare_and_swap(&_caching, 0, 1);
+
+  _cache_mutex.unlock();
+}
+
+void InterfaceAdaptor::invalidate_cache()
+{
+  _cache_mutex.lock();
+
+  for (CachedMethodTable::iterator ci = _cache.begin(); ci != _cache.end(); ++ci)
+    ci->second.replies.clear();
+
+  ++_cache_generation;
+
+  _cache_mutex.unlock();
+}
+
+void InterfaceAdaptor::invalidate_cache(const std::string &method)
+{
+  _cache_mutex.lock();
+
+  CachedMethodTable::iterator ci = _cache.find(method);
+
+  if (ci != _cache.end())
+    ci->second.replies.clear();
+
+  ++_cache_generation;
+
+  _cache_mutex.unlock();
+}
+
+bool InterfaceAdaptor::is_cached(const char *method) const
+{
+  // don't lock for each call unless some method is cached
+  if (!__sync_fetch_and_add(&_caching, 0) || !method)
+    return false;
+
+  _cache_mutex.lock();
+  bool b = _cache.find(method) != _cache.end();
+  _cache_mutex.unlock();
+
+  return b;
+}
+
+unsigned long InterfaceAdaptor::cache_generation() const
+{
+  _cache_mutex.lock();
+  unsigned long g = _cache_generation;
+  _cache_mutex.unlock();
+
+  return g;
+}
+
+bool InterfaceAdaptor::cached_reply(const char *method, const std::string &args, Message &reply)
+{
+  _cache_mutex.lock();
+
+  CachedMethodTable::iterator ci = _cache.find(method);
+
+  if (ci == _cache.end())
+  {
+    _cache_mutex.unlock();
+    return false;
+  }
+
+  CachedReplyTable::iterator ri = ci->second.replies.find(args);
+
+  if (ri == ci->second.replies.end())
+  {
+    _cache_mutex.unlock();
+    return false;
+  }
+
+  if (ri->second.expiration && ri->second.expiration <= Deadline::now())
+  {
+    ci->second.replies.erase(ri);
+
+    _cache_mutex.unlock();
+    return false;
+  }
+
+  // the caller sets its own reply serial and destination
+  reply = ri->second.reply.copy();
+
+  _cache_mutex.unlock();
+  return true;
+}
+
+void InterfaceAdaptor::cache_reply(const char *method, const std::string &args, const Message &reply,
+                                   unsigned long generation)
+{
+  _cache_mutex.lock();
+
+  CachedMethodTable::iterator ci = _cache.find(method);
+
+  // the cache was invalidated while the call was being handled
+  if (ci == _cache.end() || generation != _cache_generation)
+  {
+    _cache_mutex.unlock();
+    return;
+  }
+
+  CachedMethod &cm = ci->second;
+  double now = Deadline::now();
+
+  if (cm.replies.size() >= cm.max_entries)
+  {
+    CachedReplyTable::iterator ri = cm.replies.begin();
+
+    while (ri != cm.replies.end())
+    {
+      if (ri->second.expiration && ri->second.expiration <= now)
+        cm.replies.erase(ri++);
+      else
+        ++ri;
+    }
+
+    if (cm.replies.size() >= cm.max_entries)
+      cm.replies.clear();
+  }
+
+  // don't share the reference count with the dispatcher's copy
+  CachedReply &cr = cm.replies[args];
+
+  cr.reply = Message(reply, false);
+  cr.expiration = cm.ttl ? now + cm.ttl : 0;
+
+  _cache_mutex.unlock();
+}
+
 void InterfaceAdaptor::emit_signal(const SignalMessage &sig)
 {
   SignalMessage &sig2 = const_cast<SignalMessage &>(sig);
@@ -79,7 +315,7 @@ void InterfaceAdaptor::emit_signal(const SignalMessage &sig)
   _emit_signal(sig2);
 }
 
-Variant *InterfaceAdaptor::get_property(const std::string &name)
+const Variant *InterfaceAdaptor::get_property(const std::string &name)
 {
   PropertyTable::iterator pti = _properties.find(name);
 
@@ -88,8 +324,21 @@ Variant *InterfaceAdaptor::get_property(const std::string &name)
     if (!pti->second.read)
       throw ErrorAccessDenied("property is not readable");
 
+    if (pti->second.storage)
+      return &pti->second.storage->encoded();
+
     return &(pti->second.value);
   }
+
+  const PropertyEntry *pe = find_property_entry(name.c_str());
+
+  if (pe)
+  {
+    if (!pe->read)
+      throw ErrorAccessDenied("property is not readable");
+
+    return &pe->value(this)->encoded();
+  }
   return NULL;
 }
 
@@ -107,12 +356,75 @@ void InterfaceAdaptor::set_property(const std::string &name, Variant &value)
     if (pti->second.sig != sig)
       throw ErrorInvalidSignature("property expects a different type");
 
-    pti->second.value = value;
+    if (pti->second.storage)
+      pti->second.storage->assign(value);
+    else
+      pti->second.value = value;
+    return;
+  }
+
+  const PropertyEntry *pe = find_property_entry(name.c_str());
+
+  if (pe)
+  {
+    if (!pe->write)
+      throw ErrorAccessDenied("property is not writeable");
+
+    Signature sig = value.signature();
+
+    if (sig != pe->sig)
+      throw ErrorInvalidSignature("property expects a different type");
+
+    pe->value(this)->assign(value);
     return;
   }
   throw ErrorFailed("requested property not found");
 }
 
+void InterfaceAdaptor::append_properties(MessageIter &iter)
+{
+  MessageIter ai = iter.new_array("{sv}");
+
+  for (PropertyTable::iterator pti = _properties.begin(); pti != _properties.end(); ++pti)
+  {
+    if (!pti->second.read)
+      continue;
+
+    PropertyBase *storage = pti->second.storage;
+
+    // never set, there is nothing to send
+    if (!storage && pti->second.value.signature().empty())
+      continue;
+
+    MessageIter ei = ai.new_dict_entry();
+
+    ei.append_string(pti->first.c_str());
+
+    if (storage)
+      storage->append(ei);
+    else
+      ei << pti->second.value;
+
+    ai.close_container(ei);
+  }
+
+  const PropertyEntry *pe = property_table();
+
+  for (; pe && pe->name; ++pe)
+  {
+    if (!pe->read || _properties.count(pe->name))
+      continue;
+
+    MessageIter ei = ai.new_dict_entry();
+
+    ei.append_string(pe->name);
+    pe->value(this)->append(ei);
+
+    ai.close_container(ei);
+  }
+  iter.close_container(ai);
+}
+
 InterfaceProxy *ProxyBase::find_interface(const std::string &name)
 {
   InterfaceProxyTable::const_iterator ii = _interfaces.find(name);
@@ -120,6 +432,149 @@ InterfaceProxy *ProxyBase::find_interface(const std::string &name)
   return ii != _interfaces.end() ? ii->second : NULL;
 }
 
+InterfaceProxy *ProxyBase::find_interface(const char *name)
+{
+  if (!name)
+    return NULL;
+
+  size_t len = strlen(name);
+
+  for (InterfaceProxyTable::const_iterator ii = _interfaces.begin(); ii != _interfaces.end(); ++ii)
+  {
+    if (ii->first.size() == len && !memcmp(ii->first.data(), name, len))
+      return ii->second;
+  }
+  return NULL;
+}
+
+// appends `key'='value' to a match rule, quoting the apostrophes of `value'
+static void append_key(std::string &rule, const std::string &key, const std::string &value)
+{
+  rule += ',' + key + "='";
+
+  for (std::string::const_iterator ci = value.begin(); ci != value.end(); ++ci)
+  {
+    if (*ci == '\'')
+      rule += "'\\''";
+    else
+      rule += *ci;
+  }
+  rule += '\'';
+}
+
+// whether one path is `other' or below it, given either ends with a '/'
+static bool path_matches(const std::string &path, const char *other)
+{
+  size_t len = strlen(other);
+
+  if (path.length() == len || path.empty() || !len)
+    return path == other;
+
+  if (path.length() < len)
+    return path[path.length() - 1] == '/' && !strncmp(other, path.c_str(), path.length());
+  else
+    return other[len - 1] == '/' && !path.compare(0, len, other);
+}
+
+SignalMatch::SignalMatch()
+  : _below(false)
+{}
+
+SignalMatch &SignalMatch::arg(unsigned int n, const std::string &value)
+{
+  if (n > DBUS_MAXIMUM_MATCH_RULE_ARG_NUMBER)
+    throw ErrorInvalidArgs("argument number out of range");
+
+  Arg a = { n, false, value };
+
+  _args.push_back(a);
+  return *this;
+}
+
+SignalMatch &SignalMatch::arg_path(unsigned int n, const std::string &path)
+{
+  if (n > DBUS_MAXIMUM_MATCH_RULE_ARG_NUMBER)
+    throw ErrorInvalidArgs("argument number out of range");
+
+  Arg a = { n, true, path };
+
+  _args.push_back(a);
+  return *this;
+}
+
+SignalMatch &SignalMatch::arg0_namespace(const std::string &ns)
+{
+  _arg0_namespace = ns;
+  return *this;
+}
+
+SignalMatch &SignalMatch::path_namespace()
+{
+  _below = true;
+  return *this;
+}
+
+std::string SignalMatch::keys() const
+{
+  std::string rule;
+
+  for (std::vector<Arg>::const_iterator ai = _args.begin(); ai != _args.end(); ++ai)
+  {
+    char key[16];
+
+    snprintf(key, sizeof(key), ai->path ? "arg%upath" : "arg%u", ai->n);
+    append_key(rule, key, ai->value);
+  }
+
+  if (!_arg0_namespace.empty())
+    append_key(rule, "arg0namespace", _arg0_namespace);
+
+  return rule;
+}
+
+bool SignalMatch::matches(const SignalMessage &sig) const
+{
+  if (_args.empty() && _arg0_namespace.empty())
+    return true;
+
+  // the string and object path arguments, others are NULL
+  std::vector<const char *> strings;
+  std::vector<bool> paths;
+  MessageIter ri = sig.reader();
+
+  for (; !ri.at_end() && strings.size() <= DBUS_MAXIMUM_MATCH_RULE_ARG_NUMBER; ++ri)
+  {
+    int type = ri.type();
+
+    strings.push_back(type == DBUS_TYPE_STRING ? ri.get_string()
+                      : type == DBUS_TYPE_OBJECT_PATH ? ri.get_path() : NULL);
+    paths.push_back(type == DBUS_TYPE_OBJECT_PATH);
+  }
+
+  for (std::vector<Arg>::const_iterator ai = _args.begin(); ai != _args.end(); ++ai)
+  {
+    if (ai->n >= strings.size() || !strings[ai->n])
+      return false;
+
+    if (ai->path ? !path_matches(ai->value, strings[ai->n])
+        : paths[ai->n] || ai->value != strings[ai->n])
+      return false;
+  }
+
+  if (!_arg0_namespace.empty())
+  {
+    if (strings.empty() || !strings[0] || paths[0])
+      return false;
+
+    const char *name = strings[0];
+    size_t len = _arg0_namespace.length();
+
+    if (strncmp(name, _arg0_namespace.c_str(), len) || (name[len] != '\0' && name[len] != '.'))
+      return false;
+  }
+  return true;
+}
+
 InterfaceProxy::InterfaceProxy(const std::string &name)
   : Interface(name)
 {
@@ -128,15 +583,29 @@ InterfaceProxy::InterfaceProxy(const std::string &name)
   _interfaces[name] = this;
 }
 
+SignalTable::mapped_type *InterfaceProxy::find_signal(const char *member)
+{
+  SignalTable::iterator si = _signals.find(member);
+
+  return si != _signals.end() ? &si->second : NULL;
+}
+
 bool InterfaceProxy::dispatch_signal(const SignalMessage &msg)
 {
   const char *name = msg.member();
 
   debug_log("InterfaceProxy::Dispatch_Signal");
-  SignalTable::iterator si = _signals.find(name);
-  if (si != _signals.end())
+  SignalTable::mapped_type *signal = find_signal(name);
+  if (signal)
   {
-    si->second.call(msg);
+    const SignalMatch *match = find_match(name);
+
+    // the objects below the proxy's path only send what was asked for
+    if (match ? !match->matches(msg) || (!match->below() && object()->path() != msg.path())
+        : object()->path() != msg.path())
+      return false;
+
+    signal->call(msg);
     // Here we always return false because there might be
     // another InterfaceProxy listening for the same signal.
     // This way we instruct libdbus-1 to go on dispatching
@@ -149,6 +618,34 @@ bool InterfaceProxy::dispatch_signal(const SignalMessage &msg)
   }
 }
 
+void InterfaceProxy::match_signal(const char *member, const SignalMatch &match)
+{
+  _matches[member] = match;
+  _resubscribe();
+}
+
+void InterfaceProxy::disconnect_signal(const char *member)
+{
+  SignalTable::iterator si = _signals.find(member);
+
+  if (si == _signals.end() || si->second.empty())
+    return;
+
+  // the entry stays, generated proxies keep pointers to it
+  si->second = NULL;
+  _resubscribe();
+}
+
+const SignalMatch *InterfaceProxy::find_match(const char *member) const
+{
+  if (_matches.empty())
+    return NULL;
+
+  SignalMatchTable::const_iterator mi = _matches.find(member);
+
+  return mi != _matches.end() ? &mi->second : NULL;
+}
+
 Message InterfaceProxy::invoke_method(const CallMessage &call)
 {
   CallMessage &call2 = const_cast<CallMessage &>(call);
@@ -168,3 +665,14 @@ bool InterfaceProxy::invoke_method_noreply(const CallMessage &call)
 
   return _invoke_method_noreply(call2);
 }
+
+PendingCall InterfaceProxy::invoke_method_async(const CallMessage &call, PendingCall::Handler handler, void *object,
+                                                void *data)
+{
+  CallMessage &call2 = const_cast<CallMessage &>(call);
+
+  if (call.interface() == NULL)
+    call2.interface(name().c_str());
+
+  return _invoke_method_async(call2, handler, object, data);
+}
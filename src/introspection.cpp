@@ -29,6 +29,8 @@
 #include <dbus-c++/object.h>
 #include <dbus-c++/message.h>
 
+#include "introspection_p.h"
+
 #include <dbus/dbus.h>
 
 #include <sstream>
@@ -37,30 +39,22 @@ using namespace DBus;
 
 static const char *introspectable_name = "org.freedesktop.DBus.Introspectable";
 
-IntrospectableAdaptor::IntrospectableAdaptor()
-  : InterfaceAdaptor(introspectable_name)
-{
-  register_method(IntrospectableAdaptor, Introspect, Introspect);
-}
-
-Message IntrospectableAdaptor::Introspect(const CallMessage &call)
+void DBus::introspect_interfaces(std::ostringstream &xml, const InterfaceAdaptorTable &interfaces)
 {
-  debug_log("requested introspection data");
-
-  std::ostringstream xml;
-
-  xml << DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE;
-
-  const std::string path = object()->path();
-
-  xml << "<node name=\"" << path << "\">";
-
   InterfaceAdaptorTable::const_iterator iti;
 
-  for (iti = _interfaces.begin(); iti != _interfaces.end(); ++iti)
+  for (iti = interfaces.begin(); iti != interfaces.end(); ++iti)
   {
     debug_log("introspecting interface %s", iti->first.c_str());
 
+    const char *fragment = iti->second->introspect_xml();
+
+    if (fragment)
+    {
+      xml << fragment;
+      continue;
+    }
+
     IntrospectedInterface *const intro = iti->second->introspect();
     if (intro)
     {
@@ -113,37 +107,34 @@ Message IntrospectableAdaptor::Introspect(const CallMessage &call)
       xml << "\n\t</interface>";
     }
   }
+}
 
-  const ObjectPathList nodes = ObjectAdaptor::child_nodes_from_prefix(path + '/');
-  ObjectPathList::const_iterator oni;
-
-  for (oni = nodes.begin(); oni != nodes.end(); ++oni)
-  {
-    xml << "\n\t<node name=\"" << (*oni) << "\"/>";
-  }
-
-  /* broken
-  const ObjectAdaptorPList children = ObjectAdaptor::from_path_prefix(path + '/');
-
-  ObjectAdaptorPList::const_iterator oci;
-
-  for (oci = children.begin(); oci != children.end(); ++oci)
-  {
-  	std::string name = (*oci)->path().substr(path.length()+1);
-  	name.substr(name.find('/'));
+IntrospectableAdaptor::IntrospectableAdaptor()
+  : InterfaceAdaptor(introspectable_name)
+{}
 
-  	xml << "<node name=\"" << name << "\"/>";
-  }
-  */
+Message IntrospectableAdaptor::Introspect(const CallMessage &call)
+{
+  debug_log("requested introspection data");
 
-  xml << "\n</node>";
+  ObjectAdaptor *self = const_cast<ObjectAdaptor *>(object());
 
   ReturnMessage reply(call);
   MessageIter wi = reply.writer();
-  wi.append_string(xml.str().c_str());
+  wi.append_string(self->introspection().c_str());
   return reply;
 }
 
+const MethodEntry *IntrospectableAdaptor::method_table() const
+{
+  static const MethodEntry Introspectable_method_table[] =
+  {
+    { "Introspect", &method_member< IntrospectableAdaptor, &IntrospectableAdaptor::Introspect > },
+    { 0, 0 }
+  };
+  return Introspectable_method_table;
+}
+
 IntrospectedInterface *IntrospectableAdaptor::introspect() const
 {
   static IntrospectedArgument Introspect_args[] =
@@ -0,0 +1,175 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "match-rules.h"
+
+#include <dbus-c++/debug.h>
+
+using namespace DBus;
+
+static dbus_int32_t _rules_slot = -1;
+static pthread_once_t _rules_slot_once = PTHREAD_ONCE_INIT;
+
+static void _rules_slot_allocate()
+{
+  // one slot for the whole process, never freed
+  dbus_connection_allocate_data_slot(&_rules_slot);
+}
+
+static pthread_mutex_t _rules_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+MatchRules::MatchRules(DBusConnection *conn)
+  : _conn(conn)
+{
+  pthread_mutex_init(&_mutex, NULL);
+}
+
+MatchRules::~MatchRules()
+{
+  // the connection is going away, and the daemon drops its rules with it
+  pthread_mutex_destroy(&_mutex);
+}
+
+MatchRules *MatchRules::of(DBusConnection *conn)
+{
+  pthread_once(&_rules_slot_once, _rules_slot_allocate);
+
+  if (_rules_slot == -1)
+    return NULL;
+
+  pthread_mutex_lock(&_rules_mutex);
+
+  MatchRules *rules = static_cast<MatchRules *>(dbus_connection_get_data(conn, _rules_slot));
+
+  if (!rules)
+  {
+    // not a reference: the rules live as long as the connection
+    rules = new MatchRules(conn);
+
+    if (!dbus_connection_set_data(conn, _rules_slot, rules, free_stub))
+    {
+      delete rules;
+      rules = NULL;
+    }
+  }
+
+  pthread_mutex_unlock(&_rules_mutex);
+  return rules;
+}
+
+void MatchRules::free_stub(void *data)
+{
+  delete static_cast<MatchRules *>(data);
+}
+
+void MatchRules::add(const std::string &rule)
+{
+  pthread_mutex_lock(&_mutex);
+
+  if (++_rules[rule] == 1)
+    send("AddMatch", rule);
+
+  pthread_mutex_unlock(&_mutex);
+}
+
+void MatchRules::remove(const std::string &rule)
+{
+  pthread_mutex_lock(&_mutex);
+
+  RuleTable::iterator ri = _rules.find(rule);
+
+  if (ri != _rules.end() && --ri->second == 0)
+  {
+    send("RemoveMatch", rule);
+    _rules.erase(ri);
+  }
+
+  pthread_mutex_unlock(&_mutex);
+}
+
+void MatchRules::send(const char *method, const std::string &rule)
+{
+  DBusMessage *msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                     DBUS_INTERFACE_DBUS, method);
+  const char *arg = rule.c_str();
+
+  if (!msg || !dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg, DBUS_TYPE_INVALID))
+  {
+    debug_log("unable to build %s for %s", method, arg);
+
+    if (msg)
+      dbus_message_unref(msg);
+
+    return;
+  }
+
+  DBusPendingCall *pending = NULL;
+
+  if (!dbus_connection_send_with_reply(_conn, msg, &pending, -1) || !pending)
+  {
+    debug_log("unable to send %s for %s", method, arg);
+  }
+  else
+  {
+    debug_log("%s %s", method, arg);
+
+    // nobody waits for the reply, it is only logged if an error
+    std::string *request = new std::string(method);
+    *request += ' ';
+    *request += rule;
+
+    if (!dbus_pending_call_set_notify(pending, reply_stub, request, free_request_stub))
+      delete request;
+
+    dbus_pending_call_unref(pending);
+  }
+
+  dbus_message_unref(msg);
+}
+
+void MatchRules::reply_stub(DBusPendingCall *pending, void *data)
+{
+  DBusMessage *reply = dbus_pending_call_steal_reply(pending);
+
+  if (!reply)
+    return;
+
+  if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR)
+  {
+    const char *message = "";
+
+    dbus_message_get_args(reply, NULL, DBUS_TYPE_STRING, &message, DBUS_TYPE_INVALID);
+
+    debug_log("%s failed: %s: %s", static_cast<std::string *>(data)->c_str(),
+              dbus_message_get_error_name(reply), message);
+  }
+
+  dbus_message_unref(reply);
+}
+
+void MatchRules::free_request_stub(void *data)
+{
+  delete static_cast<std::string *>(data);
+}
@@ -0,0 +1,91 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_MATCH_RULES_H
+#define __DBUSXX_MATCH_RULES_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/api.h>
+
+#include <dbus/dbus.h>
+
+#include <map>
+#include <string>
+
+#include <pthread.h>
+
+namespace DBus
+{
+
+/*	The match rules the library asks the bus daemon for on behalf of a
+	connection, counted: identical rules, e.g. those of two proxies of the
+	same object, are sent once and removed along with their last user.
+	AddMatch and RemoveMatch go out without waiting for the reply: they
+	queue up behind each other and reach the daemon before whatever the
+	connection sends afterwards, which is enough for the signals a call
+	of ours triggers to be routed. The reply is only looked at, once the
+	dispatcher gets it, to log the rules the daemon rejected. Attached to the
+  DBusConnection, as ObjectTree is. Thread safe.
+*/
+class DXXAPILOCAL MatchRules
+{
+public:
+
+  // the rules of `conn', created on first use
+  static MatchRules *of(DBusConnection *conn);
+
+  void add(const std::string &rule);
+
+  void remove(const std::string &rule);
+
+private:
+
+  typedef std::map<std::string, unsigned int> RuleTable;
+
+  MatchRules(DBusConnection *conn);
+
+  ~MatchRules();
+
+  MatchRules(const MatchRules &);
+
+  MatchRules &operator = (const MatchRules &);
+
+  // with the mutex held, so the daemon sees them in the same order
+  void send(const char *method, const std::string &rule);
+
+  static void free_stub(void *);
+
+  static void reply_stub(DBusPendingCall *pending, void *data);
+
+  static void free_request_stub(void *);
+
+  DBusConnection *_conn;
+  RuleTable _rules;
+  pthread_mutex_t _mutex;
+};
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_MATCH_RULES_H
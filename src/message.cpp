@@ -330,38 +330,46 @@ void MessageIter::copy_data(MessageIter &to)
 {
   for (MessageIter &from = *this; !from.at_end(); ++from)
   {
-    if (is_basic_type(from.type()))
-    {
-      debug_log("copying basic type: %c", from.type());
+    from.copy_value(to);
+  }
+}
 
-      unsigned char value[8];
-      from.get_basic(from.type(), &value);
-      to.append_basic(from.type(), &value);
-    }
-    else
+void MessageIter::copy_value(MessageIter &to)
+{
+  MessageIter &from = *this;
+
+  if (is_basic_type(from.type()))
+  {
+    debug_log("copying basic type: %c", from.type());
+
+    unsigned char value[8];
+    from.get_basic(from.type(), &value);
+    to.append_basic(from.type(), &value);
+  }
+  else
+  {
+    MessageIter from_container = from.recurse();
+    char *sig = from_container.signature();
+
+    debug_log("copying compound type: %c[%s]", from.type(), sig);
+
+    MessageIter to_container(to.msg());
+    dbus_bool_t ret = dbus_message_iter_open_container
+    (
+      (DBusMessageIter *) & (to._iter),
+      from.type(),
+      (from.type() == DBUS_TYPE_VARIANT || from.type() == DBUS_TYPE_ARRAY) ? sig : NULL,
+      (DBusMessageIter *) & (to_container._iter)
+    );
+    if (!ret)
     {
-      MessageIter from_container = from.recurse();
-      char *sig = from_container.signature();
-
-      debug_log("copying compound type: %c[%s]", from.type(), sig);
-
-      MessageIter to_container(to.msg());
-      dbus_bool_t ret = dbus_message_iter_open_container
-      (
-        (DBusMessageIter *) & (to._iter),
-        from.type(),
-        (from.type() == DBUS_TYPE_VARIANT || from.type() == DBUS_TYPE_ARRAY) ? sig : NULL,
-        (DBusMessageIter *) & (to_container._iter)
-      );
-      if (!ret)
-      {
-        throw ErrorNoMemory("Unable to append container");
-      }
-
-      from_container.copy_data(to_container);
-      to.close_container(to_container);
       free(sig);
+      throw ErrorNoMemory("Unable to append container");
     }
+
+    from_container.copy_data(to_container);
+    to.close_container(to_container);
+    free(sig);
   }
 }
 
@@ -392,13 +400,16 @@ Message::Message(const Message &m, bool share_private)
       _pvt->msg = m._pvt->msg;
   }
   debug_log("%s About to ref msg this %p msg %p", __func__, this, _pvt->msg);
-  dbus_message_ref(_pvt->msg);
+  if (_pvt->msg)
+    dbus_message_ref(_pvt->msg);
 }
 
 Message::~Message()
 {
+  // a default constructed Message has nothing to release
   debug_log("%s About to unref msg this %p msg %p", __func__, this, _pvt->msg);
-  dbus_message_unref(_pvt->msg);
+  if (_pvt->msg)
+    dbus_message_unref(_pvt->msg);
 }
 
 Message &Message::operator = (const Message &m)
@@ -406,10 +417,12 @@ Message &Message::operator = (const Message &m)
   if (&m != this)
   {
     debug_log("%s About to unref msg this %p msg %p", __func__, this, _pvt->msg);
-    dbus_message_unref(_pvt->msg);
+    if (_pvt->msg)
+      dbus_message_unref(_pvt->msg);
     _pvt = m._pvt;
     debug_log("%s About to ref msg this %p msg %p", __func__, this, _pvt->msg);
-    dbus_message_ref(_pvt->msg);
+    if (_pvt->msg)
+      dbus_message_ref(_pvt->msg);
   }
   return *this;
 }
@@ -418,7 +431,7 @@ Message Message::copy()
 {
   Private *pvt = new Private(dbus_message_copy(_pvt->msg));
   debug_log("%s Copied %p", __func__, pvt->msg);
-  return Message(pvt);
+  return Message(pvt, false);
 }
 
 bool Message::append(int first_type, ...)
@@ -447,6 +460,11 @@ int Message::serial() const
   return dbus_message_get_serial(_pvt->msg);
 }
 
+void Message::serial(int s)
+{
+  dbus_message_set_serial(_pvt->msg, s);
+}
+
 int Message::reply_serial() const
 {
   return dbus_message_get_reply_serial(_pvt->msg);
@@ -487,6 +505,38 @@ bool Message::is_signal(const char *interface, const char *member) const
   return dbus_message_is_signal(_pvt->msg, interface, member);
 }
 
+size_t Message::size() const
+{
+  char *data;
+  int length;
+
+  if (!dbus_message_marshal(_pvt->msg, &data, &length))
+    throw ErrorNoMemory("Unable to marshal message");
+
+  dbus_free(data);
+  return length;
+}
+
+std::string Message::body() const
+{
+  char *data;
+  int length;
+
+  if (!dbus_message_marshal(_pvt->msg, &data, &length))
+    throw ErrorNoMemory("Unable to marshal message");
+
+  // the body comes last, its length is the second field of the header
+  unsigned char *l = (unsigned char *) data + 4;
+  size_t body_length = data[0] == DBUS_LITTLE_ENDIAN
+                       ? l[0] | l[1] << 8 | l[2] << 16 | (size_t) l[3] << 24
+                       : l[3] | l[2] << 8 | l[1] << 16 | (size_t) l[0] << 24;
+
+  std::string b(data + length - body_length, body_length);
+
+  dbus_free(data);
+  return b;
+}
+
 MessageIter Message::writer()
 {
   MessageIter iter(*this);
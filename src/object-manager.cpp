@@ -0,0 +1,292 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/object-manager.h>
+#include <dbus-c++/introspection.h>
+#include <dbus-c++/object.h>
+#include <dbus-c++/message.h>
+#include <dbus-c++/debug.h>
+
+using namespace DBus;
+
+static const char *object_manager_name = "org.freedesktop.DBus.ObjectManager";
+
+// how many managers exist in the process, objects skip the lookup if none
+static volatile int _managers = 0;
+
+std::vector<ObjectManagerAdaptor *> ObjectManagerAdaptor::managers_of(ObjectAdaptor &object)
+{
+  std::vector<ObjectManagerAdaptor *> managers;
+
+  if (!__sync_fetch_and_add(&_managers, 0))
+    return managers;
+
+  std::string path = object.path();
+
+  while (path.length() > 1)
+  {
+    size_t slash = path.rfind('/');
+
+    path.erase(slash ? slash : 1);
+
+    ObjectAdaptor *parent = ObjectAdaptor::from_path(object.conn(), path);
+
+    if (!parent)
+      continue;
+
+    ObjectManagerAdaptor *manager = dynamic_cast<ObjectManagerAdaptor *>(parent->find_interface(object_manager_name));
+
+    if (manager)
+      managers.push_back(manager);
+  }
+  return managers;
+}
+
+ObjectManagerAdaptor::ObjectManagerAdaptor()
+  : InterfaceAdaptor(object_manager_name)
+{
+  __sync_fetch_and_add(&_managers, 1);
+}
+
+ObjectManagerAdaptor::~ObjectManagerAdaptor()
+{
+  __sync_fetch_and_sub(&_managers, 1);
+}
+
+void ObjectManagerAdaptor::registered(ObjectAdaptor &object)
+{
+  std::vector<ObjectManagerAdaptor *> managers = managers_of(object);
+
+  for (std::vector<ObjectManagerAdaptor *>::iterator mi = managers.begin(); mi != managers.end(); ++mi)
+    (*mi)->interfaces_added(object);
+}
+
+void ObjectManagerAdaptor::unregistered(ObjectAdaptor &object)
+{
+  std::vector<ObjectManagerAdaptor *> managers = managers_of(object);
+
+  for (std::vector<ObjectManagerAdaptor *>::iterator mi = managers.begin(); mi != managers.end(); ++mi)
+    (*mi)->interfaces_removed(object);
+}
+
+void ObjectManagerAdaptor::append_interfaces(MessageIter &iter, ObjectAdaptor &object)
+{
+  MessageIter ai = iter.new_array("{sa{sv}}");
+
+  for (InterfaceAdaptorTable::iterator ii = object._interfaces.begin(); ii != object._interfaces.end(); ++ii)
+  {
+    MessageIter ei = ai.new_dict_entry();
+
+    ei.append_string(ii->first.c_str());
+    ii->second->append_properties(ei);
+
+    ai.close_container(ei);
+  }
+  iter.close_container(ai);
+}
+
+void ObjectManagerAdaptor::interfaces_added(ObjectAdaptor &object)
+{
+  debug_log("%s added below %s", object.path().c_str(), this->object()->path().c_str());
+
+  SignalMessage sig("InterfacesAdded");
+  MessageIter wi = sig.writer();
+
+  wi.append_path(object.path().c_str());
+  append_interfaces(wi, object);
+
+  emit_signal(sig);
+}
+
+void ObjectManagerAdaptor::interfaces_removed(ObjectAdaptor &object)
+{
+  debug_log("%s removed below %s", object.path().c_str(), this->object()->path().c_str());
+
+  SignalMessage sig("InterfacesRemoved");
+  MessageIter wi = sig.writer();
+
+  wi.append_path(object.path().c_str());
+
+  MessageIter ai = wi.new_array("s");
+
+  for (InterfaceAdaptorTable::iterator ii = object._interfaces.begin(); ii != object._interfaces.end(); ++ii)
+    ai.append_string(ii->first.c_str());
+
+  wi.close_container(ai);
+
+  emit_signal(sig);
+}
+
+Message ObjectManagerAdaptor::GetManagedObjects(const CallMessage &call)
+{
+  ObjectAdaptor *self = const_cast<ObjectAdaptor *>(object());
+  const Path &path = self->path();
+
+  // the objects strictly below, which the root is not
+  ObjectAdaptorPList objects = ObjectAdaptor::from_path_prefix(self->conn(), path == "/" ? std::string(path) : path + "/");
+
+  debug_log("%u objects managed by %s", (unsigned) objects.size(), path.c_str());
+
+  ReturnMessage reply(call);
+  MessageIter wi = reply.writer();
+  MessageIter ai = wi.new_array("{oa{sa{sv}}}");
+
+  for (ObjectAdaptorPList::iterator oi = objects.begin(); oi != objects.end(); ++oi)
+  {
+    if (*oi == self)
+      continue;
+
+    MessageIter ei = ai.new_dict_entry();
+
+    ei.append_path((*oi)->path().c_str());
+    append_interfaces(ei, **oi);
+
+    ai.close_container(ei);
+  }
+  wi.close_container(ai);
+
+  return reply;
+}
+
+const MethodEntry *ObjectManagerAdaptor::method_table() const
+{
+  static const MethodEntry ObjectManager_method_table[] =
+  {
+    { "GetManagedObjects", &method_member< ObjectManagerAdaptor, &ObjectManagerAdaptor::GetManagedObjects > },
+    { 0, 0 }
+  };
+  return ObjectManager_method_table;
+}
+
+IntrospectedInterface *ObjectManagerAdaptor::introspect() const
+{
+  static IntrospectedArgument GetManagedObjects_args[] =
+  {
+    { "objects", "a{oa{sa{sv}}}", false },
+    { 0, 0, 0 }
+  };
+  static IntrospectedArgument InterfacesAdded_args[] =
+  {
+    { "object", "o", false },
+    { "interfaces", "a{sa{sv}}", false },
+    { 0, 0, 0 }
+  };
+  static IntrospectedArgument InterfacesRemoved_args[] =
+  {
+    { "object", "o", false },
+    { "interfaces", "as", false },
+    { 0, 0, 0 }
+  };
+  static IntrospectedMethod ObjectManager_methods[] =
+  {
+    { "GetManagedObjects", GetManagedObjects_args },
+    { 0, 0 }
+  };
+  static IntrospectedMethod ObjectManager_signals[] =
+  {
+    { "InterfacesAdded", InterfacesAdded_args },
+    { "InterfacesRemoved", InterfacesRemoved_args },
+    { 0, 0 }
+  };
+  static IntrospectedProperty ObjectManager_properties[] =
+  {
+    { 0, 0, 0, 0 }
+  };
+  static IntrospectedInterface ObjectManager_interface =
+  {
+    object_manager_name,
+    ObjectManager_methods,
+    ObjectManager_signals,
+    ObjectManager_properties
+  };
+  return &ObjectManager_interface;
+}
+
+ObjectManagerProxy::ObjectManagerProxy()
+  : InterfaceProxy(object_manager_name)
+{
+  connect_signal(ObjectManagerProxy, InterfacesAdded, _InterfacesAdded_stub);
+  connect_signal(ObjectManagerProxy, InterfacesRemoved, _InterfacesRemoved_stub);
+}
+
+ManagedObjects ObjectManagerProxy::GetManagedObjects()
+{
+  DBus::CallMessage call;
+
+  call.member("GetManagedObjects");
+
+  DBus::Message ret = invoke_method(call);
+  DBus::MessageIter ri = ret.reader();
+
+  ManagedObjects objects;
+  ri >> objects;
+
+  return objects;
+}
+
+void ObjectManagerProxy::refresh()
+{
+  ManagedObjects objects = GetManagedObjects();
+
+  _objects.swap(objects);
+}
+
+void ObjectManagerProxy::_InterfacesAdded_stub(const SignalMessage &sig)
+{
+  MessageIter ri = sig.reader();
+  Path path;
+  InterfaceValues interfaces;
+
+  ri >> path >> interfaces;
+
+  InterfaceValues &known = _objects[path];
+
+  for (InterfaceValues::iterator ii = interfaces.begin(); ii != interfaces.end(); ++ii)
+    known[ii->first] = ii->second;
+
+  InterfacesAdded(path, interfaces);
+}
+
+void ObjectManagerProxy::_InterfacesRemoved_stub(const SignalMessage &sig)
+{
+  MessageIter ri = sig.reader();
+  Path path;
+  std::vector<std::string> interfaces;
+
+  ri >> path >> interfaces;
+
+  ManagedObjects::iterator oi = _objects.find(path);
+
+  if (oi != _objects.end())
+  {
+    for (std::vector<std::string>::iterator ii = interfaces.begin(); ii != interfaces.end(); ++ii)
+      oi->second.erase(*ii);
+
+    if (oi->second.empty())
+      _objects.erase(oi);
+  }
+
+  InterfacesRemoved(path, interfaces);
+}
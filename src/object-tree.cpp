@@ -0,0 +1,317 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "object-tree.h"
+
+#include <set>
+#include <vector>
+
+using namespace DBus;
+
+static dbus_int32_t _tree_slot = -1;
+static pthread_once_t _tree_slot_once = PTHREAD_ONCE_INIT;
+
+static void _tree_slot_allocate()
+{
+  // one slot for the whole process, never freed
+  dbus_connection_allocate_data_slot(&_tree_slot);
+}
+
+// never destroyed, connections may be finalized until the very end
+static pthread_mutex_t _trees_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::set<ObjectTree *> *_trees = NULL;
+
+/*	the segment of `path' starting at `pos', which moves to the next one;
+	false at the end of the path
+*/
+static bool next_segment(const std::string &path, size_t &pos, std::string &segment)
+{
+  if (pos >= path.length())
+    return false;
+
+  size_t end = path.find('/', pos);
+
+  if (end == std::string::npos)
+    end = path.length();
+
+  segment.assign(path, pos, end - pos);
+  pos = end + 1;
+  return true;
+}
+
+ObjectTree::Node::~Node()
+{
+  for (NodeTable::iterator ci = children.begin(); ci != children.end(); ++ci)
+    delete ci->second;
+}
+
+void ObjectTree::Node::objects(ObjectAdaptorPList &list) const
+{
+  if (object)
+    list.push_back(object);
+
+  for (NodeTable::const_iterator ci = children.begin(); ci != children.end(); ++ci)
+    ci->second->objects(list);
+}
+
+ObjectTree::ObjectTree()
+  : _clock(1)
+{
+  _root.stamp = _clock;
+
+  pthread_rwlock_init(&_lock, NULL);
+}
+
+ObjectTree::~ObjectTree()
+{
+  pthread_rwlock_destroy(&_lock);
+}
+
+ObjectTree *ObjectTree::of(DBusConnection *conn, bool create)
+{
+  pthread_once(&_tree_slot_once, _tree_slot_allocate);
+
+  if (_tree_slot == -1)
+    return NULL;
+
+  pthread_mutex_lock(&_trees_mutex);
+
+  ObjectTree *tree = static_cast<ObjectTree *>(dbus_connection_get_data(conn, _tree_slot));
+
+  if (!tree && create)
+  {
+    tree = new ObjectTree;
+
+    if (dbus_connection_set_data(conn, _tree_slot, tree, free_stub))
+    {
+      if (!_trees)
+        _trees = new std::set<ObjectTree *>;
+
+      _trees->insert(tree);
+    }
+    else
+    {
+      delete tree;
+      tree = NULL;
+    }
+  }
+
+  pthread_mutex_unlock(&_trees_mutex);
+  return tree;
+}
+
+void ObjectTree::free_stub(void *data)
+{
+  ObjectTree *tree = static_cast<ObjectTree *>(data);
+
+  pthread_mutex_lock(&_trees_mutex);
+  _trees->erase(tree);
+  pthread_mutex_unlock(&_trees_mutex);
+
+  delete tree;
+}
+
+void ObjectTree::each(void (*fn)(const ObjectTree *, void *), void *data)
+{
+  pthread_mutex_lock(&_trees_mutex);
+
+  if (_trees)
+  {
+    for (std::set<ObjectTree *>::const_iterator ti = _trees->begin(); ti != _trees->end(); ++ti)
+      fn(*ti, data);
+  }
+
+  pthread_mutex_unlock(&_trees_mutex);
+}
+
+bool ObjectTree::insert(const std::string &path, ObjectAdaptor *object)
+{
+  pthread_rwlock_wrlock(&_lock);
+
+  Node *node = &_root;
+  size_t pos = 1;
+  std::string segment;
+
+  while (next_segment(path, pos, segment))
+  {
+    Node *&child = node->children[segment];
+
+    if (!child)
+    {
+      child = new Node;
+      child->stamp = ++_clock;
+      node->stamp = ++_clock;
+    }
+
+    node = child;
+  }
+
+  bool ok = !node->object || node->object == object;
+
+  if (ok)
+    node->object = object;
+
+  pthread_rwlock_unlock(&_lock);
+  return ok;
+}
+
+void ObjectTree::erase(const std::string &path, ObjectAdaptor *object)
+{
+  pthread_rwlock_wrlock(&_lock);
+
+  // the nodes down to the object's, to prune the ones left empty
+  std::vector<Node *> nodes(1, &_root);
+  std::vector<NodeTable::iterator> links;
+  size_t pos = 1;
+  std::string segment;
+
+  while (next_segment(path, pos, segment))
+  {
+    NodeTable::iterator ci = nodes.back()->children.find(segment);
+
+    if (ci == nodes.back()->children.end())
+    {
+      pthread_rwlock_unlock(&_lock);
+      return;
+    }
+
+    nodes.push_back(ci->second);
+    links.push_back(ci);
+  }
+
+  if (nodes.back()->object == object)
+  {
+    nodes.back()->object = NULL;
+
+    while (!links.empty() && !nodes.back()->object && nodes.back()->children.empty())
+    {
+      delete nodes.back();
+      nodes.pop_back();
+
+      nodes.back()->children.erase(links.back());
+      nodes.back()->stamp = ++_clock;
+      links.pop_back();
+    }
+  }
+
+  pthread_rwlock_unlock(&_lock);
+}
+
+const ObjectTree::Node *ObjectTree::find_node(const std::string &path) const
+{
+  if (path.empty() || path[0] != '/')
+    return NULL;
+
+  const Node *node = &_root;
+  size_t pos = 1;
+  std::string segment;
+
+  while (next_segment(path, pos, segment))
+  {
+    NodeTable::const_iterator ci = node->children.find(segment);
+
+    if (ci == node->children.end())
+      return NULL;
+
+    node = ci->second;
+  }
+  return node;
+}
+
+ObjectAdaptor *ObjectTree::find(const std::string &path) const
+{
+  pthread_rwlock_rdlock(&_lock);
+
+  const Node *node = find_node(path);
+  ObjectAdaptor *object = node ? node->object : NULL;
+
+  pthread_rwlock_unlock(&_lock);
+  return object;
+}
+
+unsigned long ObjectTree::children(const std::string &path, ObjectPathList &nodes) const
+{
+  pthread_rwlock_rdlock(&_lock);
+
+  const Node *node = find_node(path);
+  unsigned long current = 0;
+
+  if (node)
+  {
+    for (NodeTable::const_iterator ci = node->children.begin(); ci != node->children.end(); ++ci)
+      nodes.push_back(ci->first);
+
+    current = node->stamp;
+  }
+
+  pthread_rwlock_unlock(&_lock);
+  return current;
+}
+
+unsigned long ObjectTree::stamp(const std::string &path) const
+{
+  pthread_rwlock_rdlock(&_lock);
+
+  const Node *node = find_node(path);
+  unsigned long current = node ? node->stamp : 0;
+
+  pthread_rwlock_unlock(&_lock);
+  return current;
+}
+
+void ObjectTree::prefixed(const std::string &prefix, ObjectAdaptorPList *objects, ObjectPathList *nodes) const
+{
+  size_t slash = prefix.rfind('/');
+
+  if (slash == std::string::npos)
+    return;
+
+  // the node holding the last segment of the prefix, maybe a partial one
+  std::string dir = slash ? prefix.substr(0, slash) : "/";
+  std::string rest = prefix.substr(slash + 1);
+
+  pthread_rwlock_rdlock(&_lock);
+
+  const Node *node = find_node(dir);
+
+  if (node)
+  {
+    if (node == &_root && prefix == "/" && node->object && objects)
+      objects->push_back(node->object);
+
+    NodeTable::const_iterator ci = node->children.lower_bound(rest);
+
+    for (; ci != node->children.end() && !ci->first.compare(0, rest.length(), rest); ++ci)
+    {
+      if (objects)
+        ci->second->objects(*objects);
+
+      if (nodes && ci->first.length() > rest.length())
+        nodes->push_back(ci->first.substr(rest.length()));
+    }
+  }
+
+  pthread_rwlock_unlock(&_lock);
+}
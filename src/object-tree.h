@@ -0,0 +1,122 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_OBJECT_TREE_H
+#define __DBUSXX_OBJECT_TREE_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/object.h>
+
+#include <dbus/dbus.h>
+
+#include <map>
+#include <string>
+
+#include <pthread.h>
+
+namespace DBus
+{
+
+/*	The objects a connection exports, in a tree of path segments: finding
+	an object costs the depth of its path and the children of a node are
+	listed without scanning the others. Attached to the DBusConnection,
+	so all the Connections wrapping it share it. Thread safe.
+*/
+class DXXAPILOCAL ObjectTree
+{
+public:
+
+  /*	the tree of `conn', created if `create' holds, else NULL if it has
+  	none yet
+  */
+  static ObjectTree *of(DBusConnection *conn, bool create);
+
+  /*	runs `fn' on the trees of all the connections, for the lookups
+  	which name no connection
+  */
+  static void each(void (*fn)(const ObjectTree *, void *), void *data);
+
+  // false if another object has `path' already
+  bool insert(const std::string &path, ObjectAdaptor *object);
+
+  // only if `object' is the one at `path'
+  void erase(const std::string &path, ObjectAdaptor *object);
+
+  ObjectAdaptor *find(const std::string &path) const;
+
+  /*	the names of the nodes right under `path', sorted, and the stamp
+  	of that list
+  */
+  unsigned long children(const std::string &path, ObjectPathList &nodes) const;
+
+  /*	changes whenever nodes appear or vanish right under `path', 0 if
+  	there is no node there
+  */
+  unsigned long stamp(const std::string &path) const;
+
+  /*	the objects whose path starts with the string `prefix', and the
+  	names of their next segment after it
+  */
+  void prefixed(const std::string &prefix, ObjectAdaptorPList *objects, ObjectPathList *nodes) const;
+
+private:
+
+  struct Node
+  {
+    ObjectAdaptor *object;
+    std::map<std::string, Node *> children;
+    unsigned long stamp;	// of the last change of children
+
+    Node() : object(NULL), stamp(0)
+    {}
+
+    ~Node();
+
+    void objects(ObjectAdaptorPList &list) const;
+  };
+
+  typedef std::map<std::string, Node *> NodeTable;
+
+  ObjectTree();
+
+  ~ObjectTree();
+
+  ObjectTree(const ObjectTree &);
+
+  ObjectTree &operator = (const ObjectTree &);
+
+  // with the lock held
+  const Node *find_node(const std::string &path) const;
+
+  static void free_stub(void *);
+
+  Node _root;
+  unsigned long _clock;
+  mutable pthread_rwlock_t _lock;
+};
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_OBJECT_TREE_H
@@ -27,15 +27,26 @@
 
 #include <dbus-c++/debug.h>
 #include <dbus-c++/object.h>
+#include <dbus-c++/object-manager.h>
+#include <dbus-c++/subtree.h>
 #include "internalerror.h"
 
+#include <algorithm>
 #include <cstring>
 #include <map>
+#include <new>
+#include <pthread.h>
+#include <sstream>
+#include <time.h>
 #include <dbus/dbus.h>
 
 #include "message_p.h"
 #include "server_p.h"
 #include "connection_p.h"
+#include "object-tree.h"
+#include "signal-router.h"
+#include "match-rules.h"
+#include "introspection_p.h"
 
 using namespace DBus;
 
@@ -56,6 +67,152 @@ void Object::set_timeout(int new_timeout)
   _default_timeout = new_timeout;
 }
 
+static pthread_key_t _call_context_key;
+static pthread_once_t _call_context_once = PTHREAD_ONCE_INIT;
+
+static void _call_context_key_create()
+{
+  pthread_key_create(&_call_context_key, NULL);
+}
+
+CallContext::CallContext(const CallMessage &call, const Tag *tag)
+  : _call(call), _tag(tag), _deferred(NULL), _failed(false), _expiration(0), _batched(false)
+{
+  pthread_once(&_call_context_once, _call_context_key_create);
+
+  _previous = static_cast<CallContext *>(pthread_getspecific(_call_context_key));
+  pthread_setspecific(_call_context_key, this);
+}
+
+CallContext::~CallContext()
+{
+  pthread_setspecific(_call_context_key, _previous);
+}
+
+CallContext *CallContext::current()
+{
+  pthread_once(&_call_context_once, _call_context_key_create);
+
+  return static_cast<CallContext *>(pthread_getspecific(_call_context_key));
+}
+
+void CallContext::defer(const Tag *tag)
+{
+  _deferred = tag;
+  _failed = false;
+}
+
+void CallContext::fail(const char *name, const char *message)
+{
+  _failed = true;
+  _deferred = NULL;
+  _error_name = name ? name : DBUS_ERROR_FAILED;
+  _error_message = message ? message : "";
+}
+
+void CallContext::fail(const Error &error)
+{
+  fail(error.name(), error.message());
+}
+
+bool CallContext::settled()
+{
+  CallContext *ctx = current();
+
+  return ctx && (ctx->_deferred || ctx->_failed);
+}
+
+void CallContext::expires_in(int timeout)
+{
+  _expiration = Deadline::now() + timeout;
+}
+
+int CallContext::remaining() const
+{
+  if (!_expiration)
+    return -1;
+
+  double left = _expiration - Deadline::now();
+
+  return left > 0 ? (int) left : 0;
+}
+
+static pthread_key_t _deadline_key;
+static pthread_once_t _deadline_once = PTHREAD_ONCE_INIT;
+
+static void _deadline_key_create()
+{
+  pthread_key_create(&_deadline_key, NULL);
+}
+
+Deadline::Deadline(int timeout)
+  : _expiration(now() + timeout)
+{
+  _previous = current();
+
+  // an inner scope can't extend an outer one
+  if (_previous && _previous->_expiration < _expiration)
+    _expiration = _previous->_expiration;
+
+  pthread_setspecific(_deadline_key, this);
+}
+
+Deadline::~Deadline()
+{
+  pthread_setspecific(_deadline_key, _previous);
+}
+
+int Deadline::remaining() const
+{
+  double left = _expiration - now();
+
+  return left > 0 ? (int) left : 0;
+}
+
+bool Deadline::expired() const
+{
+  return _expiration <= now();
+}
+
+Deadline *Deadline::current()
+{
+  pthread_once(&_deadline_once, _deadline_key_create);
+
+  return static_cast<Deadline *>(pthread_getspecific(_deadline_key));
+}
+
+int Deadline::bound(int timeout)
+{
+  double expiration = 0;
+
+  Deadline *d = current();
+  if (d)
+    expiration = d->_expiration;
+
+  CallContext *ctx = CallContext::current();
+  if (ctx && ctx->expiration() && (!expiration || ctx->expiration() < expiration))
+    expiration = ctx->expiration();
+
+  if (!expiration)
+    return timeout;
+
+  double left = expiration - now();
+
+  if (left < 1)
+    throw ErrorTimeout("Deadline exceeded");
+
+  return (timeout < 0 || left < timeout) ? (int) left : timeout;
+}
+
+double Deadline::now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
 struct ObjectAdaptor::Private
 {
   static void unregister_function_stub(DBusConnection *, void *);
@@ -99,95 +256,242 @@ DBusHandlerResult ObjectAdaptor::Private::message_function_stub(DBusConnection *
   }
 }
 
-typedef std::map<Path, ObjectAdaptor *> ObjectAdaptorTable;
-static ObjectAdaptorTable _adaptor_table;
+ObjectAdaptor *ObjectAdaptor::from_path(Connection &conn, const Path &path)
+{
+  ObjectTree *tree = ObjectTree::of(conn._pvt->conn, false);
 
-ObjectAdaptor *ObjectAdaptor::from_path(const Path &path)
+  return tree ? tree->find(path) : NULL;
+}
+
+ObjectPathList ObjectAdaptor::child_nodes(Connection &conn, const Path &path)
 {
-  ObjectAdaptorTable::iterator ati = _adaptor_table.find(path);
+  ObjectPathList nodes;
+  ObjectTree *tree = ObjectTree::of(conn._pvt->conn, false);
 
-  if (ati != _adaptor_table.end())
-    return ati->second;
+  if (tree)
+    tree->children(path, nodes);
 
-  return NULL;
+  return nodes;
 }
 
-ObjectAdaptorPList ObjectAdaptor::from_path_prefix(const std::string &prefix)
+ObjectAdaptorPList ObjectAdaptor::from_path_prefix(Connection &conn, const std::string &prefix)
 {
-  ObjectAdaptorPList ali;
+  ObjectAdaptorPList objects;
+  ObjectTree *tree = ObjectTree::of(conn._pvt->conn, false);
+
+  if (tree)
+    tree->prefixed(prefix, &objects, NULL);
+
+  return objects;
+}
 
-  ObjectAdaptorTable::iterator ati = _adaptor_table.begin();
+std::string ObjectAdaptor::introspection()
+{
+  ObjectTree *tree = ObjectTree::of(conn()._pvt->conn, false);
 
-  size_t plen = prefix.length();
+  _introspection_mutex.lock();
 
-  while (ati != _adaptor_table.end())
+  // the stamp is 0 for the objects outside of the tree, never kept
+  if (_introspection_stamp && _introspection_interfaces == _interfaces.size()
+      && tree && tree->stamp(path()) == _introspection_stamp)
   {
-    if (!strncmp(ati->second->path().c_str(), prefix.c_str(), plen))
-      ali.push_back(ati->second);
+    std::string xml = _introspection;
 
-    ++ati;
+    _introspection_mutex.unlock();
+    return xml;
   }
 
-  return ali;
+  debug_log("assembling introspection data of %s", path().c_str());
+
+  ObjectPathList nodes;
+  unsigned long stamp = tree ? tree->children(path(), nodes) : 0;
+  std::ostringstream xml;
+
+  xml << DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE;
+  xml << "<node name=\"" << path() << "\">";
+
+  introspect_interfaces(xml, _interfaces);
+
+  for (ObjectPathList::const_iterator ni = nodes.begin(); ni != nodes.end(); ++ni)
+    xml << "\n\t<node name=\"" << *ni << "\"/>";
+
+  xml << "\n</node>";
+
+  _introspection = xml.str();
+  _introspection_stamp = stamp;
+  _introspection_interfaces = _interfaces.size();
+
+  std::string document = _introspection;
+
+  _introspection_mutex.unlock();
+  return document;
 }
 
-ObjectPathList ObjectAdaptor::child_nodes_from_prefix(const std::string &prefix)
+struct FindObject
 {
-  ObjectPathList ali;
+  const Path *path;
+  ObjectAdaptor *object;
 
-  ObjectAdaptorTable::iterator ati = _adaptor_table.begin();
+  static void tree(const ObjectTree *tree, void *data)
+  {
+    FindObject *fo = static_cast<FindObject *>(data);
 
-  size_t plen = prefix.length();
+    if (!fo->object)
+      fo->object = tree->find(*fo->path);
+  }
+};
+
+ObjectAdaptor *ObjectAdaptor::from_path(const Path &path)
+{
+  FindObject fo = { &path, NULL };
+
+  ObjectTree::each(FindObject::tree, &fo);
+
+  return fo.object;
+}
+
+struct FindPrefixed
+{
+  const std::string *prefix;
+  ObjectAdaptorPList *objects;
+  ObjectPathList *nodes;
 
-  while (ati != _adaptor_table.end())
+  static void tree(const ObjectTree *tree, void *data)
   {
-    if (!strncmp(ati->second->path().c_str(), prefix.c_str(), plen))
-    {
-      std::string p = ati->second->path().substr(plen);
-      p = p.substr(0, p.find('/'));
-      ali.push_back(p);
-    }
-    ++ati;
+    FindPrefixed *fp = static_cast<FindPrefixed *>(data);
+
+    tree->prefixed(*fp->prefix, fp->objects, fp->nodes);
   }
+};
+
+ObjectAdaptorPList ObjectAdaptor::from_path_prefix(const std::string &prefix)
+{
+  ObjectAdaptorPList ali;
+  FindPrefixed fp = { &prefix, &ali, NULL };
+
+  ObjectTree::each(FindPrefixed::tree, &fp);
+
+  return ali;
+}
+
+ObjectPathList ObjectAdaptor::child_nodes_from_prefix(const std::string &prefix)
+{
+  ObjectPathList ali;
+  FindPrefixed fp = { &prefix, NULL, &ali };
+
+  ObjectTree::each(FindPrefixed::tree, &fp);
 
+  // each connection's nodes are sorted and unique already
   ali.sort();
   ali.unique();
 
   return ali;
 }
 
+static std::string _call_args(const CallMessage &call)
+{
+  std::string args(call.signature());
+
+  args += '\0';
+  args += call.body();
+
+  return args;
+}
+
+static std::string _caller_match(const std::string &sender)
+{
+  return "type='signal',sender='" DBUS_SERVICE_DBUS "',path='" DBUS_PATH_DBUS
+         "',interface='" DBUS_INTERFACE_DBUS "',member='NameOwnerChanged',arg0='"
+         + sender + "'";
+}
+
+static void _unwatch_caller(DBusConnection *conn, const std::string &sender)
+{
+  MatchRules *rules = MatchRules::of(conn);
+
+  if (rules)
+    rules->remove(_caller_match(sender));
+}
+
 ObjectAdaptor::ObjectAdaptor(Connection &conn, const Path &path)
-  : Object(conn, path, conn.unique_name())
+  : Object(conn, path, conn.unique_name()), _call_budget(-1), _subtree(NULL),
+    _announced(false), _introspection_stamp(0), _introspection_interfaces(0)
 {
   register_obj();
 }
 
+ObjectAdaptor::ObjectAdaptor(SubtreeAdaptor &subtree, const Path &path)
+  : Object(subtree.conn(), path, subtree.conn().unique_name()), _call_budget(-1), _subtree(&subtree),
+    _announced(false), _introspection_stamp(0), _introspection_interfaces(0)
+{
+}
+
 ObjectAdaptor::~ObjectAdaptor()
 {
   unregister_obj(false);
+
+  for (CallerTable::iterator ci = _callers.begin(); ci != _callers.end(); ++ci)
+    _unwatch_caller(conn()._pvt->conn, ci->first);
+
+  if (!_caller_filter.empty())
+    conn().remove_filter(_caller_filter);
+
+  // the tags still belong to whoever deferred the calls
+  std::vector<Continuation *> pending;
+  _continuations.values(pending);
+
+  for (std::vector<Continuation *>::iterator ci = pending.begin(); ci != pending.end(); ++ci)
+    delete_continuation(*ci);
 }
 
 void ObjectAdaptor::register_obj()
 {
+  if (_subtree)
+    return;
+
   debug_log("registering local object %s", path().c_str());
 
+  ObjectTree *tree = ObjectTree::of(conn()._pvt->conn, true);
+
+  if (!tree)
+    throw ErrorNoMemory("unable to register object path");
+
   if (!dbus_connection_register_object_path(conn()._pvt->conn, path().c_str(), &_vtable, this))
   {
     throw ErrorNoMemory("unable to register object path");
   }
 
-  _adaptor_table[path()] = this;
+  tree->insert(path(), this);
 }
 
 void ObjectAdaptor::unregister_obj(bool)
 {
-  _adaptor_table.erase(path());
+  if (_subtree)
+    return;
+
+  if (_announced)
+    ObjectManagerAdaptor::unregistered(*this);
+
+  ObjectTree *tree = ObjectTree::of(conn()._pvt->conn, false);
+
+  if (tree)
+    tree->erase(path(), this);
 
   debug_log("unregistering local object %s", path().c_str());
 
   dbus_connection_unregister_object_path(conn()._pvt->conn, path().c_str());
 }
 
+void ObjectAdaptor::announce()
+{
+  if (_subtree)
+    return;
+
+  _announced = true;
+
+  ObjectManagerAdaptor::registered(*this);
+}
+
 void ObjectAdaptor::_emit_signal(SignalMessage &sig)
 {
   sig.path(path().c_str());
@@ -204,6 +508,7 @@ bool ObjectAdaptor::handle_message(const Message &msg)
     const CallMessage &cmsg = reinterpret_cast<const CallMessage &>(msg);
     const char *member      = cmsg.member();
     const char *interface   = cmsg.interface();
+    const char *sender      = cmsg.sender();
     InterfaceAdaptor *ii    = NULL;
 
     debug_log(" invoking method %s.%s", interface, member);
@@ -215,21 +520,121 @@ bool ObjectAdaptor::handle_message(const Message &msg)
 
     if (ii)
     {
+      bool cached = ii->is_cached(member);
+      bool single_flight = ii->is_single_flight(member);
+      unsigned long generation = 0;
+      std::string args;
+
+      if (cached || single_flight)
+        args = _call_args(cmsg);
+
+      if (cached)
+      {
+        Message reply;
+
+        if (ii->cached_reply(member, args, reply))
+        {
+          debug_log(" answering from the cache");
+
+          reply.reply_serial(cmsg.serial());
+          reply.destination(sender);
+          conn().send(reply);
+          return true;
+        }
+
+        // a reply computed across an invalidation is stale
+        generation = ii->cache_generation();
+      }
+
+      if (!_admission.admit(interface, member, sender))
+      {
+        ErrorMessage em(cmsg, _admission.error_name(interface, member), "Too many calls in progress");
+        conn().send(em);
+        return true;
+      }
+
+      std::string flight;
+
+      if (single_flight)
+      {
+        flight = interface;
+        flight += '\0';
+        flight += member;
+        flight += '\0';
+        flight += args;
+
+        FlightTable::iterator fi = _flights.find(flight);
+
+        if (fi != _flights.end())
+        {
+          debug_log(" joining pending call #%d", fi->second->_call.serial());
+
+          fi->second->_waiters.push_back(cmsg);
+          watch_caller(sender);
+          return true;
+        }
+      }
+
+      CallContext ctx(cmsg);
+      Message ret;
+
+      if (_call_budget >= 0)
+        ctx.expires_in(_call_budget);
+
+      // handlers either return, or settle the call through ctx, or throw
       try
       {
-        Message ret = ii->dispatch_method(cmsg);
-        conn().send(ret);
+        ret = ii->dispatch_method(cmsg);
       }
       catch (Error &e)
       {
-        ErrorMessage em(cmsg, e.name(), e.message());
-        conn().send(em);
+        ctx.fail(e);
       }
       catch (ReturnLaterError &rle)
       {
-        _continuations[rle.tag] = new Continuation(conn(), cmsg, rle.tag);
+        ctx.defer(rle.tag);
+      }
+
+      if (!ctx.deferred())
+      {
+        if (ctx.failed())
+        {
+          ErrorMessage em(cmsg, ctx.error_name(), ctx.error_message());
+          conn().send(em);
+        }
+        else
+        {
+          conn().send(ret);
+
+          if (cached && !ret.is_error())
+            ii->cache_reply(member, args, ret, generation);
+        }
+
+        _admission.release(interface, member, sender);
+      }
+      else
+      {
+        const Tag *tag = ctx.deferred();
+        Continuation *c = new_continuation(cmsg, tag);
+
+        _continuations.insert(tag, c);
+        watch_caller(sender);
+
+        if (!flight.empty())
+        {
+          c->_flight = flight;
+          _flights[flight] = c;
+        }
+
+        if (cached)
+        {
+          c->_cache = ii;
+          c->_cache_args = args;
+          c->_cache_generation = generation;
+        }
+
         // Let tag author know tag is registered
-        rle.tag->tag_registered();
+        tag->tag_registered();
       }
       return true;
     }
@@ -245,12 +650,102 @@ bool ObjectAdaptor::handle_message(const Message &msg)
   }
 }
 
+Message ObjectAdaptor::dispatch_local(CallMessage &call, const std::string &interface, const std::string &member)
+{
+  InterfaceAdaptor *ii = find_interface(interface);
+
+  // only known names reach the message, libdbus rejects invalid ones
+  if (!ii)
+    return ErrorMessage(call, DBUS_ERROR_UNKNOWN_METHOD, ("No such interface " + interface).c_str());
+
+  if (!ii->find_method(member.c_str()) && !ii->find_method_entry(member.c_str()))
+    return ErrorMessage(call, DBUS_ERROR_UNKNOWN_METHOD, member.c_str());
+
+  // its reply would come after the batch's, don't even start it
+  if (ii->is_deferred(member.c_str()))
+    return ErrorMessage(call, DBUS_ERROR_NOT_SUPPORTED, "Deferred methods can't be batched");
+
+  call.path(path().c_str());
+  call.interface(interface.c_str());
+  call.member(member.c_str());
+
+  CallContext *outer = CallContext::current();
+  CallContext ctx(call);
+  Message ret;
+
+  ctx.batched(true);
+
+  // the sub-call gets what is left of the batch's deadline, or its own
+  if (outer)
+    ctx.expiration(outer->expiration());
+
+  if (_call_budget >= 0)
+  {
+    double e = Deadline::now() + _call_budget;
+
+    if (!ctx.expiration() || e < ctx.expiration())
+      ctx.expiration(e);
+  }
+
+  if (ctx.expired())
+    return ErrorMessage(call, DBUS_ERROR_TIMEOUT, "Deadline exceeded");
+
+  const char *sender = call.sender();
+
+  // each sub-call counts as a call of its own
+  if (!_admission.admit(interface.c_str(), member.c_str(), sender))
+    return ErrorMessage(call, _admission.error_name(interface.c_str(), member.c_str()), "Too many calls in progress");
+
+  try
+  {
+    ret = ii->dispatch_method(call);
+  }
+  catch (Error &e)
+  {
+    ctx.fail(e);
+  }
+  catch (ReturnLaterError &rle)
+  {
+    ctx.defer(rle.tag);
+  }
+
+  _admission.release(interface.c_str(), member.c_str(), sender);
+
+  // a handler which deferred anyway is told its reply is lost
+  if (ctx.deferred())
+  {
+    ctx.deferred()->cancel();
+
+    return ErrorMessage(call, DBUS_ERROR_NOT_SUPPORTED, "Deferred methods can't be batched");
+  }
+
+  if (ctx.failed())
+    return ErrorMessage(call, ctx.error_name(), ctx.error_message());
+
+  return ret;
+}
+
+void ObjectAdaptor::call_budget(int timeout)
+{
+  _call_budget = timeout < 0 ? -1 : timeout;
+}
+
 void ObjectAdaptor::return_later(const Tag *tag)
 {
   ReturnLaterError rle = { tag };
   throw rle;
 }
 
+void ObjectAdaptor::defer_return(const Tag *tag)
+{
+  CallContext *ctx = CallContext::current();
+
+  if (!ctx)
+    return_later(tag);
+
+  ctx->defer(tag);
+}
+
 const CallMessage* ObjectAdaptor::find_continuation_call_message(const Tag *tag) {
     ObjectAdaptor::Continuation *my_cont = find_continuation(tag);
     if (!my_cont) {
@@ -263,6 +758,19 @@ void ObjectAdaptor::return_now(const Tag *tag, Message _return) {
     ObjectAdaptor::Continuation *my_cont = find_continuation(tag);
     if (!my_cont) {
         debug_log("Unable to find continuation for tag %p");
+    } else if (_return.type() == DBUS_MESSAGE_TYPE_METHOD_RETURN
+               || _return.type() == DBUS_MESSAGE_TYPE_ERROR) {
+        // send the caller's message as is, only addressing it if needed
+        const CallMessage &call = my_cont->_call;
+        const char *sender = call.sender();
+        const char *destination = _return.destination();
+
+        if (_return.reply_serial() != call.serial())
+            _return.reply_serial(call.serial());
+        if (sender && (!destination || strcmp(destination, sender)))
+            _return.destination(sender);
+
+        complete(my_cont, _return);
     } else {
         _return.reader().copy_data(my_cont->writer());
         return_now(my_cont);
@@ -271,37 +779,233 @@ void ObjectAdaptor::return_now(const Tag *tag, Message _return) {
 
 void ObjectAdaptor::return_now(Continuation *ret)
 {
-  ret->_conn.send(ret->_return);
+  ret->writer();
 
-  ContinuationMap::iterator di = _continuations.find(ret->_tag);
+  complete(ret, *ret->_return);
+}
 
-  delete di->second;
+void ObjectAdaptor::return_error(Continuation *ret, const Error error)
+{
+  ErrorMessage em(ret->_call, error.name(), error.message());
 
-  _continuations.erase(di);
+  complete(ret, em);
 }
 
-void ObjectAdaptor::return_error(Continuation *ret, const Error error)
+void ObjectAdaptor::complete(Continuation *ret, Message &reply)
 {
-  ret->_conn.send(ErrorMessage(ret->_call, error.name(), error.message()));
+  if (ret->_cache && !reply.is_error())
+    ret->_cache->cache_reply(ret->_call.member(), ret->_cache_args, reply, ret->_cache_generation);
+
+  if (!ret->_flight.empty())
+  {
+    _flights.erase(ret->_flight);
+
+    // copies have no serial yet, each gets its own when sent
+    for (std::vector<CallMessage>::iterator wi = ret->_waiters.begin(); wi != ret->_waiters.end(); ++wi)
+    {
+      Message r = reply.copy();
+
+      r.reply_serial(wi->serial());
+      r.destination(wi->sender());
+      ret->_conn.send(r);
+
+      _admission.release(wi->interface(), wi->member(), wi->sender());
+      unwatch_caller(wi->sender());
+    }
+  }
+
+  if (!ret->_orphaned)
+  {
+    ret->_conn.send(reply);
 
-  ContinuationMap::iterator di = _continuations.find(ret->_tag);
+    _admission.release(ret->_call.interface(), ret->_call.member(), ret->_call.sender());
+    unwatch_caller(ret->_call.sender());
+  }
 
-  delete di->second;
+  _continuations.erase(ret->_tag);
 
-  _continuations.erase(di);
+  delete_continuation(ret);
 }
 
 ObjectAdaptor::Continuation *ObjectAdaptor::find_continuation(const Tag *tag)
 {
-  ContinuationMap::iterator di = _continuations.find(tag);
+  return _continuations.find(tag);
+}
+
+ObjectAdaptor::Continuation *ObjectAdaptor::new_continuation(const CallMessage &call, const Tag *tag)
+{
+  void *p = _continuation_pool.allocate();
+
+  return new (p) Continuation(conn(), call, tag);
+}
+
+void ObjectAdaptor::delete_continuation(Continuation *c)
+{
+  c->~Continuation();
+
+  _continuation_pool.release(c);
+}
+
+void ObjectAdaptor::watch_caller(const char *sender)
+{
+  // peer to peer connections have no names to watch
+  if (!sender)
+    return;
+
+  if (++_callers[sender] > 1)
+    return;
+
+  if (_caller_filter.empty())
+  {
+    _caller_filter = new Callback<ObjectAdaptor, bool, const Message &>(this, &ObjectAdaptor::caller_filter);
+    conn().add_filter(_caller_filter);
+  }
+
+  // shared with the other objects watching the same caller
+  MatchRules *rules = MatchRules::of(conn()._pvt->conn);
+
+  if (rules)
+    rules->add(_caller_match(sender));
+}
+
+void ObjectAdaptor::unwatch_caller(const char *sender)
+{
+  if (!sender)
+    return;
+
+  CallerTable::iterator ci = _callers.find(sender);
+
+  if (ci == _callers.end() || --ci->second > 0)
+    return;
+
+  _unwatch_caller(conn()._pvt->conn, ci->first);
+
+  _callers.erase(ci);
+}
+
+bool ObjectAdaptor::caller_filter(const Message &msg)
+{
+  if (_callers.empty() || !msg.is_signal(DBUS_INTERFACE_DBUS, "NameOwnerChanged"))
+    return false;
 
-  return di != _continuations.end() ? di->second : NULL;
+  const char *from = msg.sender();
+
+  if (!from || strcmp(from, DBUS_SERVICE_DBUS))
+    return false;
+
+  std::string name, old_owner, new_owner;
+  MessageIter ri = msg.reader();
+
+  ri >> name >> old_owner >> new_owner;
+
+  if (new_owner.empty() && _callers.find(name) != _callers.end())
+  {
+    debug_log("%s left the bus, cancelling its calls to %s", name.c_str(), path().c_str());
+
+    caller_vanished(name);
+  }
+
+  // other filters may be interested as well
+  return false;
+}
+
+void ObjectAdaptor::caller_vanished(const std::string &sender)
+{
+  FlightTable::iterator fi = _flights.begin();
+
+  while (fi != _flights.end())
+  {
+    Continuation *c = fi->second;
+    std::vector<CallMessage>::iterator wi = c->_waiters.begin();
+
+    while (wi != c->_waiters.end())
+    {
+      const char *s = wi->sender();
+
+      if (s && sender == s)
+      {
+        _admission.release(wi->interface(), wi->member(), s);
+        wi = c->_waiters.erase(wi);
+      }
+      else
+      {
+        ++wi;
+      }
+    }
+
+    // nobody is interested in the result anymore
+    if (c->_orphaned && c->_waiters.empty())
+    {
+      _continuations.erase(c->_tag);
+      _flights.erase(fi++);
+
+      c->_tag->cancel();
+      delete_continuation(c);
+    }
+    else
+    {
+      ++fi;
+    }
+  }
+
+  std::vector<Continuation *> pending;
+  _continuations.values(pending);
+
+  for (std::vector<Continuation *>::iterator di = pending.begin(); di != pending.end(); ++di)
+  {
+    Continuation *c = *di;
+    const char *s = c->_call.sender();
+
+    if (!s || sender != s || c->_orphaned)
+      continue;
+
+    _admission.release(c->_call.interface(), c->_call.member(), s);
+
+    // the coalesced callers still want the result
+    if (!c->_waiters.empty())
+    {
+      c->_orphaned = true;
+      continue;
+    }
+
+    _continuations.erase(c->_tag);
+
+    if (!c->_flight.empty())
+      _flights.erase(c->_flight);
+
+    c->_tag->cancel();
+    delete_continuation(c);
+  }
+
+  CallerTable::iterator ci = _callers.find(sender);
+
+  if (ci != _callers.end())
+  {
+    _unwatch_caller(conn()._pvt->conn, sender);
+
+    _callers.erase(ci);
+  }
 }
 
 ObjectAdaptor::Continuation::Continuation(Connection &conn, const CallMessage &call, const Tag *tag)
-  : _conn(conn), _call(call), _return(_call), _tag(tag)
+  : _conn(conn), _call(call), _return(NULL), _tag(tag), _orphaned(false),
+    _cache(NULL), _cache_generation(0)
+{
+}
+
+ObjectAdaptor::Continuation::~Continuation()
+{
+  delete _return;
+}
+
+MessageIter &ObjectAdaptor::Continuation::writer()
 {
-  _writer = _return.writer(); //todo: verify
+  if (!_return)
+  {
+    _return = new ReturnMessage(_call);
+    _writer = _return->writer();
+  }
+  return _writer;
 }
 
 /*
@@ -322,31 +1026,154 @@ void ObjectProxy::register_obj()
 {
   debug_log("registering remote object %s", path().c_str());
 
-  _filtered = new Callback<ObjectProxy, bool, const Message &>(this, &ObjectProxy::handle_message);
+  SignalRouter *router = SignalRouter::of(conn()._pvt->conn);
+  MatchRules *rules = MatchRules::of(conn()._pvt->conn);
 
-  conn().add_filter(_filtered);
+  if (!router || !rules)
+    throw ErrorNoMemory("unable to route signals");
 
   InterfaceProxyTable::const_iterator ii = _interfaces.begin();
   while (ii != _interfaces.end())
   {
-    std::string im = "type='signal',interface='" + ii->first + "',path='" + path() + "'";
-    conn().add_match(im.c_str());
+    router->add(path(), ii->first, this);
     ++ii;
   }
+
+  subscriptions(_rules, _below);
+
+  for (std::vector<std::string>::const_iterator ri = _rules.begin(); ri != _rules.end(); ++ri)
+    rules->add(*ri);
+
+  for (std::vector<std::string>::const_iterator bi = _below.begin(); bi != _below.end(); ++bi)
+    router->add(path(), *bi, this, true);
 }
 
 void ObjectProxy::unregister_obj(bool throw_on_error)
 {
   debug_log("unregistering remote object %s", path().c_str());
 
-  InterfaceProxyTable::const_iterator ii = _interfaces.begin();
-  while (ii != _interfaces.end())
+  SignalRouter *router = SignalRouter::of(conn()._pvt->conn);
+  MatchRules *rules = MatchRules::of(conn()._pvt->conn);
+
+  if (router)
   {
-    std::string im = "type='signal',interface='" + ii->first + "',path='" + path() + "'";
-    conn().remove_match(im.c_str(), throw_on_error);
-    ++ii;
+    InterfaceProxyTable::const_iterator ii = _interfaces.begin();
+    while (ii != _interfaces.end())
+    {
+      router->remove(path(), ii->first, this);
+      ++ii;
+    }
+
+    for (std::vector<std::string>::const_iterator bi = _below.begin(); bi != _below.end(); ++bi)
+      router->remove(path(), *bi, this, true);
+  }
+
+  if (rules)
+  {
+    for (std::vector<std::string>::const_iterator ri = _rules.begin(); ri != _rules.end(); ++ri)
+      rules->remove(*ri);
   }
-  conn().remove_filter(_filtered);
+
+  _rules.clear();
+  _below.clear();
+}
+
+void ObjectProxy::subscriptions(std::vector<std::string> &rules, std::vector<std::string> &below) const
+{
+  for (InterfaceProxyTable::const_iterator ii = _interfaces.begin(); ii != _interfaces.end(); ++ii)
+  {
+    const InterfaceProxy *iface = ii->second;
+    const SignalTable &signals = iface->_signals;
+    bool all = iface->_matches.empty();
+    bool any = false;
+
+    for (SignalTable::const_iterator si = signals.begin(); si != signals.end(); ++si)
+    {
+      if (si->second.empty())
+        all = false;
+      else
+        any = true;
+    }
+
+    // nothing to ask for
+    if (!any)
+      continue;
+
+    std::string rule = "type='signal',interface='" + ii->first + "'";
+
+    // one rule lets through the same signals as one per member
+    if (all)
+    {
+      rules.push_back(rule + ",path='" + path() + "'");
+      continue;
+    }
+
+    bool subtree = false;
+
+    for (SignalTable::const_iterator si = signals.begin(); si != signals.end(); ++si)
+    {
+      if (si->second.empty())
+        continue;
+
+      const SignalMatch *match = iface->find_match(si->first.c_str());
+      std::string member = rule + ",member='" + si->first + "'";
+
+      if (match && match->below())
+      {
+        member += ",path_namespace='" + path() + "'";
+        subtree = true;
+      }
+      else
+      {
+        member += ",path='" + path() + "'";
+      }
+
+      if (match)
+        member += match->keys();
+
+      rules.push_back(member);
+    }
+
+    if (subtree)
+      below.push_back(ii->first);
+  }
+}
+
+void ObjectProxy::_resubscribe()
+{
+  SignalRouter *router = SignalRouter::of(conn()._pvt->conn);
+  MatchRules *rules = MatchRules::of(conn()._pvt->conn);
+
+  if (!router || !rules)
+    throw ErrorNoMemory("unable to route signals");
+
+  std::vector<std::string> new_rules;
+  std::vector<std::string> new_below;
+
+  subscriptions(new_rules, new_below);
+
+  // the new rules first, so those kept never run out of users
+  for (std::vector<std::string>::const_iterator ri = new_rules.begin(); ri != new_rules.end(); ++ri)
+    rules->add(*ri);
+
+  for (std::vector<std::string>::const_iterator ri = _rules.begin(); ri != _rules.end(); ++ri)
+    rules->remove(*ri);
+
+  // a signal may arrive meanwhile, don't route it twice
+  for (std::vector<std::string>::const_iterator bi = new_below.begin(); bi != new_below.end(); ++bi)
+  {
+    if (std::find(_below.begin(), _below.end(), *bi) == _below.end())
+      router->add(path(), *bi, this, true);
+  }
+
+  for (std::vector<std::string>::const_iterator bi = _below.begin(); bi != _below.end(); ++bi)
+  {
+    if (std::find(new_below.begin(), new_below.end(), *bi) == new_below.end())
+      router->remove(path(), *bi, this, true);
+  }
+
+  _rules.swap(new_rules);
+  _below.swap(new_below);
 }
 
 Message ObjectProxy::_invoke_method(CallMessage &call)
@@ -357,7 +1184,7 @@ Message ObjectProxy::_invoke_method(CallMessage &call)
   if (call.destination() == NULL)
     call.destination(service().c_str());
 
-  return conn().send_blocking(call, get_timeout());
+  return conn().send_blocking(call, Deadline::bound(get_timeout()));
 }
 
 bool ObjectProxy::_invoke_method_noreply(CallMessage &call)
@@ -371,6 +1198,18 @@ bool ObjectProxy::_invoke_method_noreply(CallMessage &call)
   return conn().send(call);
 }
 
+PendingCall ObjectProxy::_invoke_method_async(CallMessage &call, PendingCall::Handler handler, void *object,
+                                              void *data)
+{
+  if (call.path() == NULL)
+    call.path(path().c_str());
+
+  if (call.destination() == NULL)
+    call.destination(service().c_str());
+
+  return conn().send_async(call, Deadline::bound(get_timeout()), handler, object, data);
+}
+
 bool ObjectProxy::handle_message(const Message &msg)
 {
   switch (msg.type())
@@ -385,7 +1224,8 @@ bool ObjectProxy::handle_message(const Message &msg)
 
     debug_log("ObjectProxy::handle_message target path %s Signal: objpath %s interface %s member %s",
               path().c_str(), objpath, interface, member);
-    if (objpath != path()) return false;
+    // those of the objects below, if asked for, see SignalMatch::path_namespace()
+    if (objpath != path() && _below.empty()) return false;
 
     debug_log("filtered signal %s(in %s) from %s to object %s",
               member, interface, msg.sender(), objpath);
@@ -26,7 +26,9 @@
 #endif
 
 #include <dbus-c++/pendingcall.h>
+#include <dbus-c++/tag-table.h>
 
+#include <pthread.h>
 #include <dbus/dbus.h>
 
 #include "internalerror.h"
@@ -35,38 +37,119 @@
 
 using namespace DBus;
 
-PendingCall::Private::Private(DBusPendingCall *dpc)
-  : call(dpc), dataslot(-1)
+static dbus_int32_t _private_slot = -1;
+static pthread_once_t _private_slot_once = PTHREAD_ONCE_INIT;
+
+static void _private_slot_allocate()
 {
-  if (!dbus_pending_call_allocate_data_slot(&dataslot))
-  {
-    throw ErrorNoMemory("Unable to allocate data slot");
-  }
+  // one slot for the whole process, never freed
+  dbus_pending_call_allocate_data_slot(&_private_slot);
 }
 
-PendingCall::Private::~Private()
+static pthread_mutex_t _private_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static SlabPool<PendingCall::Private> *_private_pool = NULL;
+
+void *PendingCall::Private::operator new(size_t)
+{
+  pthread_mutex_lock(&_private_pool_mutex);
+
+  // never destroyed, calls may be finalized until the very end
+  if (!_private_pool)
+    _private_pool = new SlabPool<PendingCall::Private>;
+
+  void *p = _private_pool->allocate();
+
+  pthread_mutex_unlock(&_private_pool_mutex);
+  return p;
+}
+
+void PendingCall::Private::operator delete(void *p)
+{
+  pthread_mutex_lock(&_private_pool_mutex);
+  _private_pool->release(p);
+  pthread_mutex_unlock(&_private_pool_mutex);
+}
+
+PendingCall::Private::Private(DBusPendingCall *dpc)
+  : call(dpc), handler(NULL), object(NULL), data(NULL), notified(0), delivered(0), handled(0)
 {
-  if (dataslot != -1)
-  {
-    dbus_pending_call_allocate_data_slot(&dataslot);
-  }
 }
 
 void PendingCall::Private::notify_stub(DBusPendingCall *dpc, void *data)
 {
   PendingCall::Private *pvt = static_cast<PendingCall::Private *>(data);
 
-  PendingCall pc(pvt);
-  pvt->slot(pc);
+  // the constructor may have seen the call completed already
+  if (!__sync_bool_compare_and_swap(&pvt->notified, 0, 1))
+    return;
+
+  // may drop the last reference, pvt must not be used afterwards
+  PendingCall pc(pvt, true);
+
+  pvt->delivered = 1;
+  __sync_synchronize();
+
+  // pairs with PendingCall::handler()
+  if (pvt->handler)
+  {
+    if (__sync_bool_compare_and_swap(&pvt->handled, 0, 1))
+      pvt->handler(pc, pvt->object);
+  }
+  else
+  {
+    pvt->slot(pc);
+  }
+}
+
+void PendingCall::Private::free_stub(void *data)
+{
+  delete static_cast<PendingCall::Private *>(data);
 }
 
 PendingCall::PendingCall(PendingCall::Private *p)
   : _pvt(p)
 {
+  if (!_pvt->call)
+  {
+    delete _pvt;
+    throw ErrorDisconnected("Connection is closed");
+  }
+
+  pthread_once(&_private_slot_once, _private_slot_allocate);
+
+  if (_private_slot == -1
+      || !dbus_pending_call_set_data(_pvt->call, _private_slot, p, Private::free_stub))
+  {
+    DBusPendingCall *call = _pvt->call;
+
+    delete _pvt;
+    dbus_pending_call_cancel(call);
+    dbus_pending_call_unref(call);
+    throw ErrorNoMemory("Unable to initialize pending call");
+  }
+
+  // keeps the call alive until the notification, even if the caller
+  // dropped every copy of it
+  dbus_pending_call_ref(_pvt->call);
+
   if (!dbus_pending_call_set_notify(_pvt->call, Private::notify_stub, p, NULL))
   {
+    DBusPendingCall *call = _pvt->call;
+
+    dbus_pending_call_cancel(call);
+    dbus_pending_call_unref(call);
+    dbus_pending_call_unref(call);
     throw ErrorNoMemory("Unable to initialize pending call");
   }
+
+  // a reply dispatched before the notification was set gets none
+  if (dbus_pending_call_get_completed(_pvt->call))
+    Private::notify_stub(_pvt->call, _pvt);
+}
+
+PendingCall::PendingCall(PendingCall::Private *p, bool)
+  : _pvt(p)
+{
 }
 
 PendingCall::PendingCall(const PendingCall &c)
@@ -84,9 +167,9 @@ PendingCall &PendingCall::operator = (const PendingCall &c)
 {
   if (&c != this)
   {
+    dbus_pending_call_ref(c._pvt->call);
     dbus_pending_call_unref(_pvt->call);
     _pvt = c._pvt;
-    dbus_pending_call_ref(_pvt->call);
   }
   return *this;
 }
@@ -99,6 +182,10 @@ bool PendingCall::completed()
 void PendingCall::cancel()
 {
   dbus_pending_call_cancel(_pvt->call);
+
+  // there will be no notification, drop the reference kept for it
+  if (__sync_bool_compare_and_swap(&_pvt->notified, 0, 1))
+    dbus_pending_call_unref(_pvt->call);
 }
 
 void PendingCall::block()
@@ -108,15 +195,12 @@ void PendingCall::block()
 
 void PendingCall::data(void *p)
 {
-  if (!dbus_pending_call_set_data(_pvt->call, _pvt->dataslot, p, NULL))
-  {
-    throw ErrorNoMemory("Unable to initialize data slot");
-  }
+  _pvt->data = p;
 }
 
 void *PendingCall::data()
 {
-  return dbus_pending_call_get_data(_pvt->call, _pvt->dataslot);
+  return _pvt->data;
 }
 
 Slot<void, PendingCall &>& PendingCall::slot()
@@ -124,6 +208,18 @@ Slot<void, PendingCall &>& PendingCall::slot()
   return _pvt->slot;
 }
 
+void PendingCall::handler(Handler h, void *object)
+{
+  _pvt->object = object;
+  __sync_synchronize();
+  _pvt->handler = h;
+  __sync_synchronize();
+
+  // the completion went by without a handler to call
+  if (h && _pvt->delivered && __sync_bool_compare_and_swap(&_pvt->handled, 0, 1))
+    h(*this, object);
+}
+
 Message PendingCall::steal_reply()
 {
   DBusMessage *dmsg = dbus_pending_call_steal_reply(_pvt->call);
@@ -137,6 +233,7 @@ Message PendingCall::steal_reply()
       throw ErrorNoReply("Call not complete");
   }
 
-  return Message(new Message::Private(dmsg));
+  // the reference is stolen too
+  return Message(new Message::Private(dmsg), false);
 }
 
@@ -30,24 +30,42 @@
 #endif
 
 #include <dbus-c++/pendingcall.h>
-#include <dbus-c++/refptr_impl.h>
 
+#include <cstddef>
 #include <dbus/dbus.h>
 
 namespace DBus
 {
 
+/*	attached to the DBusPendingCall, which frees it when finalized
+*/
 struct DXXAPILOCAL PendingCall::Private
 {
   DBusPendingCall *call;
-  int dataslot;
   Slot<void, PendingCall &> slot;
+  Handler handler;
+  void *object;
+  void *data;
 
-  Private(DBusPendingCall *);
+  // set by whoever delivers the completion, see notify_stub(); until
+  // then the call holds a reference to itself
+  volatile int notified;
+
+  // set once the completion was dispatched, and by whoever calls the
+  // handler: a handler set late is still called exactly once
+  volatile int delivered;
+  volatile int handled;
 
-  ~Private();
+  Private(DBusPendingCall *);
 
   static void notify_stub(DBusPendingCall *dpc, void *data);
+
+  static void free_stub(void *data);
+
+  // from a process wide pool
+  static void *operator new(size_t);
+
+  static void operator delete(void *);
 };
 
 } /* namespace DBus */
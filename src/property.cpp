@@ -36,10 +36,7 @@ static const char *properties_name = "org.freedesktop.DBus.Properties";
 
 PropertiesAdaptor::PropertiesAdaptor()
   : InterfaceAdaptor(properties_name)
-{
-  register_method(PropertiesAdaptor, Get, Get);
-  register_method(PropertiesAdaptor, Set, Set);
-}
+{}
 
 Message PropertiesAdaptor::Get(const CallMessage &call)
 {
@@ -57,18 +54,25 @@ Message PropertiesAdaptor::Get(const CallMessage &call)
   if (!interface)
     throw ErrorFailed("requested interface not found");
 
-  Variant *value = interface->get_property(property_name);
+  const Variant *cached = interface->get_property(property_name);
 
-  if (!value)
+  if (!cached)
     throw ErrorFailed("requested property not found");
 
-  on_get_property(*interface, property_name, *value);
+  // a copy, what on_get_property() does to it must not reach the cache
+  Variant value;
+  MessageIter ci = cached->reader();
+  MessageIter vi = value.writer();
+
+  ci.copy_data(vi);
+
+  on_get_property(*interface, property_name, value);
 
   ReturnMessage reply(call);
 
   MessageIter wi = reply.writer();
 
-  wi << *value;
+  wi << value;
   return reply;
 }
 
@@ -96,6 +100,41 @@ Message PropertiesAdaptor::Set(const CallMessage &call)
   return reply;
 }
 
+Message PropertiesAdaptor::GetAll(const CallMessage &call)
+{
+  MessageIter ri = call.reader();
+
+  std::string iface_name;
+
+  ri >> iface_name;
+
+  debug_log("requesting all properties on interface %s", iface_name.c_str());
+
+  InterfaceAdaptor *interface = (InterfaceAdaptor *) find_interface(iface_name);
+
+  if (!interface)
+    throw ErrorFailed("requested interface not found");
+
+  ReturnMessage reply(call);
+
+  MessageIter wi = reply.writer();
+
+  interface->append_properties(wi);
+  return reply;
+}
+
+const MethodEntry *PropertiesAdaptor::method_table() const
+{
+  static const MethodEntry Properties_method_table[] =
+  {
+    { "Get", &method_member< PropertiesAdaptor, &PropertiesAdaptor::Get > },
+    { "Set", &method_member< PropertiesAdaptor, &PropertiesAdaptor::Set > },
+    { "GetAll", &method_member< PropertiesAdaptor, &PropertiesAdaptor::GetAll > },
+    { 0, 0 }
+  };
+  return Properties_method_table;
+}
+
 IntrospectedInterface *PropertiesAdaptor::introspect() const
 {
   static IntrospectedArgument Get_args[] =
@@ -112,10 +151,17 @@ IntrospectedInterface *PropertiesAdaptor::introspect() const
     { "value", "v", true },
     { 0, 0, 0 }
   };
+  static IntrospectedArgument GetAll_args[] =
+  {
+    { "interface_name", "s", true },
+    { "properties", "a{sv}", false },
+    { 0, 0, 0 }
+  };
   static IntrospectedMethod Properties_methods[] =
   {
     { "Get", Get_args },
     { "Set", Set_args },
+    { "GetAll", GetAll_args },
     { 0, 0 }
   };
   static IntrospectedMethod Properties_signals[] =
@@ -13,11 +13,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#include <new>
 
 using namespace DBus;
 
+// written to the response pipe by the worker when it registered a
+// continuation for a caller who already left
+static const Tag sweep_marker;
+
 RequestPiper::RequestPiper(Connection &connection, const std::string&  server_path)
     : ObjectAdaptor(connection, server_path),
+      _fair_quantum(0),
       _dispatcher_thread(pthread_self())
 {
     _create_pipe();
@@ -25,10 +31,25 @@ RequestPiper::RequestPiper(Connection &connection, const std::string&  server_pa
 
 RequestPiper::RequestPiper(Connection &connection, const std::string&  server_path, pthread_t dispatcher_thread)
     : ObjectAdaptor(connection, server_path),
+      _fair_quantum(0),
       _dispatcher_thread(dispatcher_thread) {
     _create_pipe();
 }
 
+RequestPiper::~RequestPiper() {
+    std::vector<PipeContinuation *> pending;
+    _pipe_continuations.values(pending);
+    for (size_t i = 0; i < pending.size(); ++i) {
+        delete pending[i]->orig_tag;
+        delete_pipe_continuation(pending[i]);
+    }
+}
+
+void RequestPiper::delete_pipe_continuation(PipeContinuation *pc) {
+    pc->~PipeContinuation();
+    _pipe_continuation_pool.release(pc);
+}
+
 void RequestPiper::_create_pipe(void) {
     debug_log("Creating pipe()");
     if (0 != pipe(request_pipefd)) {
@@ -46,9 +67,32 @@ Message RequestPiper::_Forwarding_stub(const CallMessage &call) {
     pthread_t this_thread = pthread_self();
 
     debug_log("Forwarding stub called");
+
+    // the worker's reply would come after the batch's, don't queue it
+    CallContext *ctx = CallContext::current();
+    if (ctx && ctx->batched()) {
+        return ErrorMessage(call, DBUS_ERROR_NOT_SUPPORTED, "Deferred methods can't be batched");
+    }
+
+    // Only marshal the call to find out its size when something
+    // accounts for bytes.
+    size_t bytes = 0;
+    if (_fair_quantum || admission().counts_bytes()) {
+        bytes = call.size();
+    }
+
+    // Shed load before queueing anything: the caller is told right
+    // away instead of timing out behind a queue it will never clear.
+    if (!admission().admit_queued(call.interface(), call.member(), call.sender(), bytes)) {
+        return ErrorMessage(call, admission().error_name(call.interface(), call.member()), "Request queue is full");
+    }
+
+    // the worker handles the call under the same deadline
+    double expiration = ctx ? ctx->expiration() : 0;
+
     Tag* later_tag = new Tag();
     request_mutex.lock();
-    request_queue.push_back(std::make_pair(CallMessage(call, false), later_tag));
+    request_queue.push(CallMessage(call, false), later_tag, bytes, _fair_quantum ? bytes : 1, expiration);
     /* can release lock here because it doesn't matter if what is written to pipe
        matches what is in queue.
     */
@@ -62,14 +106,15 @@ Message RequestPiper::_Forwarding_stub(const CallMessage &call) {
 
     request_mutex.unlock();
 
-    /* return_later() throws an exception which records the
-      "continuation" Since this same thread will delete the
-      continuation when the response pipe is written/read by the
-      dispatcher/eventloop thread, is OK if the worker thread is has created the
-      response before the continuation is written.
+    /* defer_return() has the "continuation" recorded once we return.
+      Since this same thread will delete the continuation when the
+      response pipe is written/read by the dispatcher/eventloop thread,
+      is OK if the worker thread is has created the response before the
+      continuation is written.
     */
-    debug_log("Calling return_later for tag %p", later_tag);
-    return_later(later_tag); //this throws exception
+    debug_log("Calling defer_return for tag %p", later_tag);
+    defer_return(later_tag);
+    return Message();
 }
 
 void RequestPiper::do_dispatch(const CallMessage& msg, Message& res, const Tag* tag) {
@@ -102,6 +147,15 @@ Message RequestPiper::_call_orig_method(const CallMessage &msg) {
         Message res = mi->second.call(msg);
         return res;
     }
+
+    // the generated stub, from its adaptor's shared table
+    InterfaceAdaptor *ii = find_interface(msg.interface());
+    const MethodEntry *entry = ii ? ii->find_method_entry(name) : NULL;
+    if (entry)
+    {
+        Message res = entry->call(ii, msg);
+        return res;
+    }
     else
     {
         Message res = ErrorMessage(msg, DBUS_ERROR_UNKNOWN_METHOD, name);
@@ -113,40 +167,86 @@ void RequestPiper::process_pipe_request(void) {
 
         //process the message if possible
         request_mutex.lock();
-        if (!request_queue.size()) {
+        FairRequestQueue::Request *req = request_queue.front();
+        if (!req) {
             debug_log("Request queue unexpectedly empty");
             request_mutex.unlock();
             return;
         }
 
-        const CallMessage msg = CallMessage(request_queue[0].first, false);
-        Tag* tag = request_queue[0].second;
-        request_queue.erase(request_queue.begin());
+        const CallMessage msg = CallMessage(req->call, false);
+        Tag* tag = req->tag;
+        size_t bytes = req->bytes;
+        double expiration = req->expiration;
+        request_queue.pop();
         request_mutex.unlock();
 
+        admission().release_queued(msg.interface(), msg.member(), msg.sender(), bytes);
+
+        // the tag is cancelled if the caller leaves meanwhile
+        CallContext ctx(msg, tag);
+        ctx.expiration(expiration);
+
+        // The caller has given up on a call which expired while
+        // queued, don't spend the worker on it.
+        if (ctx.expired()) {
+            debug_log("Dropping expired call %s", msg.member());
+            ErrorMessage em(msg, DBUS_ERROR_TIMEOUT, "Deadline exceeded");
+            do_dispatch(msg, em, tag);
+            return;
+        }
+
+        Message res;
 
         try {
-            Message res = _call_orig_method(msg);
-            do_dispatch(msg, res, tag);
+            res = _call_orig_method(msg);
         }
         catch (Error &e)
         {
-            ErrorMessage em(msg, e.name(), e.message());
-            do_dispatch(msg, em, tag);
+            ctx.fail(e);
         }
         catch (ReturnLaterError &rle)
         {
-            debug_log("Pushing onto _pipe_continuations, pipe tag tag is %p", rle.tag);
+            ctx.defer(rle.tag);
+        }
+
+        if (ctx.failed()) {
+            ErrorMessage em(msg, ctx.error_name(), ctx.error_message());
+            do_dispatch(msg, em, tag);
+        } else if (!ctx.deferred()) {
+            do_dispatch(msg, res, tag);
+        } else {
+            const Tag *later_tag = ctx.deferred();
+            debug_log("Pushing onto _pipe_continuations, pipe tag tag is %p", later_tag);
             _pipe_continuations_mutex.lock();
-            // use new tag to index, but store old tag in pair
-            _pipe_continuations[rle.tag] = std::pair<CallMessage, const Tag*>(CallMessage(msg, false), tag);
+            // use new tag to index, but store old tag with the call
+            void *p = _pipe_continuation_pool.allocate();
+            _pipe_continuations.insert(later_tag, new (p) PipeContinuation(msg, later_tag, tag));
+            // The caller may have left while the handler was running,
+            // after caller_vanished() swept the continuations. Tags are
+            // only cancelled and freed in the dispatcher thread, so ask
+            // it to sweep again rather than doing it here.
+            bool cancelled = tag->cancelled();
             _pipe_continuations_mutex.unlock();
             // Let tag author know tag is registered
-            rle.tag->tag_registered();
+            later_tag->tag_registered();
+            if (cancelled) {
+                response_n_signal_mutex.lock();
+                const Tag *sweep = &sweep_marker;
+                response_n_signal_pipe->write(&sweep, sizeof(sweep));
+                response_n_signal_mutex.unlock();
+            }
         }
 
 }
 
+void RequestPiper::fair_queue_quantum(size_t bytes) {
+    request_mutex.lock();
+    _fair_quantum = bytes;
+    request_queue.quantum(bytes);
+    request_mutex.unlock();
+}
+
 void RequestPiper::check_pipe_request(void) {
     // Read from and process incoming request on pipe
     char buf_char;
@@ -182,7 +282,10 @@ void RequestPiper::dispatcher_pipe_handler(void *buffer, unsigned int nbyte) {
 
     // we have curTag filled out sufficiently, now we can pop the
     // associated values off of the response_queue
-    if (curTag) {
+    if (curTag == &sweep_marker) {
+        //a continuation was registered for a caller who left
+        cancel_pipe_continuations();
+    } else if (curTag) {
         //it's a response message
         response_n_signal_mutex.lock();
         debug_log("About to unpack dbus response call msg %p size %i tag %p", response_queue[0].first,
@@ -253,10 +356,53 @@ void RequestPiper::_emit_signal(SignalMessage &sig)
     response_n_signal_mutex.unlock();
 }
 
+void RequestPiper::caller_vanished(const std::string &sender) {
+    // Frees the continuations of the forwarded calls, whether queued
+    // or running, and cancels their tags. Calls other callers have
+    // been coalesced with (see InterfaceAdaptor::single_flight()) are
+    // not cancelled and must go on.
+    ObjectAdaptor::caller_vanished(sender);
+
+    std::deque<FairRequestQueue::Request> dropped;
+
+    request_mutex.lock();
+    request_queue.drop(sender, dropped);
+    while (!dropped.empty()) {
+        FairRequestQueue::Request &req = dropped.front();
+        if (req.tag->cancelled()) {
+            debug_log("Dropping queued call %s from %s", req.call.member(), sender.c_str());
+            admission().release_queued(req.call.interface(), req.call.member(), sender.c_str(), req.bytes);
+            delete req.tag;
+        } else {
+            request_queue.push(req.call, req.tag, req.bytes, req.cost, req.expiration);
+        }
+        dropped.pop_front();
+    }
+    request_mutex.unlock();
+
+    cancel_pipe_continuations();
+}
+
+void RequestPiper::cancel_pipe_continuations(void) {
+    _pipe_continuations_mutex.lock();
+    std::vector<PipeContinuation *> pending;
+    _pipe_continuations.values(pending);
+    for (size_t i = 0; i < pending.size(); ++i) {
+        PipeContinuation *pc = pending[i];
+        if (pc->orig_tag->cancelled()) {
+            _pipe_continuations.erase(pc->tag);
+            pc->tag->cancel();
+            delete pc->orig_tag;
+            delete_pipe_continuation(pc);
+        }
+    }
+    _pipe_continuations_mutex.unlock();
+}
+
 void RequestPiper::return_now(const Tag *tag, Message _return) {
     _pipe_continuations_mutex.lock();
-    PipeContinuationMap::iterator pi = _pipe_continuations.find(tag);
-    if (pi == _pipe_continuations.end()) {
+    PipeContinuation *pc = _pipe_continuations.erase(tag);
+    if (!pc) {
         // up call
         debug_log("%s Did not find pipe continuation for %p", __FUNCTION__, tag);
         _pipe_continuations_mutex.unlock();
@@ -265,9 +411,9 @@ void RequestPiper::return_now(const Tag *tag, Message _return) {
 
 
     // Found it, so we send it to the pipe like we usually would
-    const CallMessage call_msg(pi->second.first, false);
-    const Tag* orig_tag  = pi->second.second;
-    _pipe_continuations.erase(pi);
+    const CallMessage call_msg(pc->call, false);
+    const Tag* orig_tag  = pc->orig_tag;
+    delete_pipe_continuation(pc);
     _pipe_continuations_mutex.unlock();
     debug_log("%s Found pipe continuation for tag %p orig_tag %p call_msg %p", __FUNCTION__, tag, orig_tag,
         call_msg);
@@ -276,15 +422,15 @@ void RequestPiper::return_now(const Tag *tag, Message _return) {
 
 const CallMessage* RequestPiper::find_continuation_call_message(const Tag *tag) {
     _pipe_continuations_mutex.lock();
-    PipeContinuationMap::iterator pi = _pipe_continuations.find(tag);
-    if (pi == _pipe_continuations.end()) {
+    PipeContinuation *pc = _pipe_continuations.find(tag);
+    if (!pc) {
         // not in request piper, must be a generic ObjectAdaptor tag.
         _pipe_continuations_mutex.unlock();
         // up call
         return ObjectAdaptor::find_continuation_call_message(tag);
     }
 
-    const CallMessage& res(pi->second.first);
+    const CallMessage& res(pc->call);
     _pipe_continuations_mutex.unlock();
     return &res;
 }
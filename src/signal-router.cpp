@@ -0,0 +1,291 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "signal-router.h"
+
+#include <dbus-c++/debug.h>
+#include "internalerror.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "message_p.h"
+
+using namespace DBus;
+
+static dbus_int32_t _router_slot = -1;
+static pthread_once_t _router_slot_once = PTHREAD_ONCE_INIT;
+
+static void _router_slot_allocate()
+{
+  // one slot for the whole process, never freed
+  dbus_connection_allocate_data_slot(&_router_slot);
+}
+
+static pthread_mutex_t _routers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+bool SignalRouter::RouteLess::operator()(const RouteKey &a, const RouteKey &b) const
+{
+  int c = strcmp(a.first, b.first);
+
+  return c < 0 || (c == 0 && strcmp(a.second, b.second) < 0);
+}
+
+SignalRouter::SignalRouter()
+  : _generation(0), _delivering(NULL)
+{
+  pthread_mutex_init(&_mutex, NULL);
+  pthread_cond_init(&_delivered, NULL);
+}
+
+SignalRouter::~SignalRouter()
+{
+  for (RouteTable::iterator ri = _routes.begin(); ri != _routes.end(); ++ri)
+    delete ri->second;
+
+  for (RouteTable::iterator ri = _below.begin(); ri != _below.end(); ++ri)
+    delete ri->second;
+
+  pthread_cond_destroy(&_delivered);
+  pthread_mutex_destroy(&_mutex);
+}
+
+SignalRouter *SignalRouter::of(DBusConnection *conn)
+{
+  pthread_once(&_router_slot_once, _router_slot_allocate);
+
+  if (_router_slot == -1)
+    return NULL;
+
+  pthread_mutex_lock(&_routers_mutex);
+
+  SignalRouter *router = static_cast<SignalRouter *>(dbus_connection_get_data(conn, _router_slot));
+
+  if (!router)
+  {
+    router = new SignalRouter;
+
+    if (!dbus_connection_add_filter(conn, filter_stub, router, NULL))
+    {
+      delete router;
+      router = NULL;
+    }
+    else if (!dbus_connection_set_data(conn, _router_slot, router, free_stub))
+    {
+      dbus_connection_remove_filter(conn, filter_stub, router);
+      delete router;
+      router = NULL;
+    }
+  }
+
+  pthread_mutex_unlock(&_routers_mutex);
+  return router;
+}
+
+void SignalRouter::free_stub(void *data)
+{
+  delete static_cast<SignalRouter *>(data);
+}
+
+void SignalRouter::add(const std::string &path, const std::string &interface, ObjectProxy *proxy, bool below)
+{
+  pthread_mutex_lock(&_mutex);
+
+  RouteTable &routes = below ? _below : _routes;
+  RouteTable::iterator ri = routes.find(RouteKey(path.c_str(), interface.c_str()));
+  Route *route;
+
+  if (ri != routes.end())
+  {
+    route = ri->second;
+  }
+  else
+  {
+    route = new Route;
+    route->path = path;
+    route->interface = interface;
+
+    routes[RouteKey(route->path.c_str(), route->interface.c_str())] = route;
+  }
+
+  route->proxies.push_back(proxy);
+
+  pthread_mutex_unlock(&_mutex);
+}
+
+void SignalRouter::remove(const std::string &path, const std::string &interface, ObjectProxy *proxy, bool below)
+{
+  pthread_mutex_lock(&_mutex);
+
+  // the proxy is likely about to be destroyed, let its handler finish
+  while (_delivering == proxy && !pthread_equal(_delivering_thread, pthread_self()))
+    pthread_cond_wait(&_delivered, &_mutex);
+
+  RouteTable &routes = below ? _below : _routes;
+  RouteTable::iterator ri = routes.find(RouteKey(path.c_str(), interface.c_str()));
+
+  if (ri != routes.end())
+  {
+    ++_generation;
+
+    ProxyList &proxies = ri->second->proxies;
+    ProxyList::iterator pi = std::find(proxies.begin(), proxies.end(), proxy);
+
+    if (pi != proxies.end())
+      proxies.erase(pi);
+
+    if (proxies.empty())
+    {
+      delete ri->second;
+      routes.erase(ri);
+    }
+  }
+
+  pthread_mutex_unlock(&_mutex);
+}
+
+bool SignalRouter::routed(const RouteTable &routes, const RouteKey &key, ObjectProxy *proxy)
+{
+  RouteTable::const_iterator ri = routes.find(key);
+
+  return ri != routes.end()
+         && std::find(ri->second->proxies.begin(), ri->second->proxies.end(), proxy) != ri->second->proxies.end();
+}
+
+void SignalRouter::targets(const RouteTable &routes, const RouteKey &key, bool below, std::vector<Target> &list)
+{
+  RouteTable::const_iterator ri = routes.find(key);
+
+  if (ri == routes.end())
+    return;
+
+  const ProxyList &proxies = ri->second->proxies;
+
+  for (ProxyList::const_iterator pi = proxies.begin(); pi != proxies.end(); ++pi)
+  {
+    list.push_back(Target());
+    list.back().routes = &routes;
+    list.back().proxy = *pi;
+
+    // the route may be gone by then, the message's path lasts
+    if (below)
+      list.back().path = key.first;
+  }
+}
+
+DBusHandlerResult SignalRouter::filter_stub(DBusConnection *, DBusMessage *dmsg, void *data)
+{
+  SignalRouter *router = static_cast<SignalRouter *>(data);
+
+  if (dbus_message_get_type(dmsg) != DBUS_MESSAGE_TYPE_SIGNAL)
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  const char *path = dbus_message_get_path(dmsg);
+  const char *interface = dbus_message_get_interface(dmsg);
+
+  if (!path || !interface)
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  pthread_mutex_lock(&router->_mutex);
+
+  // the handlers, or other threads, may remove any of them meanwhile
+  std::vector<Target> list;
+
+  targets(router->_routes, RouteKey(path, interface), false, list);
+
+  if (!router->_below.empty())
+  {
+    // the paths above, up to the root; the proxies of the path itself have their route
+    std::string above(path);
+
+    while (above.length() > 1)
+    {
+      size_t slash = above.rfind('/');
+
+      above.erase(slash ? slash : 1);
+      targets(router->_below, RouteKey(above.c_str(), interface), true, list);
+    }
+  }
+
+  unsigned long generation = router->_generation;
+
+  pthread_mutex_unlock(&router->_mutex);
+
+  if (list.empty())
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  debug_log("routing signal %s.%s of %s", interface, dbus_message_get_member(dmsg), path);
+
+  Message msg(new Message::Private(dmsg));
+  bool handled = false;
+
+  for (std::vector<Target>::iterator ti = list.begin(); ti != list.end(); ++ti)
+  {
+    RouteKey key(ti->path.empty() ? path : ti->path.c_str(), interface);
+
+    pthread_mutex_lock(&router->_mutex);
+
+    // nothing was removed since the list was made, or this one is still there
+    if (router->_generation != generation && !routed(*ti->routes, key, ti->proxy))
+    {
+      pthread_mutex_unlock(&router->_mutex);
+      continue;
+    }
+
+    router->_delivering = ti->proxy;
+    router->_delivering_thread = pthread_self();
+
+    pthread_mutex_unlock(&router->_mutex);
+
+    bool done;
+
+    try
+    {
+      done = ti->proxy->handle_message(msg);
+    }
+    catch (...)
+    {
+      router->delivered();
+      throw;
+    }
+
+    router->delivered();
+
+    if (done)
+      handled = true;
+  }
+
+  return handled ? DBUS_HANDLER_RESULT_HANDLED : DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+void SignalRouter::delivered()
+{
+  pthread_mutex_lock(&_mutex);
+
+  _delivering = NULL;
+  pthread_cond_broadcast(&_delivered);
+
+  pthread_mutex_unlock(&_mutex);
+}
@@ -0,0 +1,129 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DBUSXX_SIGNAL_ROUTER_H
+#define __DBUSXX_SIGNAL_ROUTER_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/object.h>
+
+#include <dbus/dbus.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+namespace DBus
+{
+
+/*	Hands the signals a connection receives to the proxies of their path
+	and interface, or of a path above asking for the objects below. One
+	connection filter serves all the proxies: a signal costs one lookup,
+	which builds no string, whatever their number, plus one per segment
+	of its path once a proxy asks for a subtree; it is wrapped in a
+	Message once. Attached to the DBusConnection, as ObjectTree is.
+	Thread safe: the handlers run without the mutex held, so they may
+	add and remove proxies, and a proxy removed by another thread while
+	its handler runs is only removed once the handler returned.
+*/
+class DXXAPILOCAL SignalRouter
+{
+public:
+
+  // the router of `conn', created with its filter on first use
+  static SignalRouter *of(DBusConnection *conn);
+
+  /*	with `below', the signals of the objects below `path' reach the proxy
+  	too
+  */
+  void add(const std::string &path, const std::string &interface, ObjectProxy *proxy, bool below = false);
+
+  void remove(const std::string &path, const std::string &interface, ObjectProxy *proxy, bool below = false);
+
+private:
+
+  typedef std::vector<ObjectProxy *> ProxyList;
+
+  struct Route
+  {
+    std::string path;
+    std::string interface;
+    ProxyList proxies;
+  };
+
+  // path and interface, pointing into the route or the message
+  typedef std::pair<const char *, const char *> RouteKey;
+
+  struct RouteLess
+  {
+    bool operator()(const RouteKey &a, const RouteKey &b) const;
+  };
+
+  typedef std::map<RouteKey, Route *, RouteLess> RouteTable;
+
+  // a proxy a signal is about to be handed to
+  struct Target
+  {
+    const RouteTable *routes;
+    std::string path;		// of the route, if not the signal's
+    ObjectProxy *proxy;
+  };
+
+  SignalRouter();
+
+  ~SignalRouter();
+
+  SignalRouter(const SignalRouter &);
+
+  SignalRouter &operator = (const SignalRouter &);
+
+  // with the mutex held
+  static bool routed(const RouteTable &routes, const RouteKey &key, ObjectProxy *proxy);
+
+  static void targets(const RouteTable &routes, const RouteKey &key, bool below, std::vector<Target> &list);
+
+  static DBusHandlerResult filter_stub(DBusConnection *, DBusMessage *, void *);
+
+  // the handler of the proxy being delivered to returned
+  void delivered();
+
+  static void free_stub(void *);
+
+  RouteTable _routes;
+  RouteTable _below;
+  unsigned long _generation;	// bumped by each removal
+  mutable pthread_mutex_t _mutex;
+
+  // the proxy the filter is handing a signal to, in that thread
+  ObjectProxy *_delivering;
+  pthread_t _delivering_thread;
+  pthread_cond_t _delivered;
+};
+
+} /* namespace DBus */
+
+#endif//__DBUSXX_SIGNAL_ROUTER_H
@@ -0,0 +1,316 @@
+/*
+ *
+ *  D-Bus++ - C++ bindings for D-Bus
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/subtree.h>
+#include <dbus-c++/object.h>
+#include <dbus-c++/debug.h>
+#include "internalerror.h"
+
+#include <dbus/dbus.h>
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <sstream>
+
+#include "message_p.h"
+#include "server_p.h"
+#include "connection_p.h"
+#include "introspection_p.h"
+
+using namespace DBus;
+
+struct SubtreeAdaptor::Private
+{
+  static void unregister_function_stub(DBusConnection *, void *);
+  static DBusHandlerResult message_function_stub(DBusConnection *, DBusMessage *, void *);
+};
+
+static DBusObjectPathVTable _vtable =
+{
+  SubtreeAdaptor::Private::unregister_function_stub,
+  SubtreeAdaptor::Private::message_function_stub,
+  NULL, NULL, NULL, NULL
+};
+
+void SubtreeAdaptor::Private::unregister_function_stub(DBusConnection *, void *)
+{
+}
+
+DBusHandlerResult SubtreeAdaptor::Private::message_function_stub(DBusConnection *, DBusMessage *dmsg, void *data)
+{
+  SubtreeAdaptor *s = static_cast<SubtreeAdaptor *>(data);
+
+  if (s)
+  {
+    Message msg(new Message::Private(dmsg));
+
+    debug_log("in subtree %s", s->prefix().c_str());
+
+    return s->handle_message(msg)
+           ? DBUS_HANDLER_RESULT_HANDLED
+           : DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+  else
+  {
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+}
+
+SubtreeAdaptor::SubtreeAdaptor(Connection &conn, const Path &prefix, size_t cache_size)
+  : _conn(conn), _prefix(prefix), _cache_size(cache_size), _page_size(256), _max_nodes(1024),
+    _dispatching(NULL)
+{
+  debug_log("registering subtree %s", _prefix.c_str());
+
+  if (!dbus_connection_register_fallback(_conn._pvt->conn, _prefix.c_str(), &_vtable, this))
+  {
+    throw ErrorNoMemory("unable to register object path");
+  }
+}
+
+SubtreeAdaptor::~SubtreeAdaptor()
+{
+  debug_log("unregistering subtree %s", _prefix.c_str());
+
+  dbus_connection_unregister_object_path(_conn._pvt->conn, _prefix.c_str());
+
+  for (ObjectList::iterator oi = _lru.begin(); oi != _lru.end(); ++oi)
+    delete oi->second;
+
+  for (std::vector<ObjectAdaptor *>::iterator ri = _retired.begin(); ri != _retired.end(); ++ri)
+    delete *ri;
+}
+
+void SubtreeAdaptor::invalidate(const Path &path)
+{
+  ObjectTable::iterator oi = _objects.find(path);
+
+  if (oi == _objects.end())
+    return;
+
+  _retired.push_back(oi->second->second);
+  _lru.erase(oi->second);
+  _objects.erase(oi);
+
+  trim();
+}
+
+void SubtreeAdaptor::invalidate()
+{
+  for (ObjectList::iterator oi = _lru.begin(); oi != _lru.end(); ++oi)
+    _retired.push_back(oi->second);
+
+  _lru.clear();
+  _objects.clear();
+
+  trim();
+}
+
+void SubtreeAdaptor::page_size(size_t size)
+{
+  _page_size = size ? size : 1;
+}
+
+void SubtreeAdaptor::max_nodes(size_t max)
+{
+  _max_nodes = max ? max : 1;
+}
+
+bool SubtreeAdaptor::children(const Path &, const std::string &, size_t, std::vector<std::string> &)
+{
+  return false;
+}
+
+bool SubtreeAdaptor::busy(ObjectAdaptor *object)
+{
+  return !object->_continuations.empty();
+}
+
+ObjectAdaptor *SubtreeAdaptor::lookup(const Path &path)
+{
+  ObjectTable::iterator oi = _objects.find(path);
+
+  if (oi != _objects.end())
+  {
+    _lru.splice(_lru.begin(), _lru, oi->second);
+    return oi->second->second;
+  }
+
+  debug_log("resolving %s", path.c_str());
+
+  ObjectAdaptor *object = resolve(path);
+
+  if (object)
+  {
+    _lru.push_front(std::make_pair(path, object));
+    _objects[path] = _lru.begin();
+  }
+  return object;
+}
+
+void SubtreeAdaptor::trim()
+{
+  std::vector<ObjectAdaptor *>::iterator ri = _retired.begin();
+
+  while (ri != _retired.end())
+  {
+    if (*ri != _dispatching && !busy(*ri))
+    {
+      delete *ri;
+      ri = _retired.erase(ri);
+    }
+    else
+      ++ri;
+  }
+
+  ObjectList::iterator oi = _lru.end();
+
+  while (_lru.size() > _cache_size && oi != _lru.begin())
+  {
+    --oi;
+
+    if (oi->second == _dispatching || busy(oi->second))
+      continue;
+
+    delete oi->second;
+    _objects.erase(oi->first);
+    oi = _lru.erase(oi);
+  }
+}
+
+bool SubtreeAdaptor::handle_message(const Message &msg)
+{
+  if (msg.type() != DBUS_MESSAGE_TYPE_METHOD_CALL)
+    return false;
+
+  const CallMessage &cmsg = reinterpret_cast<const CallMessage &>(msg);
+  const char *interface = cmsg.interface();
+  const char *member = cmsg.member();
+  const Path path = cmsg.path();
+  ObjectAdaptor *object;
+
+  try
+  {
+    object = lookup(path);
+  }
+  catch (Error &e)
+  {
+    ErrorMessage em(cmsg, e.name(), e.message());
+    _conn.send(em);
+    return true;
+  }
+
+  if (interface && !strcmp(interface, DBUS_INTERFACE_INTROSPECTABLE) && !strcmp(member, "Introspect"))
+  {
+    Message reply = introspect(cmsg, object);
+
+    _conn.send(reply);
+    trim();
+    return true;
+  }
+
+  if (!object)
+  {
+    ErrorMessage em(cmsg, DBUS_ERROR_UNKNOWN_OBJECT, ("No such object " + path).c_str());
+    _conn.send(em);
+    return true;
+  }
+
+  _dispatching = object;
+
+  bool handled = object->handle_message(msg);
+
+  _dispatching = NULL;
+
+  trim();
+  return handled;
+}
+
+Message SubtreeAdaptor::introspect(const CallMessage &call, ObjectAdaptor *object)
+{
+  const Path path = call.path();
+  std::ostringstream xml;
+
+  xml << DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE;
+  xml << "<node name=\"" << path << "\">";
+
+  if (object)
+    introspect_interfaces(xml, object->_interfaces);
+
+  // answered here in any case
+  if (!object || object->_interfaces.find(DBUS_INTERFACE_INTROSPECTABLE) == object->_interfaces.end())
+  {
+    xml << "\n\t<interface name=\"" DBUS_INTERFACE_INTROSPECTABLE "\">"
+        << "\n\t\t<method name=\"Introspect\">"
+        << "\n\t\t\t<arg direction=\"out\" type=\"s\" name=\"data\"/>"
+        << "\n\t\t</method>"
+        << "\n\t</interface>";
+  }
+
+  // the objects registered on their own below, then the subtree's
+  const ObjectPathList registered = ObjectAdaptor::child_nodes(_conn, path);
+  std::set<std::string> seen(registered.begin(), registered.end());
+
+  for (ObjectPathList::const_iterator ni = registered.begin(); ni != registered.end(); ++ni)
+    xml << "\n\t<node name=\"" << *ni << "\"/>";
+
+  std::vector<std::string> names;
+  std::string after;
+  size_t listed = 0;
+  bool more = true;
+
+  // one reply only, however many nodes there are
+  while (more && listed < _max_nodes)
+  {
+    names.clear();
+    more = children(path, after, std::min(_page_size, _max_nodes - listed), names);
+
+    if (names.empty())
+      break;
+
+    for (std::vector<std::string>::const_iterator ni = names.begin(); ni != names.end(); ++ni)
+    {
+      if (!seen.count(*ni))
+        xml << "\n\t<node name=\"" << *ni << "\"/>";
+    }
+    listed += names.size();
+    after = names.back();
+  }
+
+  if (more && !names.empty())
+    xml << "\n\t<!-- truncated after " << listed << " nodes -->";
+
+  if (!object && registered.empty() && after.empty())
+    return ErrorMessage(call, DBUS_ERROR_UNKNOWN_OBJECT, ("No such object " + path).c_str());
+
+  xml << "\n</node>";
+
+  ReturnMessage reply(call);
+  MessageIter wi = reply.writer();
+
+  wi.append_string(xml.str().c_str());
+  return reply;
+}
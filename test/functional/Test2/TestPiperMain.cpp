@@ -0,0 +1,314 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// STD
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "TestPiperProvider.h"
+
+/* The server runs in this process, the clients in a child process, each
+   on its own connection so that they can leave the bus on their own.
+ */
+
+using namespace std;
+
+static const char *SERVER_NAME = "DBusCpp.Test.Piper";
+static const char *SERVER_PATH = "/DBusCpp/Test/Piper";
+
+DBus::BusDispatcher dispatcher;
+TestPiperProvider *g_provider;
+pid_t g_client;
+int g_status = 1;
+
+static DBus::CallMessage slow(uint32_t ms)
+{
+  DBus::CallMessage call(SERVER_NAME, SERVER_PATH, "DBusCpp.Test.Piper", "Slow");
+  DBus::MessageIter wi = call.writer();
+
+  wi << ms;
+  return call;
+}
+
+static uint32_t get(DBus::Connection &conn, const char *member)
+{
+  DBus::CallMessage call(SERVER_NAME, SERVER_PATH, "DBusCpp.Test.Piper", member);
+  DBus::Message reply = conn.send_blocking(call, 5000);
+  DBus::MessageIter ri = reply.reader();
+  uint32_t value;
+
+  ri >> value;
+  return value;
+}
+
+static bool check(const char *what, bool ok)
+{
+  cout << what << ": " << (ok ? "OK" : "NOK") << endl;
+  return ok;
+}
+
+struct SlowCall
+{
+  uint32_t ms;
+  uint32_t runs;
+  bool replied;
+};
+
+// makes the call on a connection of its own and keeps the run number
+static void *callSlow(void *arg)
+{
+  SlowCall *call = static_cast<SlowCall *>(arg);
+  DBus::Connection conn = DBus::Connection::SessionBus();
+  DBus::CallMessage msg = slow(call->ms);
+
+  try
+  {
+    DBus::Message reply = conn.send_blocking(msg, 5000);
+    DBus::MessageIter ri = reply.reader();
+
+    ri >> call->runs;
+    call->replied = true;
+  }
+  catch (DBus::Error &)
+  {
+    call->replied = false;
+  }
+  return NULL;
+}
+
+/* Identical calls made while the first one is pending share its
+   execution: both replies carry the same run number.
+ */
+static bool testSingleFlight()
+{
+  SlowCall first = { 300, 0, false };
+  SlowCall second = { 300, 0, false };
+  pthread_t t1, t2;
+
+  pthread_create(&t1, NULL, callSlow, &first);
+
+  usleep(50000);
+
+  pthread_create(&t2, NULL, callSlow, &second);
+
+  pthread_join(t1, NULL);
+  pthread_join(t2, NULL);
+
+  return check("identical calls coalesced",
+               first.replied && second.replied && first.runs == second.runs);
+}
+
+/* A queued call is put back in the queue when a caller coalesced with it
+   leaves, it must keep its deadline.
+ */
+static bool testDeadline()
+{
+  DBus::Connection busy = DBus::Connection::SessionBus();
+  DBus::Connection leaving = DBus::Connection::SessionBus();
+  DBus::Connection staying = DBus::Connection::SessionBus();
+
+  // keeps the worker thread past the call budget
+  DBus::CallMessage c1 = slow(1500);
+  DBus::PendingCall p1 = busy.send_async(c1, 5000);
+
+  usleep(100000);
+
+  // coalesced with each other, both queued behind the first call
+  DBus::CallMessage c2 = slow(1);
+  DBus::PendingCall p2 = leaving.send_async(c2, 5000);
+
+  usleep(100000);
+
+  DBus::CallMessage c3 = slow(1);
+  DBus::PendingCall p3 = staying.send_async(c3, 5000);
+
+  usleep(100000);
+
+  leaving.disconnect();
+
+  p3.block();
+
+  DBus::Message r3 = p3.steal_reply();
+
+  p1.block();
+
+  return check("deadline kept when re-queued",
+               r3.is_error() && !strcmp(DBus::Error(r3).name(), "org.freedesktop.DBus.Error.Timeout"));
+}
+
+/* The handler of a call whose caller left sees it cancelled and gives up.
+ */
+static bool testCancel()
+{
+  DBus::Connection probe = DBus::Connection::SessionBus();
+  DBus::Connection leaving = DBus::Connection::SessionBus();
+
+  uint32_t before = get(probe, "Cancelled");
+
+  DBus::CallMessage call = slow(3000);
+  DBus::PendingCall pending = leaving.send_async(call, 5000);
+
+  usleep(200000);
+
+  leaving.disconnect();
+
+  // well before the handler is done sleeping
+  bool cancelled = false;
+
+  for (int i = 0; i < 100 && !cancelled; ++i)
+  {
+    usleep(10000);
+    cancelled = get(probe, "Cancelled") > before;
+  }
+
+  return check("call cancelled when its caller left", cancelled);
+}
+
+/* A cached reply is handed out until the cache is invalidated.
+ */
+static bool testCache()
+{
+  DBus::Connection conn = DBus::Connection::SessionBus();
+
+  uint32_t first = get(conn, "Count");
+  uint32_t cached = get(conn, "Count");
+
+  DBus::CallMessage bump(SERVER_NAME, SERVER_PATH, "DBusCpp.Test.Piper", "Bump");
+  conn.send_blocking(bump, 5000);
+
+  uint32_t fresh = get(conn, "Count");
+
+  return check("cached reply until invalidated", cached == first && fresh == first + 1);
+}
+
+/* A batch runs its calls in order and reports each outcome; the forwarded
+   method is rejected without reaching the worker thread.
+ */
+static bool testBatch()
+{
+  DBus::Connection conn = DBus::Connection::SessionBus();
+
+  DBus::CallMessage first = slow(1);
+  DBus::Message before = conn.send_blocking(first, 5000);
+  uint32_t runs_before;
+  DBus::MessageIter bi = before.reader();
+
+  bi >> runs_before;
+
+  std::vector<DBus::BatchCall> calls(3);
+
+  calls[0]._1 = SERVER_PATH;
+  calls[0]._2 = "DBusCpp.Test.Piper";
+  calls[0]._3 = "Count";
+
+  calls[1]._1 = SERVER_PATH;
+  calls[1]._2 = "DBusCpp.Test.Piper";
+  calls[1]._3 = "Fail";
+
+  calls[2]._1 = SERVER_PATH;
+  calls[2]._2 = "DBusCpp.Test.Piper";
+  calls[2]._3 = "Slow";
+  calls[2]._4.resize(1);
+
+  DBus::MessageIter vi = calls[2]._4[0].writer();
+  vi << (uint32_t) 1;
+
+  DBus::CallMessage call(SERVER_NAME, SERVER_PATH, "org.dbuscxx.Batch", "Call");
+  DBus::MessageIter wi = call.writer();
+
+  wi << calls;
+
+  DBus::Message reply = conn.send_blocking(call, 5000);
+  DBus::MessageIter ri = reply.reader();
+  std::vector<DBus::BatchResult> results;
+
+  ri >> results;
+
+  DBus::CallMessage last = slow(1);
+  DBus::Message after = conn.send_blocking(last, 5000);
+  uint32_t runs_after;
+  DBus::MessageIter ai = after.reader();
+
+  ai >> runs_after;
+
+  return check("batch of a normal, a failing and a forwarded call",
+               results.size() == 3
+               && results[0]._1.empty() && results[0]._2.size() == 1
+               && results[1]._1 == "DBusCpp.Test.Piper.Error.Failed"
+               && results[2]._1 == "org.freedesktop.DBus.Error.NotSupported"
+               && runs_after == runs_before + 1);
+}
+
+static int runClient()
+{
+  bool ok = true;
+
+  ok = testSingleFlight() && ok;
+  ok = testDeadline() && ok;
+  ok = testCancel() && ok;
+  ok = testCache() && ok;
+  ok = testBatch() && ok;
+
+  return ok ? 0 : 1;
+}
+
+static void *waitClient(void *)
+{
+  waitpid(g_client, &g_status, 0);
+
+  dispatcher.leave();
+  return NULL;
+}
+
+static void *workerThread(void *)
+{
+  g_provider->worker_thread();
+  return NULL;
+}
+
+int main()
+{
+  DBus::_init_threading();
+
+  DBus::default_dispatcher = &dispatcher;
+
+  DBus::Connection conn = DBus::Connection::SessionBus();
+  conn.request_name(SERVER_NAME);
+
+  TestPiperProvider provider(conn);
+  g_provider = &provider;
+
+  provider.call_budget(1000);
+  provider.start_pipe(dispatcher);
+
+  // before any thread is started
+  g_client = fork();
+
+  if (g_client == 0)
+  {
+    // leave the connections of the server alone
+    _exit(runClient());
+  }
+
+  pthread_t worker, waiter;
+
+  pthread_create(&worker, NULL, workerThread, NULL);
+  pthread_create(&waiter, NULL, waitClient, NULL);
+
+  dispatcher.enter();
+
+  pthread_join(waiter, NULL);
+
+  bool ok = WIFEXITED(g_status) && WEXITSTATUS(g_status) == 0;
+
+  cout << "Testresult = " << string(ok ? "OK" : "NOK") << endl;
+
+  // the worker thread blocks in the request pipe
+  _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,73 @@
+#ifndef TEST_PIPER_PROVIDER_H
+#define TEST_PIPER_PROVIDER_H
+
+#include <dbus-c++/dbus.h>
+#include <dbus-c++/request-piper.h>
+#include <dbus-c++/batch.h>
+#include "TestPiperProviderPrivate.h"
+
+#include <unistd.h>
+
+/* Serves DBusCpp.Test.Piper, Slow being handled in the worker thread and
+   the others in the dispatcher thread
+ */
+class TestPiperProvider :
+  public DBusCpp::Test::Piper_adaptor,
+  public DBus::BatchAdaptor,
+  public DBus::RequestPiper
+{
+public:
+  TestPiperProvider(DBus::Connection &connection) :
+    DBus::RequestPiper(connection, "/DBusCpp/Test/Piper"),
+    mRuns(0),
+    mCancelled(0),
+    mCount(0)
+  {
+    // the generated stub is still found by _call_orig_method()
+    Piper_adaptor::_methods["Slow"] =
+      new DBus::Callback<TestPiperProvider, DBus::Message, const DBus::CallMessage &>(this, &TestPiperProvider::_Forwarding_stub);
+  }
+
+  // in the worker thread
+  uint32_t Slow(const uint32_t &ms)
+  {
+    uint32_t runs = __sync_add_and_fetch(&mRuns, 1);
+    DBus::CallContext *ctx = DBus::CallContext::current();
+
+    for (uint32_t slept = 0; slept < ms && !ctx->cancelled(); slept += 10)
+      usleep(10000);
+
+    if (ctx->cancelled())
+      __sync_add_and_fetch(&mCancelled, 1);
+
+    return runs;
+  }
+
+  uint32_t Cancelled()
+  {
+    return __sync_fetch_and_add(&mCancelled, 0);
+  }
+
+  // cached until Bump() is called
+  uint32_t Count()
+  {
+    return ++mCount;
+  }
+
+  void Bump()
+  {
+    Piper_adaptor::invalidate_cache("Count");
+  }
+
+  void Fail()
+  {
+    throw DBus::Error("DBusCpp.Test.Piper.Error.Failed", "Failed on purpose");
+  }
+
+private:
+  volatile uint32_t mRuns;
+  volatile uint32_t mCancelled;
+  uint32_t mCount;
+};
+
+#endif // TEST_PIPER_PROVIDER_H
@@ -0,0 +1,381 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// STD
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <dbus-c++/completion-queue.h>
+
+#include "TestCallsProvider.h"
+
+/* The server runs in this process, the client in a child process which
+   dispatches its own connection in a thread of its own.
+ */
+
+using namespace std;
+
+static const char *SERVER_NAME = "DBusCpp.Test.Calls";
+static const char *SERVER_PATH = "/DBusCpp/Test/Calls";
+
+DBus::BusDispatcher dispatcher;
+pid_t g_client;
+int g_status = 1;
+
+static bool check(const char *what, bool ok)
+{
+  cout << what << ": " << (ok ? "OK" : "NOK") << endl;
+  return ok;
+}
+
+static DBus::CallMessage echo(uint32_t value)
+{
+  DBus::CallMessage call(SERVER_NAME, SERVER_PATH, "DBusCpp.Test.Calls", "Echo");
+  DBus::MessageIter wi = call.writer();
+
+  wi << value;
+  return call;
+}
+
+static DBus::CallMessage slow(uint32_t ms)
+{
+  DBus::CallMessage call(SERVER_NAME, SERVER_PATH, "DBusCpp.Test.Calls", "Slow");
+  DBus::MessageIter wi = call.writer();
+
+  wi << ms;
+  return call;
+}
+
+static uint32_t value(DBus::Message &reply)
+{
+  DBus::MessageIter ri = reply.reader();
+  uint32_t value;
+
+  ri >> value;
+  return value;
+}
+
+// what a completion handler saw
+struct Completion
+{
+  volatile int calls;
+  bool matched;
+};
+
+static void completed(DBus::PendingCall &call, void *object)
+{
+  Completion *completion = static_cast<Completion *>(object);
+  DBus::Message reply = call.steal_reply();
+
+  completion->matched = !reply.is_error()
+                        && value(reply) == (uint32_t)(size_t) call.data();
+  __sync_add_and_fetch(&completion->calls, 1);
+}
+
+// waits for the client dispatcher to deliver every completion, 5s at most
+static bool waitCompletions(vector<Completion> &completions)
+{
+  for (int i = 0; i < 500; ++i)
+  {
+    size_t done = 0;
+
+    for (size_t c = 0; c < completions.size(); ++c)
+      done += __sync_fetch_and_add(&completions[c].calls, 0) != 0;
+
+    if (done == completions.size())
+      break;
+
+    usleep(10000);
+  }
+
+  // a second call would come right after the first one
+  usleep(50000);
+
+  for (size_t c = 0; c < completions.size(); ++c)
+  {
+    if (completions[c].calls != 1 || !completions[c].matched)
+      return false;
+  }
+  return true;
+}
+
+/* Rounds of overlapping calls, their state comes from a pool and is
+   reused round after round: each handler gets its own call and data.
+ */
+static bool testPool(DBus::Connection &conn)
+{
+  bool ok = true;
+
+  for (int round = 0; round < 3; ++round)
+  {
+    vector<Completion> completions(200);
+    vector<DBus::PendingCall> pending;
+
+    for (size_t c = 0; c < completions.size(); ++c)
+    {
+      DBus::CallMessage call = echo(round * 1000 + c);
+
+      completions[c].calls = 0;
+      completions[c].matched = false;
+
+      pending.push_back(conn.send_async(call, 5000, completed, &completions[c],
+                                        (void *)(size_t)(round * 1000 + c)));
+    }
+
+    // the calls are still completed once their handles are gone
+    pending.clear();
+
+    ok = waitCompletions(completions) && ok;
+  }
+
+  return check("pooled calls complete once each", ok);
+}
+
+/* A handler set while the client dispatcher may be delivering the reply,
+   or once it did, is called exactly once.
+ */
+static bool testLateHandler(DBus::Connection &conn)
+{
+  vector<Completion> completions(200);
+
+  for (size_t c = 0; c < completions.size(); ++c)
+  {
+    DBus::CallMessage call = echo(c);
+    DBus::PendingCall pending = conn.send_async(call, 5000);
+
+    completions[c].calls = 0;
+    completions[c].matched = false;
+
+    pending.data((void *) c);
+
+    // anywhere from before the reply to well after it
+    if (c % 2)
+      pending.block();
+    usleep(rand() % 1000);
+
+    pending.handler(completed, &completions[c]);
+  }
+
+  return check("late handler called once", waitCompletions(completions));
+}
+
+static bool readable(int fd)
+{
+  struct pollfd pfd = { fd, POLLIN, 0 };
+
+  return poll(&pfd, 1, 0) == 1;
+}
+
+/* The queue collects the calls as the server answers them, one after the
+   other, and the waits end with the completions or their timeout.
+ */
+static bool testCompletionQueue(DBus::Connection &conn)
+{
+  DBus::CompletionQueue queue;
+
+  for (uint32_t ms = 100; ms <= 300; ms += 100)
+  {
+    DBus::CallMessage call = slow(ms);
+    DBus::PendingCall pending = conn.send_async(call, 5000);
+
+    queue.add(pending);
+  }
+
+  bool none = !queue.wait_all(20) && queue.outstanding() == 3 && !readable(queue.fd());
+  bool any = queue.wait_any(2000) && queue.ready() >= 1 && readable(queue.fd());
+  bool all = queue.wait_all(2000) && queue.outstanding() == 0 && queue.ready() == 3;
+
+  vector<DBus::PendingCall> calls;
+  size_t first = queue.take(calls, 2);
+  size_t rest = queue.take(calls);
+
+  bool taken = first == 2 && rest == 1 && queue.ready() == 0 && !readable(queue.fd());
+  bool replied = true;
+
+  for (size_t c = 0; c < calls.size(); ++c)
+  {
+    DBus::Message reply = calls[c].steal_reply();
+
+    replied = replied && !reply.is_error() && value(reply) == 100 * (c + 1);
+  }
+
+  return check("completion queue waits and takes", none && any && all && taken && replied);
+}
+
+/* wait_any() gives up after its timeout, and a call attached once
+   completed is queued right away.
+ */
+static bool testCompletionTimeout(DBus::Connection &conn)
+{
+  DBus::CompletionQueue queue;
+
+  DBus::CallMessage call = slow(500);
+  DBus::PendingCall pending = conn.send_async(call, 5000);
+
+  queue.add(pending);
+
+  double start = DBus::Deadline::now();
+  bool expired = !queue.wait_any(100);
+  double waited = DBus::Deadline::now() - start;
+
+  bool timed = expired && waited >= 90 && waited < 450;
+  bool all = queue.wait_all(5000) && queue.ready() == 1;
+
+  DBus::CompletionQueue late;
+
+  DBus::CallMessage done = echo(7);
+  DBus::PendingCall completed = conn.send_async(done, 5000);
+
+  completed.block();
+  usleep(50000);
+
+  late.add(completed);
+
+  bool ready = late.wait_any(0) && late.ready() == 1 && late.outstanding() == 0;
+
+  return check("completion queue timeout", timed && all && ready);
+}
+
+static string errorName(DBus::Message &reply)
+{
+  return reply.is_error() ? DBus::Error(reply).name() : "";
+}
+
+/* The replies of a batch come back in the order of the calls, failed
+   calls included.
+ */
+static bool testSendBatch(DBus::Connection &conn)
+{
+  vector<DBus::CallMessage> calls;
+
+  for (uint32_t c = 0; c < 100; ++c)
+    calls.push_back(echo(c));
+
+  calls.push_back(DBus::CallMessage(SERVER_NAME, SERVER_PATH, "DBusCpp.Test.Calls", "Fail"));
+  calls.push_back(DBus::CallMessage(SERVER_NAME, SERVER_PATH, "DBusCpp.Test.Calls", "Missing"));
+  calls.push_back(echo(100));
+
+  vector<DBus::Message> replies = conn.send_batch(calls, 5000);
+
+  bool ordered = replies.size() == 103;
+
+  for (uint32_t c = 0; ordered && c < 100; ++c)
+    ordered = !replies[c].is_error() && value(replies[c]) == c;
+
+  bool failed = ordered
+                && errorName(replies[100]) == "DBusCpp.Test.Calls.Error.Failed"
+                && errorName(replies[101]) == "org.freedesktop.DBus.Error.UnknownMethod"
+                && !replies[102].is_error() && value(replies[102]) == 100;
+
+  return check("send_batch replies in order", ordered && failed);
+}
+
+/* The timeout covers the whole batch: calls stuck behind a slow one fail
+   with it.
+ */
+static bool testSendBatchTimeout(DBus::Connection &conn)
+{
+  vector<DBus::CallMessage> calls;
+
+  calls.push_back(slow(600));
+  calls.push_back(echo(1));
+
+  double start = DBus::Deadline::now();
+  vector<DBus::Message> replies = conn.send_batch(calls, 200);
+  double waited = DBus::Deadline::now() - start;
+
+  bool expired = replies.size() == 2 && replies[0].is_error() && replies[1].is_error();
+
+  // let the server catch up
+  usleep(500000);
+
+  return check("send_batch timeout", expired && waited < 500);
+}
+
+static void *dispatchClient(void *arg)
+{
+  static_cast<DBus::BusDispatcher *>(arg)->enter();
+  return NULL;
+}
+
+static int runClient()
+{
+  // the server's dispatcher and connection are left alone
+  DBus::BusDispatcher clientDispatcher;
+
+  DBus::default_dispatcher = &clientDispatcher;
+
+  DBus::Connection conn = DBus::Connection::SessionBus();
+
+  pthread_t thread;
+
+  pthread_create(&thread, NULL, dispatchClient, &clientDispatcher);
+
+  bool ok = true;
+
+  ok = testPool(conn) && ok;
+  ok = testLateHandler(conn) && ok;
+  ok = testCompletionQueue(conn) && ok;
+  ok = testCompletionTimeout(conn) && ok;
+  ok = testSendBatch(conn) && ok;
+
+  clientDispatcher.leave();
+  pthread_join(thread, NULL);
+
+  /* libdbus may never wake a blocked call whose timeout another thread
+     dispatched, so this one runs with the dispatcher stopped.
+   */
+  ok = testSendBatchTimeout(conn) && ok;
+
+  return ok ? 0 : 1;
+}
+
+static void *waitClient(void *)
+{
+  waitpid(g_client, &g_status, 0);
+
+  dispatcher.leave();
+  return NULL;
+}
+
+int main()
+{
+  DBus::_init_threading();
+
+  DBus::default_dispatcher = &dispatcher;
+
+  DBus::Connection conn = DBus::Connection::SessionBus();
+  conn.request_name(SERVER_NAME);
+
+  TestCallsProvider provider(conn);
+
+  // before any thread is started
+  g_client = fork();
+
+  if (g_client == 0)
+  {
+    _exit(runClient());
+  }
+
+  pthread_t waiter;
+
+  pthread_create(&waiter, NULL, waitClient, NULL);
+
+  dispatcher.enter();
+
+  pthread_join(waiter, NULL);
+
+  bool ok = WIFEXITED(g_status) && WEXITSTATUS(g_status) == 0;
+
+  cout << "Testresult = " << string(ok ? "OK" : "NOK") << endl;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,38 @@
+#ifndef TEST_CALLS_PROVIDER_H
+#define TEST_CALLS_PROVIDER_H
+
+#include <dbus-c++/dbus.h>
+#include "TestCallsProviderPrivate.h"
+
+#include <unistd.h>
+
+/* Serves DBusCpp.Test.Calls to the asynchronous calls of the client
+ */
+class TestCallsProvider :
+  public DBusCpp::Test::Calls_adaptor,
+  public DBus::ObjectAdaptor
+{
+public:
+  TestCallsProvider(DBus::Connection &connection) :
+    DBus::ObjectAdaptor(connection, "/DBusCpp/Test/Calls")
+  {}
+
+  uint32_t Echo(const uint32_t &value)
+  {
+    return value;
+  }
+
+  // holds up the server, calls are answered in turn
+  uint32_t Slow(const uint32_t &ms)
+  {
+    usleep(ms * 1000);
+    return ms;
+  }
+
+  void Fail()
+  {
+    throw DBus::Error("DBusCpp.Test.Calls.Error.Failed", "Failed on purpose");
+  }
+};
+
+#endif // TEST_CALLS_PROVIDER_H
@@ -0,0 +1,253 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// STD
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "TestSubtreeProvider.h"
+
+/* The server runs in this process, the client in a child process.
+ */
+
+using namespace std;
+
+static const char *SERVER_NAME = "DBusCpp.Test.Subtree";
+static const char *CONTROL_PATH = "/DBusCpp/Test/Subtree";
+static const char *ROWS_PATH = "/DBusCpp/Test/Rows";
+static const char *ROW = "DBusCpp.Test.Subtree.Row";
+static const char *CONTROL = "DBusCpp.Test.Subtree.Control";
+
+DBus::BusDispatcher dispatcher;
+pid_t g_client;
+int g_status = 1;
+
+static bool check(const char *what, bool ok)
+{
+  cout << what << ": " << (ok ? "OK" : "NOK") << endl;
+  return ok;
+}
+
+static string rowPath(int row)
+{
+  char path[64];
+
+  snprintf(path, sizeof(path), "%s/r%d", ROWS_PATH, row);
+  return path;
+}
+
+static DBus::Message call(DBus::Connection &conn, const string &path, const char *interface, const char *member)
+{
+  DBus::CallMessage call(SERVER_NAME, path.c_str(), interface, member);
+
+  return conn.send_blocking(call, 5000);
+}
+
+static string name(DBus::Connection &conn, int row)
+{
+  DBus::Message reply = call(conn, rowPath(row), ROW, "Name");
+  DBus::MessageIter ri = reply.reader();
+  string name;
+
+  ri >> name;
+  return name;
+}
+
+static uint32_t count(DBus::Connection &conn, const char *member)
+{
+  DBus::Message reply = call(conn, CONTROL_PATH, CONTROL, member);
+  DBus::MessageIter ri = reply.reader();
+  uint32_t value;
+
+  ri >> value;
+  return value;
+}
+
+static string introspect(DBus::Connection &conn)
+{
+  DBus::Message reply = call(conn, ROWS_PATH, "org.freedesktop.DBus.Introspectable", "Introspect");
+  DBus::MessageIter ri = reply.reader();
+  string xml;
+
+  ri >> xml;
+  return xml;
+}
+
+static int nodes(const string &xml)
+{
+  int n = 0;
+
+  for (size_t i = xml.find("<node name=\"r"); i != string::npos; i = xml.find("<node name=\"r", i + 1))
+    ++n;
+  return n;
+}
+
+/* Objects only exist once called, and stay around for the next calls.
+ */
+static bool testResolve()
+{
+  DBus::Connection conn = DBus::Connection::SessionBus();
+
+  bool none = count(conn, "Resolved") == 0 && count(conn, "Live") == 0;
+  bool named = name(conn, 0) == rowPath(0) && name(conn, 0) == rowPath(0);
+  bool once = count(conn, "Resolved") == 1 && count(conn, "Live") == 1;
+
+  bool unknown = false;
+
+  try
+  {
+    call(conn, string(ROWS_PATH) + "/nothing", ROW, "Name");
+  }
+  catch (DBus::Error &e)
+  {
+    unknown = !strcmp(e.name(), "org.freedesktop.DBus.Error.UnknownObject");
+  }
+
+  return check("objects resolved on their first call", none && named && once && unknown);
+}
+
+/* The least recently used object goes beyond the cache size, unless a
+   deferred call to it is pending.
+ */
+static bool testEviction()
+{
+  DBus::Connection conn = DBus::Connection::SessionBus();
+
+  // r0 is kept from testResolve()
+  name(conn, 1);
+  name(conn, 2);
+
+  bool evicted = count(conn, "Live") == 2;
+  uint32_t resolved = count(conn, "Resolved");
+
+  name(conn, 0);
+
+  bool again = count(conn, "Resolved") == resolved + 1;
+
+  DBus::CallMessage hold(SERVER_NAME, rowPath(0).c_str(), ROW, "Hold");
+  DBus::PendingCall pending = conn.send_async(hold, 5000);
+
+  // r0 is the least recently used now, but busy: r3 goes instead
+  name(conn, 3);
+  name(conn, 4);
+
+  uint32_t held = count(conn, "Resolved");
+
+  call(conn, CONTROL_PATH, CONTROL, "Release");
+  pending.block();
+
+  DBus::Message reply = pending.steal_reply();
+  bool replied = !reply.is_error();
+
+  name(conn, 0);
+
+  bool kept = count(conn, "Resolved") == held && count(conn, "Live") == 2;
+
+  return check("LRU eviction spares busy objects", evicted && again && replied && kept);
+}
+
+/* An object invalidated while handling a call lives until it returned.
+ */
+static bool testInvalidate()
+{
+  DBus::Connection conn = DBus::Connection::SessionBus();
+
+  name(conn, 5);
+
+  uint32_t resolved = count(conn, "Resolved");
+
+  call(conn, rowPath(5), ROW, "Drop");
+
+  bool dropped = count(conn, "Live") == 1;
+
+  name(conn, 5);
+
+  bool again = count(conn, "Resolved") == resolved + 1;
+
+  return check("invalidate() during a call", dropped && again);
+}
+
+/* Introspect asks for the nodes by pages and stops at max_nodes().
+ */
+static bool testIntrospect()
+{
+  DBus::Connection conn = DBus::Connection::SessionBus();
+
+  string all = introspect(conn);
+
+  DBus::CallMessage max(SERVER_NAME, CONTROL_PATH, CONTROL, "MaxNodes");
+  DBus::MessageIter wi = max.writer();
+
+  wi << (uint32_t) 5;
+  conn.send_blocking(max, 5000);
+
+  string some = introspect(conn);
+
+  return check("Introspect paging and truncation",
+               nodes(all) == 10 && all.find("truncated") == string::npos
+               && all.find("\"r9\"") != string::npos
+               && nodes(some) == 5 && some.find("truncated after 5 nodes") != string::npos
+               && some.find("\"r4\"") != string::npos);
+}
+
+static int runClient()
+{
+  bool ok = true;
+
+  ok = testResolve() && ok;
+  ok = testEviction() && ok;
+  ok = testInvalidate() && ok;
+  ok = testIntrospect() && ok;
+
+  return ok ? 0 : 1;
+}
+
+static void *waitClient(void *)
+{
+  waitpid(g_client, &g_status, 0);
+
+  dispatcher.leave();
+  return NULL;
+}
+
+int main()
+{
+  DBus::_init_threading();
+
+  DBus::default_dispatcher = &dispatcher;
+
+  DBus::Connection conn = DBus::Connection::SessionBus();
+  conn.request_name(SERVER_NAME);
+
+  TestRows rows(conn);
+  TestSubtreeControl control(conn, rows);
+
+  // before any thread is started
+  g_client = fork();
+
+  if (g_client == 0)
+  {
+    // leave the connection of the server alone
+    _exit(runClient());
+  }
+
+  pthread_t waiter;
+
+  pthread_create(&waiter, NULL, waitClient, NULL);
+
+  dispatcher.enter();
+
+  pthread_join(waiter, NULL);
+
+  bool ok = WIFEXITED(g_status) && WEXITSTATUS(g_status) == 0;
+
+  cout << "Testresult = " << string(ok ? "OK" : "NOK") << endl;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#ifndef TEST_SUBTREE_PROVIDER_H
+#define TEST_SUBTREE_PROVIDER_H
+
+#include <dbus-c++/dbus.h>
+#include <dbus-c++/subtree.h>
+#include "TestSubtreeProviderPrivate.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+/* Ten rows, /DBusCpp/Test/Rows/r0 to r9, served by a subtree keeping two
+   of them, and an object to look at the subtree from the outside
+ */
+
+class TestRows;
+
+class TestRow :
+  public DBusCpp::Test::Subtree::Row_adaptor,
+  public DBus::ObjectAdaptor
+{
+public:
+  TestRow(TestRows &rows, const DBus::Path &path);
+
+  ~TestRow();
+
+  std::string Name()
+  {
+    return path();
+  }
+
+  // deferred until Control.Release()
+  std::string Hold();
+
+  // invalidates itself while handling the call
+  void Drop();
+
+  // answers the call deferred by Hold()
+  void Release(DBus::Tag *tag);
+
+private:
+  TestRows &mRows;
+};
+
+class TestRows : public DBus::SubtreeAdaptor
+{
+public:
+  TestRows(DBus::Connection &connection) :
+    DBus::SubtreeAdaptor(connection, "/DBusCpp/Test/Rows", 2),
+    mLive(0),
+    mResolved(0),
+    mHeld(NULL),
+    mHeldTag(NULL)
+  {
+    page_size(3);
+  }
+
+  ~TestRows()
+  {
+    delete mHeldTag;
+  }
+
+  unsigned int mLive;
+  unsigned int mResolved;
+
+  TestRow *mHeld;
+  DBus::Tag *mHeldTag;
+
+  using DBus::SubtreeAdaptor::invalidate;
+
+protected:
+  DBus::ObjectAdaptor *resolve(const DBus::Path &path)
+  {
+    const std::string rows = prefix() + "/r";
+
+    if (path.compare(0, rows.size(), rows) || path.size() != rows.size() + 1
+        || path[rows.size()] < '0' || path[rows.size()] > '9')
+      return NULL;
+
+    ++mResolved;
+    return new TestRow(*this, path);
+  }
+
+  bool children(const DBus::Path &path, const std::string &after, size_t max,
+                std::vector<std::string> &names)
+  {
+    if (path != prefix())
+      return false;
+
+    int i = after.empty() ? 0 : atoi(after.c_str() + 1) + 1;
+
+    for (; i < 10 && names.size() < max; ++i)
+    {
+      char name[8];
+
+      snprintf(name, sizeof(name), "r%d", i);
+      names.push_back(name);
+    }
+    return i < 10;
+  }
+};
+
+TestRow::TestRow(TestRows &rows, const DBus::Path &path) :
+  DBus::ObjectAdaptor(rows, path),
+  mRows(rows)
+{
+  ++mRows.mLive;
+}
+
+TestRow::~TestRow()
+{
+  --mRows.mLive;
+}
+
+std::string TestRow::Hold()
+{
+  mRows.mHeld = this;
+  mRows.mHeldTag = new DBus::Tag;
+
+  return_later(mRows.mHeldTag);
+  return std::string();
+}
+
+void TestRow::Release(DBus::Tag *tag)
+{
+  DBus::CallMessage values;
+  DBus::MessageIter wi = values.writer();
+
+  wi << path();
+  return_now(tag, values);
+}
+
+void TestRow::Drop()
+{
+  mRows.invalidate(path());
+}
+
+class TestSubtreeControl :
+  public DBusCpp::Test::Subtree::Control_adaptor,
+  public DBus::ObjectAdaptor
+{
+public:
+  TestSubtreeControl(DBus::Connection &connection, TestRows &rows) :
+    DBus::ObjectAdaptor(connection, "/DBusCpp/Test/Subtree"),
+    mRows(rows)
+  {}
+
+  uint32_t Live()
+  {
+    return mRows.mLive;
+  }
+
+  uint32_t Resolved()
+  {
+    return mRows.mResolved;
+  }
+
+  void Release()
+  {
+    if (!mRows.mHeld)
+      return;
+
+    mRows.mHeld->Release(mRows.mHeldTag);
+
+    delete mRows.mHeldTag;
+    mRows.mHeldTag = NULL;
+    mRows.mHeld = NULL;
+  }
+
+  void MaxNodes(const uint32_t &max)
+  {
+    mRows.max_nodes(max);
+  }
+
+private:
+  TestRows &mRows;
+};
+
+#endif // TEST_SUBTREE_PROVIDER_H
@@ -0,0 +1,130 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// STD
+#include <cstdio>
+#include <string>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "TestSignalsProxy.h"
+
+/* The proxies get the signals of their own connection, the dispatcher
+   runs in the main thread.
+ */
+
+using namespace std;
+
+DBus::BusDispatcher dispatcher;
+
+static bool check(const char *what, bool ok)
+{
+  cout << what << ": " << (ok ? "OK" : "NOK") << endl;
+  return ok;
+}
+
+static void ping(DBus::Connection &conn)
+{
+  DBus::SignalMessage sig("/DBusCpp/Test/Signals", "DBusCpp.Test.Signals", "Ping");
+  DBus::MessageIter wi = sig.writer();
+
+  wi << (uint32_t) 1;
+  conn.send(sig);
+}
+
+// dispatches until `count' reaches `expected', for a second at most
+static void dispatchUntil(volatile int *count, int expected)
+{
+  for (int i = 0; i < 20 && __sync_fetch_and_add(count, 0) < expected; ++i)
+    dispatcher.do_iteration();
+}
+
+/* A proxy removed by the handler of another one doesn't get the signal
+   being delivered, the others still do.
+ */
+static bool testRemoveInHandler(DBus::Connection &conn)
+{
+  volatile int first = 0, removed = 0, last = 0;
+
+  TestSignalsProxy *a = new TestSignalsProxy(conn, &first);
+  TestSignalsProxy *b = new TestSignalsProxy(conn, &removed);
+  TestSignalsProxy *c = new TestSignalsProxy(conn, &last);
+
+  a->destroy(b);
+
+  ping(conn);
+  dispatchUntil(&last, 1);
+
+  delete a;
+  delete c;
+
+  return check("proxy removed by another's handler", first == 1 && removed == 0 && last == 1);
+}
+
+struct Removal
+{
+  TestSignalsProxy *proxy;
+  volatile int *started;
+  volatile int *finished;
+  int finishedWhenRemoved;
+};
+
+static void *removeThread(void *arg)
+{
+  Removal *removal = static_cast<Removal *>(arg);
+
+  while (!__sync_fetch_and_add(removal->started, 0))
+    usleep(1000);
+
+  delete removal->proxy;
+
+  removal->finishedWhenRemoved = __sync_fetch_and_add(removal->finished, 0);
+  return NULL;
+}
+
+/* A proxy destroyed in another thread while its handler runs is only
+   destroyed once the handler returned.
+ */
+static bool testRemoveDuringDelivery(DBus::Connection &conn)
+{
+  volatile int calls = 0, started = 0, finished = 0;
+
+  TestSignalsProxy *proxy = new TestSignalsProxy(conn, &calls);
+
+  proxy->slow(&started, &finished);
+
+  Removal removal = { proxy, &started, &finished, 0 };
+  pthread_t remover;
+
+  pthread_create(&remover, NULL, removeThread, &removal);
+
+  ping(conn);
+  dispatchUntil(&finished, 1);
+
+  pthread_join(remover, NULL);
+
+  return check("proxy removed while its handler runs", calls == 1 && removal.finishedWhenRemoved == 1);
+}
+
+int main()
+{
+  DBus::_init_threading();
+
+  DBus::default_dispatcher = &dispatcher;
+
+  // keeps do_iteration() from waiting for a signal forever
+  new DBus::DefaultTimeout(50, true, &dispatcher);
+
+  DBus::Connection conn = DBus::Connection::SessionBus();
+
+  bool ok = true;
+
+  ok = testRemoveInHandler(conn) && ok;
+  ok = testRemoveDuringDelivery(conn) && ok;
+
+  cout << "Testresult = " << string(ok ? "OK" : "NOK") << endl;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+#ifndef TEST_SIGNALS_PROXY_H
+#define TEST_SIGNALS_PROXY_H
+
+#include <dbus-c++/dbus.h>
+#include "TestSignalsProxyPrivate.h"
+
+#include <unistd.h>
+
+/* Receives the Ping signals this process sends to itself; its handler can
+   destroy another proxy, or take its time
+ */
+class TestSignalsProxy :
+  public DBusCpp::Test::Signals_proxy,
+  public DBus::ObjectProxy
+{
+public:
+  TestSignalsProxy(DBus::Connection &connection, volatile int *calls) :
+    DBus::ObjectProxy(connection, "/DBusCpp/Test/Signals", connection.unique_name()),
+    mCalls(calls),
+    mVictim(NULL),
+    mSlow(false),
+    mStarted(NULL),
+    mFinished(NULL)
+  {}
+
+  // destroys `victim' when it gets the next signal
+  void destroy(TestSignalsProxy *victim)
+  {
+    mVictim = victim;
+  }
+
+  // sleeps in the handler, raising `started' then `finished'
+  void slow(volatile int *started, volatile int *finished)
+  {
+    mSlow = true;
+    mStarted = started;
+    mFinished = finished;
+  }
+
+  void Ping(const uint32_t &/*serial*/)
+  {
+    __sync_add_and_fetch(mCalls, 1);
+
+    if (mVictim)
+    {
+      delete mVictim;
+      mVictim = NULL;
+    }
+
+    if (mSlow)
+    {
+      __sync_add_and_fetch(mStarted, 1);
+      usleep(200000);
+      __sync_add_and_fetch(mFinished, 1);
+    }
+  }
+
+private:
+  volatile int *mCalls;
+  TestSignalsProxy *mVictim;
+  bool mSlow;
+  volatile int *mStarted;
+  volatile int *mFinished;
+};
+
+#endif // TEST_SIGNALS_PROXY_H
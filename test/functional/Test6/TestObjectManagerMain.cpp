@@ -0,0 +1,244 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// STD
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "TestObjectManagerProvider.h"
+
+/* The server runs in this process, the client in a child process.
+ */
+
+using namespace std;
+
+static const char *SERVER_NAME = "DBusCpp.Test.Objects";
+static const char *SERVER_PATH = "/DBusCpp/Test/Objects";
+static const char *OBJECT_INTERFACE = "DBusCpp.Test.Object";
+
+DBus::BusDispatcher dispatcher;
+pid_t g_client;
+int g_status = 1;
+
+static bool check(const char *what, bool ok)
+{
+  cout << what << ": " << (ok ? "OK" : "NOK") << endl;
+  return ok;
+}
+
+/* Mirrors the objects of the server and records the signals keeping the
+   mirror up to date
+ */
+class Objects : public DBus::ObjectManagerProxy, public DBus::ObjectProxy
+{
+public:
+  Objects(DBus::Connection &connection) :
+    DBus::ObjectProxy(connection, SERVER_PATH, SERVER_NAME)
+  {}
+
+  vector<string> added;
+  vector<string> removed;
+
+protected:
+  void InterfacesAdded(const DBus::Path &path, const DBus::InterfaceValues &/*interfaces*/)
+  {
+    added.push_back(path);
+  }
+
+  void InterfacesRemoved(const DBus::Path &path, const vector<string> &/*interfaces*/)
+  {
+    removed.push_back(path);
+  }
+};
+
+static string objectPath(const string &name)
+{
+  return string(SERVER_PATH) + "/" + name;
+}
+
+static void control(DBus::Connection &conn, const char *method, const string &name)
+{
+  DBus::CallMessage call(SERVER_NAME, SERVER_PATH, "DBusCpp.Test.Objects", method);
+  DBus::MessageIter wi = call.writer();
+
+  wi << name;
+  conn.send_blocking(call, 5000);
+}
+
+static void setCount(DBus::Connection &conn, const string &name, int32_t count)
+{
+  DBus::CallMessage call(SERVER_NAME, objectPath(name).c_str(), "org.freedesktop.DBus.Properties", "Set");
+  DBus::MessageIter wi = call.writer();
+
+  wi << string(OBJECT_INTERFACE) << string("Count");
+
+  DBus::MessageIter vi = wi.new_variant("i");
+  vi << count;
+  wi.close_container(vi);
+
+  conn.send_blocking(call, 5000);
+}
+
+// the value of `property' of the object `name', NULL if unknown
+static const DBus::Variant *property(const DBus::ManagedObjects &objects, const string &name, const char *property)
+{
+  DBus::ManagedObjects::const_iterator oi = objects.find(objectPath(name));
+
+  if (oi == objects.end())
+    return NULL;
+
+  DBus::InterfaceValues::const_iterator ii = oi->second.find(OBJECT_INTERFACE);
+
+  if (ii == oi->second.end())
+    return NULL;
+
+  DBus::PropertyValues::const_iterator pi = ii->second.find(property);
+
+  return pi == ii->second.end() ? NULL : &pi->second;
+}
+
+static bool hasName(const DBus::ManagedObjects &objects, const string &name)
+{
+  const DBus::Variant *value = property(objects, name, "Name");
+
+  return value && string(*value) == name;
+}
+
+static bool hasCount(const DBus::ManagedObjects &objects, const string &name, int32_t count)
+{
+  const DBus::Variant *value = property(objects, name, "Count");
+
+  return value && int32_t(*value) == count;
+}
+
+// dispatches until `events' holds `expected' paths, for a second at most
+static void dispatchUntil(DBus::BusDispatcher &client, vector<string> &events, size_t expected)
+{
+  for (int i = 0; i < 20 && events.size() < expected; ++i)
+    client.do_iteration();
+}
+
+/* GetManagedObjects lists the objects strictly below the manager, announced
+   or not, with the current values of their properties.
+ */
+static bool testGetManagedObjects(DBus::Connection &conn, Objects &objects)
+{
+  DBus::ManagedObjects managed = objects.GetManagedObjects();
+
+  bool listed = managed.size() == 2 && hasName(managed, "a") && hasName(managed, "hidden")
+                && hasCount(managed, "a", 7);
+
+  setCount(conn, "a", 9);
+
+  managed = objects.GetManagedObjects();
+
+  return check("GetManagedObjects", listed && hasCount(managed, "a", 9));
+}
+
+/* An announced object reaches the mirror through InterfacesAdded.
+ */
+static bool testInterfacesAdded(DBus::Connection &conn, DBus::BusDispatcher &client, Objects &objects)
+{
+  objects.refresh();
+
+  bool refreshed = objects.objects().size() == 2 && hasCount(objects.objects(), "a", 9);
+
+  control(conn, "Add", "b");
+  dispatchUntil(client, objects.added, 1);
+
+  bool added = objects.added.size() == 1 && objects.added[0] == objectPath("b");
+
+  return check("InterfacesAdded", refreshed && added
+               && hasName(objects.objects(), "b") && hasCount(objects.objects(), "b", 7));
+}
+
+/* Only announced objects emit InterfacesRemoved, which takes them out of
+   the mirror.
+ */
+static bool testInterfacesRemoved(DBus::Connection &conn, DBus::BusDispatcher &client, Objects &objects)
+{
+  // signals keep their order, that of `hidden' would come first
+  control(conn, "Remove", "hidden");
+  control(conn, "Remove", "b");
+  dispatchUntil(client, objects.removed, 1);
+
+  bool removed = objects.removed.size() == 1 && objects.removed[0] == objectPath("b");
+
+  return check("InterfacesRemoved", removed
+               && !objects.objects().count(objectPath("b")) && hasName(objects.objects(), "a"));
+}
+
+static int runClient()
+{
+  // the server's dispatcher and connection are left alone
+  DBus::BusDispatcher client;
+
+  DBus::default_dispatcher = &client;
+
+  // keeps do_iteration() from waiting for a signal forever
+  new DBus::DefaultTimeout(50, true, &client);
+
+  DBus::Connection conn = DBus::Connection::SessionBus();
+
+  Objects objects(conn);
+
+  bool ok = true;
+
+  ok = testGetManagedObjects(conn, objects) && ok;
+  ok = testInterfacesAdded(conn, client, objects) && ok;
+  ok = testInterfacesRemoved(conn, client, objects) && ok;
+
+  return ok ? 0 : 1;
+}
+
+static void *waitClient(void *)
+{
+  waitpid(g_client, &g_status, 0);
+
+  dispatcher.leave();
+  return NULL;
+}
+
+int main()
+{
+  DBus::_init_threading();
+
+  DBus::default_dispatcher = &dispatcher;
+
+  DBus::Connection conn = DBus::Connection::SessionBus();
+  conn.request_name(SERVER_NAME);
+
+  TestObjectManagerProvider provider(conn);
+
+  // not below the manager
+  TestObject other(conn, "/DBusCpp/Test/Other", "other", true);
+
+  // before any thread is started
+  g_client = fork();
+
+  if (g_client == 0)
+  {
+    // leave the connection of the server alone
+    _exit(runClient());
+  }
+
+  pthread_t waiter;
+
+  pthread_create(&waiter, NULL, waitClient, NULL);
+
+  dispatcher.enter();
+
+  pthread_join(waiter, NULL);
+
+  bool ok = WIFEXITED(g_status) && WEXITSTATUS(g_status) == 0;
+
+  cout << "Testresult = " << string(ok ? "OK" : "NOK") << endl;
+
+  return ok ? 0 : 1;
+}
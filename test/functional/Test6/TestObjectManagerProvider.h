@@ -0,0 +1,75 @@
+#ifndef TEST_OBJECT_MANAGER_PROVIDER_H
+#define TEST_OBJECT_MANAGER_PROVIDER_H
+
+#include <map>
+#include <string>
+
+#include <dbus-c++/dbus.h>
+#include "TestObjectManagerProviderPrivate.h"
+
+/* An object below the manager, announced once its properties are set
+   unless told otherwise
+ */
+class TestObject :
+  public DBusCpp::Test::Object_adaptor,
+  public DBus::PropertiesAdaptor,
+  public DBus::ObjectAdaptor
+{
+public:
+  TestObject(DBus::Connection &connection, const std::string &path, const std::string &name, bool announced) :
+    DBus::ObjectAdaptor(connection, path)
+  {
+    Name = name;
+    Count = 7;
+
+    if (announced)
+      announce();
+  }
+};
+
+/* Manages the objects below /DBusCpp/Test/Objects, which its clients add
+   and remove
+ */
+class TestObjectManagerProvider :
+  public DBusCpp::Test::Objects_adaptor,
+  public DBus::ObjectManagerAdaptor,
+  public DBus::ObjectAdaptor
+{
+public:
+  TestObjectManagerProvider(DBus::Connection &connection) :
+    DBus::ObjectAdaptor(connection, "/DBusCpp/Test/Objects")
+  {
+    Add("a");
+
+    // registered, but never announced
+    _objects["hidden"] = new TestObject(connection, path() + "/hidden", "hidden", false);
+  }
+
+  ~TestObjectManagerProvider()
+  {
+    for (std::map<std::string, TestObject *>::iterator oi = _objects.begin(); oi != _objects.end(); ++oi)
+      delete oi->second;
+  }
+
+  void Add(const std::string &name)
+  {
+    if (!_objects.count(name))
+      _objects[name] = new TestObject(conn(), path() + "/" + name, name, true);
+  }
+
+  void Remove(const std::string &name)
+  {
+    std::map<std::string, TestObject *>::iterator oi = _objects.find(name);
+
+    if (oi == _objects.end())
+      return;
+
+    delete oi->second;
+    _objects.erase(oi);
+  }
+
+private:
+  std::map<std::string, TestObject *> _objects;
+};
+
+#endif // TEST_OBJECT_MANAGER_PROVIDER_H
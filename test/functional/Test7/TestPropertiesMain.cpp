@@ -0,0 +1,194 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// STD
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "TestPropertiesProvider.h"
+
+/* The server runs in this process, the client in a child process.
+ */
+
+using namespace std;
+
+static const char *SERVER_NAME = "DBusCpp.Test.Properties";
+static const char *SERVER_PATH = "/DBusCpp/Test/Properties";
+static const char *INTERFACE = "DBusCpp.Test.Properties";
+
+DBus::BusDispatcher dispatcher;
+pid_t g_client;
+int g_status = 1;
+
+static bool check(const char *what, bool ok)
+{
+  cout << what << ": " << (ok ? "OK" : "NOK") << endl;
+  return ok;
+}
+
+static void setLocalName(DBus::Connection &conn, const string &name)
+{
+  DBus::CallMessage call(SERVER_NAME, SERVER_PATH, INTERFACE, "Rename");
+  DBus::MessageIter wi = call.writer();
+
+  wi << name;
+  conn.send_blocking(call, 5000);
+}
+
+static string localName(DBus::Connection &conn)
+{
+  DBus::CallMessage call(SERVER_NAME, SERVER_PATH, INTERFACE, "LocalName");
+  DBus::Message reply = conn.send_blocking(call, 5000);
+  DBus::MessageIter ri = reply.reader();
+  string name;
+
+  ri >> name;
+  return name;
+}
+
+static string getProperty(DBus::Connection &conn, const string &property)
+{
+  DBus::CallMessage call(SERVER_NAME, SERVER_PATH, "org.freedesktop.DBus.Properties", "Get");
+  DBus::MessageIter wi = call.writer();
+
+  wi << string(INTERFACE) << property;
+
+  DBus::Message reply = conn.send_blocking(call, 5000);
+  DBus::MessageIter ri = reply.reader();
+  DBus::Variant value;
+
+  ri >> value;
+  return value;
+}
+
+static string getAllProperties(DBus::Connection &conn, const string &property)
+{
+  DBus::CallMessage call(SERVER_NAME, SERVER_PATH, "org.freedesktop.DBus.Properties", "GetAll");
+  DBus::MessageIter wi = call.writer();
+
+  wi << string(INTERFACE);
+
+  DBus::Message reply = conn.send_blocking(call, 5000);
+  DBus::MessageIter ri = reply.reader();
+  map<string, DBus::Variant> properties;
+
+  ri >> properties;
+  return properties[property];
+}
+
+static void setProperty(DBus::Connection &conn, const string &property, const string &value)
+{
+  DBus::CallMessage call(SERVER_NAME, SERVER_PATH, "org.freedesktop.DBus.Properties", "Set");
+  DBus::MessageIter wi = call.writer();
+
+  wi << string(INTERFACE) << property;
+
+  DBus::MessageIter vi = wi.new_variant("s");
+  vi << value;
+  wi.close_container(vi);
+
+  conn.send_blocking(call, 5000);
+}
+
+/* The encoding kept by Get is dropped when the value is assigned locally.
+ */
+static bool testLocalWrite()
+{
+  DBus::Connection conn = DBus::Connection::SessionBus();
+
+  bool initial = getProperty(conn, "Name") == "initial";
+
+  setLocalName(conn, "first");
+
+  bool first = getProperty(conn, "Name") == "first" && getAllProperties(conn, "Name") == "first";
+
+  setLocalName(conn, "second");
+
+  bool second = getAllProperties(conn, "Name") == "second" && getProperty(conn, "Name") == "second";
+
+  return check("local writes visible to Get and GetAll", initial && first && second);
+}
+
+/* Set assigns the value the adaptor reads.
+ */
+static bool testSet()
+{
+  DBus::Connection conn = DBus::Connection::SessionBus();
+
+  setProperty(conn, "Name", "remote");
+
+  return check("Set updates the local value",
+               localName(conn) == "remote" && getProperty(conn, "Name") == "remote");
+}
+
+/* What on_get_property() makes of the value only goes to its caller.
+ */
+static bool testHook()
+{
+  DBus::Connection conn = DBus::Connection::SessionBus();
+
+  bool hooked = getProperty(conn, "Hooked") == "hooked";
+  bool stored = getAllProperties(conn, "Hooked") == "stored";
+
+  return check("on_get_property changes a copy", hooked && stored && getProperty(conn, "Hooked") == "hooked");
+}
+
+static int runClient()
+{
+  bool ok = true;
+
+  ok = testLocalWrite() && ok;
+  ok = testSet() && ok;
+  ok = testHook() && ok;
+
+  return ok ? 0 : 1;
+}
+
+static void *waitClient(void *)
+{
+  waitpid(g_client, &g_status, 0);
+
+  dispatcher.leave();
+  return NULL;
+}
+
+int main()
+{
+  DBus::_init_threading();
+
+  DBus::default_dispatcher = &dispatcher;
+
+  DBus::Connection conn = DBus::Connection::SessionBus();
+  conn.request_name(SERVER_NAME);
+
+  TestPropertiesProvider provider(conn);
+
+  // before any thread is started
+  g_client = fork();
+
+  if (g_client == 0)
+  {
+    // leave the connection of the server alone
+    _exit(runClient());
+  }
+
+  pthread_t waiter;
+
+  pthread_create(&waiter, NULL, waitClient, NULL);
+
+  dispatcher.enter();
+
+  pthread_join(waiter, NULL);
+
+  bool ok = WIFEXITED(g_status) && WEXITSTATUS(g_status) == 0;
+
+  cout << "Testresult = " << string(ok ? "OK" : "NOK") << endl;
+
+  return ok ? 0 : 1;
+}
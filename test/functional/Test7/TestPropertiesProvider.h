@@ -0,0 +1,47 @@
+#ifndef TEST_PROPERTIES_PROVIDER_H
+#define TEST_PROPERTIES_PROVIDER_H
+
+#include <dbus-c++/dbus.h>
+#include "TestPropertiesProviderPrivate.h"
+
+/* Serves DBusCpp.Test.Properties; Name keeps its encoding for every
+   request and the value of Hooked is replaced by on_get_property()
+ */
+class TestPropertiesProvider :
+  public DBusCpp::Test::Properties_adaptor,
+  public DBus::PropertiesAdaptor,
+  public DBus::ObjectAdaptor
+{
+public:
+  TestPropertiesProvider(DBus::Connection &connection) :
+    DBus::ObjectAdaptor(connection, "/DBusCpp/Test/Properties")
+  {
+    Name.cache();
+    Name = "initial";
+    Hooked = "stored";
+  }
+
+  void Rename(const std::string &name)
+  {
+    Name = name;
+  }
+
+  std::string LocalName()
+  {
+    return Name();
+  }
+
+protected:
+  void on_get_property(DBus::InterfaceAdaptor &/*interface*/, const std::string &property, DBus::Variant &value)
+  {
+    if (property != "Hooked")
+      return;
+
+    value.clear();
+
+    DBus::MessageIter wi = value.writer();
+    wi << std::string("hooked");
+  }
+};
+
+#endif // TEST_PROPERTIES_PROVIDER_H
@@ -0,0 +1,88 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/admission.h>
+
+#include <cstring>
+
+#include "check.h"
+
+using namespace DBus;
+
+/* Methods are limited by interface and member, methods of the same name
+   in other interfaces have their own counters.
+ */
+static void testMethodLimits()
+{
+  AdmissionControl ac;
+
+  ac.method_limits("a.I", "Get", AdmissionLimits(1, 0, "a.I.Busy"));
+
+  CHECK(ac.admit("a.I", "Get", ":1.1"));
+  CHECK(!ac.admit("a.I", "Get", ":1.2"));
+  CHECK(ac.admit("b.I", "Get", ":1.2"));
+
+  CHECK(!strcmp(ac.error_name("a.I", "Get"), "a.I.Busy"));
+  CHECK(!strcmp(ac.error_name("b.I", "Get"), "org.freedesktop.DBus.Error.LimitsExceeded"));
+
+  AdmissionCounters c = ac.counters("a.I", "Get");
+  CHECK(c.admitted == 1 && c.rejected == 1 && c.in_flight == 1);
+
+  c = ac.counters();
+  CHECK(c.admitted == 2 && c.rejected == 1 && c.in_flight == 2);
+
+  ac.release("a.I", "Get", ":1.1");
+  CHECK(ac.admit("a.I", "Get", ":1.2"));
+}
+
+/* The object-wide limits apply to all the methods together.
+ */
+static void testObjectLimits()
+{
+  AdmissionControl ac;
+
+  ac.limits(AdmissionLimits(0, 2));
+
+  CHECK(ac.admit_queued("a.I", "Get", ":1.1", 10));
+  CHECK(ac.admit_queued("a.I", "Set", ":1.1", 10));
+  CHECK(!ac.admit_queued("b.I", "Get", ":1.2", 10));
+
+  AdmissionCounters c = ac.counters();
+  CHECK(c.queued == 2 && c.queued_bytes == 20 && c.rejected == 1);
+
+  ac.release_queued("a.I", "Get", ":1.1", 10);
+  CHECK(ac.admit_queued("b.I", "Get", ":1.2", 10));
+}
+
+/* reset_totals() only zeroes the totals, the calls pending are still
+   accounted for.
+ */
+static void testResetTotals()
+{
+  AdmissionControl ac;
+
+  ac.method_limits("a.I", "Get", AdmissionLimits(1));
+
+  CHECK(ac.admit("a.I", "Get", ":1.1"));
+  CHECK(!ac.admit("a.I", "Get", ":1.1"));
+
+  ac.reset_totals();
+
+  AdmissionCounters c = ac.counters("a.I", "Get");
+  CHECK(c.admitted == 0 && c.rejected == 0 && c.in_flight == 1);
+
+  c = ac.counters();
+  CHECK(c.admitted == 0 && c.rejected == 0 && c.in_flight == 1);
+
+  CHECK(!ac.admit("a.I", "Get", ":1.1"));
+}
+
+int main()
+{
+  testMethodLimits();
+  testObjectLimits();
+  testResetTotals();
+
+  return failures;
+}
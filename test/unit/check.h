@@ -0,0 +1,21 @@
+#ifndef TEST_UNIT_CHECK_H
+#define TEST_UNIT_CHECK_H
+
+#include <cstdio>
+
+/* The unit tests are plain programs run by `make check', they report each
+   failed check and exit with the number of failures.
+ */
+
+static int failures = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) \
+    { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      ++failures; \
+    } \
+  } while (0)
+
+#endif // TEST_UNIT_CHECK_H
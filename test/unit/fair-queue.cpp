@@ -0,0 +1,147 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/admission.h>
+
+#include <cstring>
+#include <string>
+
+#include "check.h"
+
+using namespace DBus;
+
+static void push(FairRequestQueue &queue, const char *sender, const char *member, size_t cost = 1)
+{
+  CallMessage call("org.freedesktop.DBus.Test", "/test", "org.freedesktop.DBus.Test", member);
+
+  call.sender(sender);
+  queue.push(call, NULL, cost, cost);
+}
+
+// the members of the queued calls, in the order they are served
+static std::string serve(FairRequestQueue &queue)
+{
+  std::string order;
+  FairRequestQueue::Request *r;
+
+  while ((r = queue.front()))
+  {
+    order += order.empty() ? "" : " ";
+    order += r->call.member();
+    queue.pop();
+  }
+  return order;
+}
+
+/* With the same cost for every call the senders are served in turn,
+   whatever the number of calls each queued.
+ */
+static void testRoundRobin()
+{
+  FairRequestQueue queue;
+
+  push(queue, ":1.1", "A1");
+  push(queue, ":1.1", "A2");
+  push(queue, ":1.1", "A3");
+  push(queue, ":1.2", "B1");
+  push(queue, ":1.3", "C1");
+  push(queue, ":1.3", "C2");
+
+  CHECK(queue.size() == 6);
+  CHECK(serve(queue) == "A1 B1 C1 A2 C2 A3");
+  CHECK(queue.empty());
+}
+
+/* With the size of the calls as their cost a sender gets about a quantum
+   of bytes per turn, its unused credit carried over to the next turn.
+ */
+static void testDeficit()
+{
+  FairRequestQueue queue(100);
+
+  push(queue, ":1.1", "A1", 60);
+  push(queue, ":1.1", "A2", 60);
+  push(queue, ":1.2", "B1", 30);
+  push(queue, ":1.2", "B2", 30);
+  push(queue, ":1.2", "B3", 30);
+  push(queue, ":1.3", "C1", 250);
+
+  CHECK(serve(queue) == "A1 B1 B2 B3 A2 C1");
+}
+
+static void testDrop()
+{
+  FairRequestQueue queue;
+  std::deque<FairRequestQueue::Request> dropped;
+
+  push(queue, ":1.1", "A1");
+  push(queue, ":1.2", "B1");
+  push(queue, ":1.1", "A2");
+
+  CHECK(queue.front() && !strcmp(queue.front()->call.member(), "A1"));
+
+  queue.drop(":1.1", dropped);
+
+  CHECK(dropped.size() == 2);
+  CHECK(queue.size() == 1);
+  CHECK(serve(queue) == "B1");
+
+  queue.drop(":1.9", dropped);
+  CHECK(dropped.size() == 2);
+}
+
+/* Each sender has its own quotas, one flooding the object does not keep
+   the others out.
+ */
+static void testSenderInFlight()
+{
+  AdmissionControl ac;
+
+  ac.sender_limits(SenderLimits(1));
+
+  CHECK(ac.admit("a.I", "Get", ":1.1"));
+  CHECK(!ac.admit("a.I", "Get", ":1.1"));
+  CHECK(ac.admit("a.I", "Get", ":1.2"));
+
+  CHECK(ac.sender_counters(":1.1").in_flight == 1);
+
+  ac.release("a.I", "Get", ":1.1");
+
+  CHECK(ac.sender_counters(":1.1").in_flight == 0);
+  CHECK(ac.admit("a.I", "Get", ":1.1"));
+}
+
+static void testSenderQueuedBytes()
+{
+  AdmissionControl ac;
+
+  ac.sender_limits(SenderLimits(0, 100));
+
+  CHECK(ac.counts_bytes());
+
+  // a single call is let through however big
+  CHECK(ac.admit_queued("a.I", "Set", ":1.1", 150));
+  CHECK(!ac.admit_queued("a.I", "Set", ":1.1", 10));
+
+  CHECK(ac.admit_queued("a.I", "Set", ":1.2", 60));
+  CHECK(ac.admit_queued("a.I", "Set", ":1.2", 40));
+  CHECK(!ac.admit_queued("a.I", "Set", ":1.2", 1));
+
+  AdmissionCounters c = ac.sender_counters(":1.2");
+  CHECK(c.queued == 2 && c.queued_bytes == 100);
+
+  ac.release_queued("a.I", "Set", ":1.1", 150);
+  CHECK(ac.admit_queued("a.I", "Set", ":1.1", 10));
+}
+
+int main()
+{
+  testRoundRobin();
+  testDeficit();
+  testDrop();
+  testSenderInFlight();
+  testSenderQueuedBytes();
+
+  return failures;
+}
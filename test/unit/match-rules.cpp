@@ -0,0 +1,112 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "match-rules.h"
+
+#include <string>
+
+#include "check.h"
+
+using namespace DBus;
+
+/* MatchRules is internal to the library, the test builds its own copy.
+   The connection goes to a server nobody serves: what the rules send
+   piles up in its outgoing queue, where it is measured.
+ */
+
+static long queued(DBusConnection *conn)
+{
+  return dbus_connection_get_outgoing_size(conn);
+}
+
+static void testRefcount(DBusConnection *conn)
+{
+  MatchRules *rules = MatchRules::of(conn);
+
+  CHECK(rules != NULL);
+  CHECK(MatchRules::of(conn) == rules);
+
+  const std::string a = "type='signal',interface='a.B'";
+  const std::string c = "type='signal',interface='c.D'";
+
+  long before = queued(conn);
+
+  rules->add(a);
+
+  long added = queued(conn);
+
+  CHECK(added > before);
+
+  // the same rule again is only counted
+  rules->add(a);
+  CHECK(queued(conn) == added);
+
+  rules->add(c);
+
+  long both = queued(conn);
+
+  CHECK(both > added);
+
+  // removed along with its last user only
+  rules->remove(a);
+  CHECK(queued(conn) == both);
+
+  rules->remove(a);
+
+  long removed = queued(conn);
+
+  CHECK(removed > both);
+
+  // unknown or already removed rules are ignored
+  rules->remove(a);
+  rules->remove("type='signal',interface='e.F'");
+  CHECK(queued(conn) == removed);
+
+  // and a removed rule is sent again when added back
+  rules->add(a);
+  CHECK(queued(conn) > removed);
+
+  rules->remove(a);
+  rules->remove(c);
+}
+
+int main()
+{
+  DBusError error;
+
+  dbus_error_init(&error);
+
+  DBusServer *server = dbus_server_listen("unix:tmpdir=/tmp", &error);
+
+  if (!server)
+  {
+    fprintf(stderr, "unable to listen: %s\n", error.message);
+    dbus_error_free(&error);
+    return 1;
+  }
+
+  char *address = dbus_server_get_address(server);
+  DBusConnection *conn = dbus_connection_open_private(address, &error);
+
+  dbus_free(address);
+
+  if (!conn)
+  {
+    fprintf(stderr, "unable to connect: %s\n", error.message);
+    dbus_error_free(&error);
+    dbus_server_disconnect(server);
+    dbus_server_unref(server);
+    return 1;
+  }
+
+  testRefcount(conn);
+
+  dbus_connection_close(conn);
+  dbus_connection_unref(conn);
+
+  dbus_server_disconnect(server);
+  dbus_server_unref(server);
+
+  return failures;
+}
@@ -0,0 +1,204 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "object-tree.h"
+
+#include <algorithm>
+#include <string>
+
+#include "check.h"
+
+using namespace DBus;
+
+/* ObjectTree is internal to the library, the test builds its own copy.
+   The objects are only compared, never dereferenced.
+ */
+
+static char dummies[8];
+
+static ObjectAdaptor *object(int i)
+{
+  return reinterpret_cast<ObjectAdaptor *>(&dummies[i]);
+}
+
+static std::string join(ObjectPathList nodes)
+{
+  std::string s;
+
+  nodes.sort();
+
+  for (ObjectPathList::const_iterator ni = nodes.begin(); ni != nodes.end(); ++ni)
+    s += (s.empty() ? "" : " ") + *ni;
+  return s;
+}
+
+static std::string children(ObjectTree *tree, const std::string &path)
+{
+  ObjectPathList nodes;
+
+  tree->children(path, nodes);
+  return join(nodes);
+}
+
+static bool has(const ObjectAdaptorPList &objects, ObjectAdaptor *o)
+{
+  return std::find(objects.begin(), objects.end(), o) != objects.end();
+}
+
+static void testInsertFind(ObjectTree *tree)
+{
+  CHECK(tree->insert("/a/b/c", object(1)));
+  CHECK(tree->insert("/a/d", object(2)));
+
+  CHECK(tree->find("/a/b/c") == object(1));
+  CHECK(tree->find("/a/d") == object(2));
+  CHECK(tree->find("/a/b") == NULL);
+  CHECK(tree->find("/a/b/c/e") == NULL);
+  CHECK(tree->find("") == NULL);
+  CHECK(tree->find("a") == NULL);
+
+  // one object per path
+  CHECK(!tree->insert("/a/b/c", object(3)));
+  CHECK(tree->insert("/a/b/c", object(1)));
+  CHECK(tree->find("/a/b/c") == object(1));
+
+  CHECK(children(tree, "/") == "a");
+  CHECK(children(tree, "/a") == "b d");
+  CHECK(children(tree, "/a/b/c") == "");
+  CHECK(children(tree, "/nowhere") == "");
+}
+
+static void testStamps(ObjectTree *tree)
+{
+  unsigned long a = tree->stamp("/a");
+  unsigned long b = tree->stamp("/a/b");
+
+  CHECK(a && b);
+  CHECK(tree->stamp("/nowhere") == 0);
+
+  // a node appearing under /a
+  CHECK(tree->insert("/a/f", object(3)));
+  CHECK(tree->stamp("/a") != a);
+  CHECK(tree->stamp("/a/b") == b);
+
+  // an object registering on an existing node changes no list
+  a = tree->stamp("/a");
+  CHECK(tree->insert("/a/b", object(4)));
+  CHECK(tree->stamp("/a") == a);
+
+  tree->erase("/a/b", object(4));
+  tree->erase("/a/f", object(3));
+  CHECK(tree->stamp("/a") != a);
+}
+
+static void testErase(ObjectTree *tree)
+{
+  // not the object there
+  tree->erase("/a/b/c", object(2));
+  CHECK(tree->find("/a/b/c") == object(1));
+
+  tree->erase("/a/b/c/e", object(1));
+  CHECK(tree->find("/a/b/c") == object(1));
+
+  // the nodes left empty go away, up to the first one still used
+  tree->erase("/a/b/c", object(1));
+  CHECK(tree->find("/a/b/c") == NULL);
+  CHECK(tree->stamp("/a/b") == 0);
+  CHECK(children(tree, "/a") == "d");
+
+  tree->erase("/a/d", object(2));
+  CHECK(children(tree, "/") == "");
+  CHECK(tree->stamp("/") != 0);
+}
+
+/* The objects whose path starts with a string, which may end in the
+   middle of a segment.
+ */
+static void testPrefixed(ObjectTree *tree)
+{
+  CHECK(tree->insert("/", object(0)));
+  CHECK(tree->insert("/x", object(1)));
+  CHECK(tree->insert("/x/y", object(2)));
+  CHECK(tree->insert("/xy", object(3)));
+  CHECK(tree->insert("/z", object(4)));
+
+  ObjectAdaptorPList objects;
+  ObjectPathList nodes;
+
+  tree->prefixed("/x/", &objects, &nodes);
+  CHECK(objects.size() == 1 && has(objects, object(2)));
+  CHECK(join(nodes) == "y");
+
+  objects.clear();
+  nodes.clear();
+  tree->prefixed("/x", &objects, &nodes);
+  CHECK(objects.size() == 3 && has(objects, object(1)) && has(objects, object(2)) && has(objects, object(3)));
+  CHECK(join(nodes) == "y");
+
+  objects.clear();
+  tree->prefixed("/", &objects, NULL);
+  CHECK(objects.size() == 5 && has(objects, object(0)) && has(objects, object(4)));
+
+  objects.clear();
+  tree->prefixed("/q", &objects, NULL);
+  CHECK(objects.empty());
+
+  CHECK(tree->find("/") == object(0));
+
+  for (int i = 0; i < 5; ++i)
+  {
+    static const char *paths[] = { "/", "/x", "/x/y", "/xy", "/z" };
+
+    tree->erase(paths[i], object(i));
+  }
+  CHECK(children(tree, "/") == "");
+}
+
+int main()
+{
+  // trees are attached to connections, any one will do
+  DBusError error;
+
+  dbus_error_init(&error);
+
+  DBusServer *server = dbus_server_listen("unix:tmpdir=/tmp", &error);
+
+  if (!server)
+  {
+    fprintf(stderr, "%s\n", error.message);
+    return 1;
+  }
+
+  char *address = dbus_server_get_address(server);
+  DBusConnection *conn = dbus_connection_open_private(address, &error);
+
+  dbus_free(address);
+
+  if (!conn)
+  {
+    fprintf(stderr, "%s\n", error.message);
+    return 1;
+  }
+
+  CHECK(ObjectTree::of(conn, false) == NULL);
+
+  ObjectTree *tree = ObjectTree::of(conn, true);
+
+  CHECK(tree && ObjectTree::of(conn, false) == tree);
+
+  if (tree)
+  {
+    testInsertFind(tree);
+    testStamps(tree);
+    testErase(tree);
+    testPrefixed(tree);
+  }
+
+  dbus_connection_close(conn);
+  dbus_connection_unref(conn);
+  dbus_server_disconnect(server);
+  dbus_server_unref(server);
+
+  return failures;
+}
@@ -0,0 +1,127 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/error.h>
+#include <dbus-c++/interface.h>
+#include <dbus-c++/message.h>
+
+#include <string>
+
+#include "check.h"
+
+using namespace DBus;
+
+// a signal with the arguments "foo", 5, /x/y and "bar"
+static SignalMessage signal()
+{
+  SignalMessage sig("/p", "org.freedesktop.DBus.Test", "Changed");
+  MessageIter wi = sig.writer();
+
+  wi.append_string("foo");
+  wi.append_int32(5);
+  wi.append_path("/x/y");
+  wi.append_string("bar");
+  return sig;
+}
+
+static SignalMessage signal(const char *arg0, bool path = false)
+{
+  SignalMessage sig("/p", "org.freedesktop.DBus.Test", "Changed");
+  MessageIter wi = sig.writer();
+
+  if (path)
+    wi.append_path(arg0);
+  else
+    wi.append_string(arg0);
+  return sig;
+}
+
+static void testKeys()
+{
+  CHECK(SignalMatch().keys() == "");
+
+  CHECK(SignalMatch().arg(0, "a").arg_path(2, "/x/").arg0_namespace("org.foo").keys()
+        == ",arg0='a',arg2path='/x/',arg0namespace='org.foo'");
+
+  // apostrophes can't be escaped inside quotes
+  CHECK(SignalMatch().arg(1, "it's").keys() == ",arg1='it'\\''s'");
+
+  bool thrown = false;
+
+  try
+  {
+    SignalMatch().arg(64, "a");
+  }
+  catch (ErrorInvalidArgs &)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
+
+/* argN only matches string arguments, equal to the value.
+ */
+static void testArg()
+{
+  SignalMessage sig = signal();
+
+  CHECK(SignalMatch().matches(sig));
+
+  CHECK(SignalMatch().arg(0, "foo").matches(sig));
+  CHECK(!SignalMatch().arg(0, "bar").matches(sig));
+  CHECK(SignalMatch().arg(3, "bar").matches(sig));
+  CHECK(SignalMatch().arg(0, "foo").arg(3, "bar").matches(sig));
+  CHECK(!SignalMatch().arg(0, "foo").arg(3, "baz").matches(sig));
+
+  // not strings
+  CHECK(!SignalMatch().arg(1, "5").matches(sig));
+  CHECK(!SignalMatch().arg(2, "/x/y").matches(sig));
+
+  // beyond the last argument
+  CHECK(!SignalMatch().arg(4, "").matches(sig));
+}
+
+/* argNpath matches strings and object paths equal to the value, or below
+   or above it when either ends with a '/'.
+ */
+static void testArgPath()
+{
+  SignalMessage sig = signal();
+
+  CHECK(SignalMatch().arg_path(2, "/x/y").matches(sig));
+  CHECK(SignalMatch().arg_path(2, "/x/").matches(sig));
+  CHECK(SignalMatch().arg_path(2, "/").matches(sig));
+  CHECK(!SignalMatch().arg_path(2, "/x").matches(sig));
+  CHECK(!SignalMatch().arg_path(2, "/x/y/").matches(sig));
+  CHECK(SignalMatch().arg_path(0, "foo").matches(sig));
+  CHECK(!SignalMatch().arg_path(1, "5").matches(sig));
+
+  // a string, object paths don't end with a '/'
+  SignalMessage dir = signal("/x/");
+
+  CHECK(SignalMatch().arg_path(0, "/x/y/z").matches(dir));
+  CHECK(SignalMatch().arg_path(0, "/x/").matches(dir));
+  CHECK(!SignalMatch().arg_path(0, "/xy").matches(dir));
+}
+
+static void testArg0Namespace()
+{
+  CHECK(SignalMatch().arg0_namespace("org.foo").matches(signal("org.foo")));
+  CHECK(SignalMatch().arg0_namespace("org.foo").matches(signal("org.foo.Bar")));
+  CHECK(!SignalMatch().arg0_namespace("org.foo").matches(signal("org.foobar")));
+  CHECK(!SignalMatch().arg0_namespace("org.foo.Bar").matches(signal("org.foo")));
+
+  // a string only
+  CHECK(!SignalMatch().arg0_namespace("org").matches(signal("/org", true)));
+}
+
+int main()
+{
+  testKeys();
+  testArg();
+  testArgPath();
+  testArg0Namespace();
+
+  return failures;
+}
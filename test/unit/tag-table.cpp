@@ -0,0 +1,191 @@
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dbus-c++/object.h>
+#include <dbus-c++/tag-table.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "check.h"
+
+using namespace DBus;
+
+static const size_t N = 1000;
+
+static Tag tags[N];
+static int values[N];
+
+// every tag of `expected' is found with its value, the others are not
+static bool consistent(const TagTable<int> &table, const std::map<const Tag *, int *> &expected)
+{
+  if (table.size() != expected.size())
+    return false;
+
+  for (size_t i = 0; i < N; ++i)
+  {
+    std::map<const Tag *, int *>::const_iterator ei = expected.find(&tags[i]);
+
+    if (table.find(&tags[i]) != (ei != expected.end() ? ei->second : NULL))
+      return false;
+  }
+  return true;
+}
+
+static void testInsertFind()
+{
+  TagTable<int> table;
+
+  CHECK(table.empty());
+  CHECK(table.find(&tags[0]) == NULL);
+  CHECK(table.erase(&tags[0]) == NULL);
+
+  for (size_t i = 0; i < N; ++i)
+    table.insert(&tags[i], &values[i]);
+
+  CHECK(table.size() == N);
+
+  // replaces the value, not a new entry
+  table.insert(&tags[7], &values[8]);
+
+  CHECK(table.size() == N);
+  CHECK(table.find(&tags[7]) == &values[8]);
+
+  std::vector<int *> all;
+  table.values(all);
+
+  CHECK(all.size() == N);
+  CHECK(std::set<int *>(all.begin(), all.end()).size() == N - 1);
+}
+
+/* Erasing moves back the entries which probed past the freed slot, in
+   whatever order the entries are erased every other one is still found.
+ */
+static void testErase()
+{
+  TagTable<int> table;
+  std::map<const Tag *, int *> expected;
+  std::vector<size_t> order;
+
+  for (size_t i = 0; i < N; ++i)
+  {
+    table.insert(&tags[i], &values[i]);
+    expected[&tags[i]] = &values[i];
+    order.push_back(i);
+  }
+
+  srand(1);
+
+  for (size_t k = N - 1; k > 0; --k)
+    std::swap(order[k], order[rand() % (k + 1)]);
+
+  bool ok = true;
+
+  for (size_t k = 0; k < N && ok; ++k)
+  {
+    size_t i = order[k];
+
+    ok = table.erase(&tags[i]) == &values[i] && table.erase(&tags[i]) == NULL;
+
+    expected.erase(&tags[i]);
+
+    // the whole table every few steps, it is quadratic
+    if (ok && (k % 16 == 0 || k == N - 1))
+      ok = consistent(table, expected);
+  }
+
+  CHECK(ok);
+  CHECK(table.empty());
+}
+
+/* Interleaved inserts and erases keep the table consistent, reusing the
+   slots freed.
+ */
+static void testChurn()
+{
+  TagTable<int> table;
+  std::map<const Tag *, int *> expected;
+
+  srand(2);
+
+  bool ok = true;
+
+  for (size_t k = 0; k < 20 * N && ok; ++k)
+  {
+    size_t i = rand() % N;
+
+    if (expected.count(&tags[i]))
+    {
+      ok = table.erase(&tags[i]) == &values[i];
+      expected.erase(&tags[i]);
+    }
+    else
+    {
+      table.insert(&tags[i], &values[i]);
+      expected[&tags[i]] = &values[i];
+    }
+
+    if (ok && k % 256 == 0)
+      ok = consistent(table, expected);
+  }
+
+  CHECK(ok && consistent(table, expected));
+}
+
+struct Item
+{
+  Item(int v) : value(v) {}
+
+  double d;
+  int value;
+};
+
+static void testSlabPool()
+{
+  SlabPool<Item, 8> pool;
+  std::vector<Item *> items;
+
+  // a few slabs
+  for (int i = 0; i < 30; ++i)
+    items.push_back(new (pool.allocate()) Item(i));
+
+  CHECK(std::set<Item *>(items.begin(), items.end()).size() == items.size());
+
+  bool ok = true;
+
+  for (int i = 0; i < 30; ++i)
+    ok = ok && items[i]->value == i && reinterpret_cast<size_t>(items[i]) % sizeof(double) == 0;
+
+  CHECK(ok);
+
+  // the blocks freed are handed out again
+  Item *freed = items[12];
+
+  freed->~Item();
+  pool.release(freed);
+
+  Item *reused = new (pool.allocate()) Item(42);
+
+  CHECK(reused == freed);
+  CHECK(items[11]->value == 11 && items[13]->value == 13);
+
+  for (size_t i = 0; i < items.size(); ++i)
+  {
+    items[i]->~Item();
+    pool.release(items[i]);
+  }
+}
+
+int main()
+{
+  testInsertFind();
+  testErase();
+  testChurn();
+  testSlabPool();
+
+  return failures;
+}
@@ -36,6 +36,40 @@ extern const char *tab;
 extern const char *header;
 extern const char *dbus_includes;
 
+/*! Whether a method is implemented as a C++20 coroutine returning a
+    DBus::Task (annotation org.dbuscxx.Method.Coroutine)
+  */
+static bool is_coroutine(Xml::Node &method)
+{
+  Xml::Nodes annotations = method["annotation"];
+  Xml::Nodes annotations_coroutine = annotations.select("name", "org.dbuscxx.Method.Coroutine");
+
+  return !annotations_coroutine.empty() && annotations_coroutine.front()->get("value") == "true";
+}
+
+/*! The value type of the DBus::Task a coroutine method returns
+  */
+static string coroutine_result_type(Xml::Nodes &args_out)
+{
+  if (args_out.empty())
+    return "void";
+
+  if (args_out.size() == 1)
+    return signature_to_type(args_out.front()->get("type"));
+
+  string type = "std::tuple< ";
+
+  for (Xml::Nodes::iterator ao = args_out.begin(); ao != args_out.end(); ++ao)
+  {
+    if (ao != args_out.begin())
+      type += ", ";
+
+    type += signature_to_type((*ao)->get("type"));
+  }
+
+  return type + " >";
+}
+
 /*! Generate adaptor code for a XML introspection
   */
 void generate_adaptor(Xml::Document &doc, const char *filename)
@@ -114,32 +148,37 @@ void generate_adaptor(Xml::Document &doc, const char *filename)
          << tab << ": ::DBus::InterfaceAdaptor(\"" << ifacename << "\")" << endl
          << tab << "{" << endl;
 
-    // generates code to bind the properties
-    for (Xml::Nodes::iterator pi = properties.begin(); pi != properties.end(); ++pi)
-    {
-      Xml::Node &property = **pi;
-
-      body << tab << tab << "bind_property("
-           << property.get("name") << ", "
-           << "\"" << property.get("type") << "\", "
-           << (property.get("access").find("read") != string::npos
-               ? "true"
-               : "false")
-           << ", "
-           << (property.get("access").find("write") != string::npos
-               ? "true"
-               : "false")
-           << ");" << endl;
-    }
-
-    // generate code to register all methods
+    // methods and properties are registered by the static tables below,
+    // only their options are set up per instance
     for (Xml::Nodes::iterator mi = methods.begin(); mi != methods.end(); ++mi)
     {
       Xml::Node &method = **mi;
 
-      body << tab << tab << "register_method("
-           << ifaceclass << ", " << method.get("name") << ", " << stub_name(method.get("name"))
-           << ");" << endl;
+      // identical concurrent calls share one execution
+      Xml::Nodes annotations = method["annotation"];
+      Xml::Nodes annotations_single_flight = annotations.select("name", "org.dbuscxx.Method.SingleFlight");
+
+      if (!annotations_single_flight.empty() && annotations_single_flight.front()->get("value") == "true")
+      {
+        body << tab << tab << "single_flight(\"" << method.get("name") << "\");" << endl;
+      }
+
+      // the reply is sent later, batches must not invoke it
+      Xml::Nodes annotations_deferred = annotations.select("name", "org.dbuscxx.Method.Deferred");
+
+      if (!annotations_deferred.empty() && annotations_deferred.front()->get("value") == "true")
+      {
+        body << tab << tab << "deferred_method(\"" << method.get("name") << "\");" << endl;
+      }
+
+      // replies are cached for the number of milliseconds given
+      Xml::Nodes annotations_cache = annotations.select("name", "org.dbuscxx.Method.Cache");
+
+      if (!annotations_cache.empty())
+      {
+        body << tab << tab << "cache_method(\"" << method.get("name") << "\", "
+             << strtoul(annotations_cache.front()->get("value").c_str(), NULL, 10) << ");" << endl;
+      }
     }
 
     body << tab << "}" << endl
@@ -242,6 +281,143 @@ void generate_adaptor(Xml::Document &doc, const char *filename)
          << tab << "}" << endl
          << endl;
 
+    // the <interface> element the library would build from the tables above, written once here
+    string fragment = "\n\t<interface name=\"" + ifacename + "\">";
+
+    for (Xml::Nodes::iterator pi = properties.begin(); pi != properties.end(); ++pi)
+    {
+      Xml::Node &property = **pi;
+      string access;
+
+      if (property.get("access").find("read") != string::npos) access += "read";
+      if (property.get("access").find("write") != string::npos) access += "write";
+
+      fragment += "\n\t\t<property name=\"" + property.get("name") + "\""
+                  " type=\"" + property.get("type") + "\""
+                  " access=\"" + access + "\"/>";
+    }
+
+    for (Xml::Nodes::iterator mi = methods.begin(); mi != methods.end(); ++mi)
+    {
+      Xml::Node &method = **mi;
+      Xml::Nodes args = method["arg"];
+
+      fragment += "\n\t\t<method name=\"" + method.get("name") + "\">";
+
+      for (Xml::Nodes::iterator ai = args.begin(); ai != args.end(); ++ai)
+      {
+        Xml::Node &arg = **ai;
+
+        fragment += "\n\t\t\t<arg direction=\"" + string(arg.get("direction") == "in" ? "in" : "out") + "\""
+                    " type=\"" + arg.get("type") + "\"";
+
+        if (arg.get("name").length())
+          fragment += " name=\"" + arg.get("name") + "\"";
+
+        fragment += "/>";
+      }
+      fragment += "\n\t\t</method>";
+    }
+
+    for (Xml::Nodes::iterator si = signals.begin(); si != signals.end(); ++si)
+    {
+      Xml::Node &signal = **si;
+      Xml::Nodes args = signal["arg"];
+
+      fragment += "\n\t\t<signal name=\"" + signal.get("name") + "\">";
+
+      for (Xml::Nodes::iterator ai = args.begin(); ai != args.end(); ++ai)
+      {
+        Xml::Node &arg = **ai;
+
+        fragment += "<arg type=\"" + arg.get("type") + "\"";
+
+        if (arg.get("name").length())
+          fragment += " name=\"" + arg.get("name") + "\"";
+
+        fragment += "/>";
+      }
+      fragment += "\n\t\t</signal>";
+    }
+    fragment += "\n\t</interface>";
+
+    body << tab << "/* the introspection data of the interface, see InterfaceAdaptor::introspect_xml()" << endl
+         << tab << " */" << endl
+         << tab << "const char *introspect_xml() const" << endl
+         << tab << "{" << endl
+         << tab << tab << "return" << endl;
+
+    generate_string_literal(body, fragment, string(tab) + tab + tab);
+
+    body << ";" << endl
+         << tab << "}" << endl
+         << endl;
+
+    // the dispatch tables, shared by all the instances
+    vector<string> method_names;
+
+    if (!methods.empty())
+    {
+      body << tab << "/* dispatch tables shared by all the instances, see InterfaceAdaptor::method_table()" << endl
+           << tab << " */" << endl
+           << tab << "const ::DBus::MethodEntry *method_table() const" << endl
+           << tab << "{" << endl
+           << tab << tab << "static const ::DBus::MethodEntry " << ifaceclass << "_method_table[] =" << endl
+           << tab << tab << "{" << endl;
+
+      for (Xml::Nodes::iterator mi = methods.begin(); mi != methods.end(); ++mi)
+      {
+        string name = (*mi)->get("name");
+
+        body << tab << tab << tab << "{ \"" << name << "\", &::DBus::method_member< "
+             << ifaceclass << ", &" << ifaceclass << "::" << stub_name(name) << " > }," << endl;
+        method_names.push_back(name);
+      }
+
+      body << tab << tab << tab << "{ 0, 0 }" << endl
+           << tab << tab << "};" << endl
+           << tab << tab << "return " << ifaceclass << "_method_table;" << endl
+           << tab << "}" << endl
+           << endl
+           << tab << "const ::DBus::MethodEntry *find_method_entry(const char *member) const" << endl
+           << tab << "{" << endl
+           << tab << tab << "const ::DBus::MethodEntry *table = " << ifaceclass << "::method_table();" << endl
+           << endl;
+
+      generate_name_switch(body, method_names, "&table", string(tab) + tab);
+
+      body << tab << tab << "return NULL;" << endl
+           << tab << "}" << endl
+           << endl;
+    }
+
+    if (!properties.empty())
+    {
+      body << tab << "const ::DBus::PropertyEntry *property_table() const" << endl
+           << tab << "{" << endl
+           << tab << tab << "static const ::DBus::PropertyEntry " << ifaceclass << "_property_table[] =" << endl
+           << tab << tab << "{" << endl;
+
+      for (Xml::Nodes::iterator pi = properties.begin(); pi != properties.end(); ++pi)
+      {
+        Xml::Node &property = **pi;
+        string name = property.get("name");
+        string access = property.get("access");
+
+        body << tab << tab << tab << "{ \"" << name << "\", \"" << property.get("type") << "\", "
+             << (access.find("read") != string::npos ? "true" : "false") << ", "
+             << (access.find("write") != string::npos ? "true" : "false") << ", "
+             << "&::DBus::property_member< " << ifaceclass << ", ::DBus::PropertyAdaptor< "
+             << signature_to_type(property.get("type")) << " >, &" << ifaceclass << "::" << name << " > }," << endl;
+      }
+
+      body << tab << tab << tab << "{ 0, 0, false, false, 0 }" << endl
+           << tab << tab << "};" << endl
+           << tab << tab << "return " << ifaceclass << "_property_table;" << endl
+           << tab << "}" << endl
+           << endl;
+    }
+
     body << "public:" << endl
          << endl
          << tab << "/* properties exposed by this interface, use" << endl
@@ -283,6 +459,32 @@ void generate_adaptor(Xml::Document &doc, const char *filename)
         arg_object = annotations_object.front()->get("value");
       }
 
+      // coroutines take their 'in' arguments by value, as they outlive
+      // the stub, and return all 'out' ones
+      if (is_coroutine(method))
+      {
+        body << tab << "virtual ::DBus::Task< " << coroutine_result_type(args_out) << " > "
+             << method.get("name") << "(";
+
+        unsigned int i = 0;
+        for (Xml::Nodes::iterator ai = args_in.begin(); ai != args_in.end(); ++ai, ++i)
+        {
+          Xml::Node &arg = **ai;
+          string arg_name = arg.get("name");
+
+          body << signature_to_type(arg.get("type")) << " ";
+
+          if (arg_name.length())
+            body << arg_name;
+
+          if (i + 1 != args_in.size())
+            body << ", ";
+        }
+
+        body << ") = 0;" << endl;
+        continue;
+      }
+
       body << tab << "virtual ";
 
       // return type is 'void' if none or multible return values
@@ -472,8 +674,9 @@ void generate_adaptor(Xml::Document &doc, const char *filename)
 
     body << endl
          << "private:" << endl
-         << endl
-         << tab << "/* unmarshalers (to unpack the DBus message before calling the actual interface method)" << endl
+         << endl;
+
+    body << tab << "/* unmarshalers (to unpack the DBus message before calling the actual interface method)" << endl
          << tab << " */" << endl;
 
     // generate the unmarshalers
@@ -486,6 +689,41 @@ void generate_adaptor(Xml::Document &doc, const char *filename)
 
       body << tab << "::DBus::Message " << stub_name(method.get("name")) << "(const ::DBus::CallMessage &call)" << endl
            << tab << "{" << endl;
+
+      // the reply is sent when the coroutine returns
+      if (is_coroutine(method))
+      {
+        if (!args_in.empty())
+        {
+          body << tab << tab << "::DBus::MessageIter ri = call.reader();" << endl;
+          body << endl;
+        }
+
+        unsigned int i = 1;
+        for (Xml::Nodes::iterator ai = args_in.begin(); ai != args_in.end(); ++ai, ++i)
+        {
+          Xml::Node &arg = **ai;
+
+          body << tab << tab << signature_to_type(arg.get("type")) << " argin" << i << ";" << " ";
+          body << "ri >> argin" << i << ";" << endl;
+        }
+
+        body << tab << tab << "return ::DBus::CoroutineBridge::start(object(), call, "
+             << method.get("name") << "(";
+
+        for (i = 1; i <= args_in.size(); ++i)
+        {
+          body << "argin" << i;
+
+          if (i != args_in.size())
+            body << ", ";
+        }
+
+        body << "));" << endl
+             << tab << "}" << endl;
+        continue;
+      }
+
       if(!args_in.empty())
       {
          body << tab << tab << "::DBus::MessageIter ri = call.reader();" << endl;
@@ -649,6 +887,9 @@ void generate_adaptor(Xml::Document &doc, const char *filename)
 
       body << ");" << endl;
 
+      // the handler deferred or failed the call through its CallContext
+      body << tab << tab << "if (::DBus::CallContext::settled()) return ::DBus::Message();" << endl;
+
       body << tab << tab << "::DBus::ReturnMessage reply(call);" << endl;
 
       if (!args_out.empty())
@@ -36,6 +36,299 @@ extern const char *tab;
 extern const char *header;
 extern const char *dbus_includes;
 
+/*! Whether a reply is expected for a method
+  */
+static bool has_reply(Xml::Node &method)
+{
+  Xml::Nodes method_annotations = method["annotation"];
+  Xml::Nodes annotations_noreply = method_annotations.select("name", "org.freedesktop.DBus.Method.NoReply");
+
+  return annotations_noreply.empty() || annotations_noreply.front()->get("value") != "true"
+         || !method["arg"].select("direction", "out").empty();
+}
+
+/*! Name of the i-th argument of a direction, as used by the method stubs
+  */
+static string arg_name(Xml::Node &arg, const char *prefix, unsigned int i)
+{
+  string name = arg.get("name");
+
+  if (!name.length())
+    name = prefix + toString <unsigned int> (i);
+
+  return name;
+}
+
+/*! The value type of the std::future returned by Method_future()
+  */
+static string future_type(Xml::Nodes &args_out)
+{
+  if (args_out.empty())
+    return "void";
+
+  if (args_out.size() == 1)
+    return signature_to_type(args_out.front()->get("type"));
+
+  string type = "std::tuple< ";
+
+  for (Xml::Nodes::iterator ao = args_out.begin(); ao != args_out.end(); ++ao)
+  {
+    if (ao != args_out.begin())
+      type += ", ";
+
+    type += signature_to_type((*ao)->get("type"));
+  }
+
+  return type + " >";
+}
+
+/*! Generates the code sending a call without waiting for its reply, the
+    handler being the given member function and `data' the given expression
+  */
+static void generate_async_send(ostringstream &body, const string &ifaceclass, Xml::Node &method,
+                                const string &handler, const string &data)
+{
+  Xml::Nodes args_in = method["arg"].select("direction", "in");
+
+  body << tab << "{" << endl
+       << tab << tab << "::DBus::CallMessage call;" << endl;
+
+  if (!args_in.empty())
+  {
+    body << tab << tab << "::DBus::MessageIter wi = call.writer();" << endl
+         << endl;
+  }
+
+  unsigned int i = 0;
+  for (Xml::Nodes::iterator ai = args_in.begin(); ai != args_in.end(); ++ai, ++i)
+  {
+    body << tab << tab << "wi << " << arg_name(**ai, "argin", i) << ";" << endl;
+  }
+
+  body << tab << tab << "call.member(\"" << method.get("name") << "\");" << endl
+       << tab << tab << "invoke_method_async(call, &::DBus::pending_call_member< " << ifaceclass
+       << ", &" << ifaceclass << "::" << handler << " >, this, " << data << ");" << endl;
+}
+
+/*! Generates the 'in' parameters of an asynchronous variant, followed by
+    a separator if more parameters come
+  */
+static void generate_async_params(ostringstream &body, Xml::Nodes &args_in, bool more)
+{
+  unsigned int i = 0;
+  for (Xml::Nodes::iterator ai = args_in.begin(); ai != args_in.end(); ++ai, ++i)
+  {
+    body << "const " << signature_to_type((*ai)->get("type")) << "& " << arg_name(**ai, "argin", i);
+
+    if (more || i + 1 != args_in.size())
+      body << ", ";
+  }
+}
+
+/*! Generates Method_async(), MethodCallback() and, for C++11 and later,
+    Method_future() for every method with a reply
+  */
+static void generate_async_methods(ostringstream &body, const string &ifaceclass, Xml::Nodes &methods)
+{
+  body << "public:" << endl
+       << endl
+       << tab << "/* asynchronous variants of the methods: the replies are unpacked in the" << endl
+       << tab << " * dispatcher thread and given to the ...Callback() handlers along with" << endl
+       << tab << " * `_data', or to the futures; the proxy must outlive the pending calls" << endl
+       << tab << " */" << endl;
+
+  for (Xml::Nodes::iterator mi = methods.begin(); mi != methods.end(); ++mi)
+  {
+    Xml::Node &method = **mi;
+
+    if (!has_reply(method))
+      continue;
+
+    Xml::Nodes args = method["arg"];
+    Xml::Nodes args_in = args.select("direction", "in");
+    Xml::Nodes args_out = args.select("direction", "out");
+    string name = method.get("name");
+    string stub = name;
+
+    underscorize(stub);
+
+    // Method_async()
+    body << tab << "void " << name << "_async(";
+    generate_async_params(body, args_in, true);
+    body << "void *_data = NULL)" << endl;
+
+    generate_async_send(body, ifaceclass, method, "_" + stub + "_async_stub", "_data");
+
+    body << tab << "}" << endl
+         << endl;
+
+    // MethodCallback(), the names are commented out as it uses none
+    body << tab << "virtual void " << name << "Callback(";
+
+    unsigned int i = 0;
+    for (Xml::Nodes::iterator ao = args_out.begin(); ao != args_out.end(); ++ao, ++i)
+    {
+      body << "const " << signature_to_type((*ao)->get("type")) << "& /*" << arg_name(**ao, "argout", i) << "*/, ";
+    }
+
+    body << "const ::DBus::Error& /*error*/, void * /*data*/)" << endl
+         << tab << "{}" << endl
+         << endl;
+
+    // Method_future()
+    string type = future_type(args_out);
+
+    body << "#if __cplusplus >= 201103L" << endl
+         << tab << "std::future< " << type << " > " << name << "_future(";
+    generate_async_params(body, args_in, false);
+    body << ")" << endl;
+
+    body << tab << "{" << endl
+         << tab << tab << "std::unique_ptr< std::promise< " << type << " > > promise(new std::promise< "
+         << type << " >);" << endl
+         << tab << tab << "std::future< " << type << " > future = promise->get_future();" << endl
+         << endl;
+
+    // the sending code has its own braces
+    ostringstream send;
+    generate_async_send(send, ifaceclass, method, "_" + stub + "_future_stub", "promise.get()");
+    string send_code = send.str();
+    body << send_code.substr(send_code.find('\n') + 1);
+
+    body << tab << tab << "promise.release();" << endl
+         << tab << tab << "return future;" << endl
+         << tab << "}" << endl
+         << "#endif" << endl
+         << endl;
+  }
+}
+
+/*! Generates the handlers unpacking the replies of the asynchronous variants
+  */
+static void generate_async_stubs(ostringstream &body, Xml::Nodes &methods)
+{
+  for (Xml::Nodes::iterator mi = methods.begin(); mi != methods.end(); ++mi)
+  {
+    Xml::Node &method = **mi;
+
+    if (!has_reply(method))
+      continue;
+
+    Xml::Nodes args_out = method["arg"].select("direction", "out");
+    string name = method.get("name");
+    string stub = name;
+
+    underscorize(stub);
+
+    // for Method_async()
+    string argouts;
+
+    for (unsigned int i = 0; i < args_out.size(); ++i)
+    {
+      argouts += "argout" + toString <unsigned int> (i) + ", ";
+    }
+
+    body << tab << "void _" << stub << "_async_stub(::DBus::PendingCall &pending)" << endl
+         << tab << "{" << endl
+         << tab << tab << "::DBus::Message reply = pending.steal_reply();" << endl;
+
+    unsigned int i = 0;
+    for (Xml::Nodes::iterator ao = args_out.begin(); ao != args_out.end(); ++ao, ++i)
+    {
+      string type = signature_to_type((*ao)->get("type"));
+
+      // the callback gets them even when the call failed
+      body << tab << tab << type << " argout" << i << " = " << type << "();" << endl;
+    }
+
+    body << endl
+         << tab << tab << "if (reply.is_error())" << endl
+         << tab << tab << "{" << endl
+         << tab << tab << tab << "::DBus::Error error(reply);" << endl
+         << tab << tab << tab << name << "Callback(" << argouts << "error, pending.data());" << endl
+         << tab << tab << tab << "return;" << endl
+         << tab << tab << "}" << endl;
+
+    if (!args_out.empty())
+    {
+      body << tab << tab << "try" << endl
+           << tab << tab << "{" << endl
+           << tab << tab << tab << "::DBus::MessageIter ri = reply.reader();" << endl;
+
+      for (i = 0; i < args_out.size(); ++i)
+      {
+        body << tab << tab << tab << "ri >> argout" << i << ";" << endl;
+      }
+
+      body << tab << tab << "}" << endl
+           << tab << tab << "catch (::DBus::Error &error)" << endl
+           << tab << tab << "{" << endl
+           << tab << tab << tab << name << "Callback(" << argouts << "error, pending.data());" << endl
+           << tab << tab << tab << "return;" << endl
+           << tab << tab << "}" << endl;
+    }
+
+    body << tab << tab << name << "Callback(" << argouts << "::DBus::Error(), pending.data());" << endl
+         << tab << "}" << endl;
+
+    // for Method_future()
+    string type = future_type(args_out);
+
+    body << "#if __cplusplus >= 201103L" << endl
+         << tab << "void _" << stub << "_future_stub(::DBus::PendingCall &pending)" << endl
+         << tab << "{" << endl
+         << tab << tab << "std::unique_ptr< std::promise< " << type << " > > promise(static_cast< std::promise< "
+         << type << " > *>(pending.data()));" << endl
+         << tab << tab << "::DBus::Message reply = pending.steal_reply();" << endl
+         << endl
+         << tab << tab << "try" << endl
+         << tab << tab << "{" << endl
+         << tab << tab << tab << "if (reply.is_error())" << endl
+         << tab << tab << tab << tab << "throw ::DBus::Error(reply);" << endl
+         << endl;
+
+    if (!args_out.empty())
+    {
+      body << tab << tab << tab << "::DBus::MessageIter ri = reply.reader();" << endl;
+
+      i = 0;
+      for (Xml::Nodes::iterator ao = args_out.begin(); ao != args_out.end(); ++ao, ++i)
+      {
+        body << tab << tab << tab << signature_to_type((*ao)->get("type")) << " argout" << i << ";" << endl
+             << tab << tab << tab << "ri >> argout" << i << ";" << endl;
+      }
+    }
+
+    if (args_out.empty())
+    {
+      body << tab << tab << tab << "promise->set_value();" << endl;
+    }
+    else if (args_out.size() == 1)
+    {
+      body << tab << tab << tab << "promise->set_value(argout0);" << endl;
+    }
+    else
+    {
+      body << tab << tab << tab << "promise->set_value(std::make_tuple(";
+
+      for (i = 0; i < args_out.size(); ++i)
+      {
+        body << (i ? ", " : "") << "argout" << i;
+      }
+
+      body << "));" << endl;
+    }
+
+    body << tab << tab << "}" << endl
+         << tab << tab << "catch (...)" << endl
+         << tab << tab << "{" << endl
+         << tab << tab << tab << "promise->set_exception(std::current_exception());" << endl
+         << tab << tab << "}" << endl
+         << tab << "}" << endl
+         << "#endif" << endl;
+  }
+}
+
 /*! Generate proxy code for a XML introspection
   */
 void generate_proxy(Xml::Document &doc, const char *filename)
@@ -55,6 +348,13 @@ void generate_proxy(Xml::Document &doc, const char *filename)
 
   head << dbus_includes;
 
+  // for the Method_future() variants
+  head << "#if __cplusplus >= 201103L" << endl
+       << "#include <future>" << endl
+       << "#include <memory>" << endl
+       << "#include <tuple>" << endl
+       << "#endif" << endl;
+
   Xml::Node &root = *(doc.root);
   Xml::Nodes interfaces = root["interface"];
 
@@ -126,6 +426,16 @@ void generate_proxy(Xml::Document &doc, const char *filename)
            << ");" << endl;
     }
 
+    vector<string> signal_names;
+
+    for (Xml::Nodes::iterator si = signals.begin(); si != signals.end(); ++si)
+    {
+      string name = (*si)->get("name");
+
+      body << tab << tab << "_signal_slots[" << signal_names.size() << "] = &_signals[\"" << name << "\"];" << endl;
+      signal_names.push_back(name);
+    }
+
     // the constructor ends here
     body << tab << "}" << endl
          << endl;
@@ -473,6 +783,8 @@ void generate_proxy(Xml::Document &doc, const char *filename)
            << endl;
     }
 
+    generate_async_methods(body, ifaceclass, methods);
+
     // write public block header for signals
     body << endl
          << "public:" << endl
@@ -528,11 +840,34 @@ void generate_proxy(Xml::Document &doc, const char *filename)
       body << ") = 0;" << endl;
     }
 
+    if (!signal_names.empty())
+    {
+      body << endl
+           << "protected:" << endl
+           << endl
+           << tab << "/* finds the signal without building a string, see InterfaceAdaptor::find_method()" << endl
+           << tab << " */" << endl
+           << tab << "::DBus::SignalTable::mapped_type *find_signal(const char *member)" << endl
+           << tab << "{" << endl;
+
+      generate_name_switch(body, signal_names, "_signal_slots", string(tab) + tab);
+
+      body << tab << tab << "return ::DBus::InterfaceProxy::find_signal(member);" << endl
+           << tab << "}" << endl;
+    }
+
     // write private block header for unmarshalers
     body << endl
          << "private:" << endl
-         << endl
-         << tab << "/* unmarshalers (to unpack the DBus message before calling the actual signal handler)" << endl
+         << endl;
+
+    if (!signal_names.empty())
+    {
+      body << tab << "::DBus::SignalTable::mapped_type *_signal_slots[" << signal_names.size() << "];" << endl
+           << endl;
+    }
+
+    body << tab << "/* unmarshalers (to unpack the DBus message before calling the actual signal handler)" << endl
          << tab << " */" << endl;
 
     // generate all the unmarshalers
@@ -626,6 +961,8 @@ void generate_proxy(Xml::Document &doc, const char *filename)
       body << tab << "}" << endl;
     }
 
+    generate_async_stubs(body, methods);
+
     body << "};" << endl
          << endl;
 
@@ -23,6 +23,8 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <map>
+#include <set>
 
 #include "generator_utils.h"
 
@@ -32,7 +34,7 @@ const char *tab = "    ";
 
 const char *header = "\n/*\n *	This file was automatically generated by dbusxx-xml2cpp; DO NOT EDIT!\n */\n\n";
 
-const char *dbus_includes = "\n#include <dbus-c++/dbus.h>\n#include <cassert>\n";
+const char *dbus_includes = "\n#include <dbus-c++/dbus.h>\n#include <cassert>\n#include <cstring>\n";
 
 void underscorize(string &str)
 {
@@ -42,6 +44,112 @@ void underscorize(string &str)
   }
 }
 
+/*! Emits the cases selecting among `indices' into `names', all of the
+    same length, by their characters
+  */
+static void generate_char_switch(ostringstream &body, const vector<string> &names, const vector<size_t> &indices,
+                                 const string &slots, const string &indent)
+{
+  const string &first = names[indices.front()];
+
+  // the character telling most of the names apart
+  size_t best = 0, best_count = 0;
+
+  for (size_t pos = 0; pos < first.length(); ++pos)
+  {
+    set<char> chars;
+
+    for (size_t i = 0; i < indices.size(); ++i)
+      chars.insert(names[indices[i]][pos]);
+
+    if (chars.size() > best_count)
+    {
+      best = pos;
+      best_count = chars.size();
+    }
+  }
+
+  // one name left, or the same name declared twice
+  if (best_count < 2)
+  {
+    body << indent << "if (!memcmp(member, \"" << first << "\", " << first.length() << "))" << endl
+         << indent << tab << "return " << slots << "[" << indices.front() << "];" << endl;
+    return;
+  }
+
+  map< char, vector<size_t> > groups;
+
+  for (size_t i = 0; i < indices.size(); ++i)
+    groups[names[indices[i]][best]].push_back(indices[i]);
+
+  body << indent << "switch (member[" << best << "])" << endl
+       << indent << "{" << endl;
+
+  for (map< char, vector<size_t> >::iterator gi = groups.begin(); gi != groups.end(); ++gi)
+  {
+    body << indent << "case '" << gi->first << "':" << endl;
+    generate_char_switch(body, names, gi->second, slots, indent + tab);
+    body << indent << tab << "break;" << endl;
+  }
+  body << indent << "}" << endl;
+}
+
+/*! Emits a lookup of `member' among `names', returning the entry of the
+    array `slots' with the same index; it switches on the length and then
+    on characters of the name, and only compares it once
+  */
+void generate_name_switch(ostringstream &body, const vector<string> &names,
+                          const string &slots, const string &indent)
+{
+  map< size_t, vector<size_t> > lengths;
+
+  for (size_t i = 0; i < names.size(); ++i)
+    lengths[names[i].length()].push_back(i);
+
+  body << indent << "switch (strlen(member))" << endl
+       << indent << "{" << endl;
+
+  for (map< size_t, vector<size_t> >::iterator li = lengths.begin(); li != lengths.end(); ++li)
+  {
+    body << indent << "case " << li->first << ":" << endl;
+    generate_char_switch(body, names, li->second, slots, indent + tab);
+    body << indent << tab << "break;" << endl;
+  }
+  body << indent << "}" << endl;
+}
+
+/*! Emits `text' as a C string literal, one piece per line of it, without
+    a line break after the last one
+  */
+void generate_string_literal(ostringstream &body, const string &text, const string &indent)
+{
+  body << indent << "\"";
+
+  for (size_t i = 0; i < text.length(); ++i)
+  {
+    switch (text[i])
+    {
+    case '\n':
+      // a new piece starts with each line
+      if (i > 0)
+        body << "\"" << endl << indent << "\"";
+
+      body << "\\n";
+      break;
+    case '\t':
+      body << "\\t";
+      break;
+    case '"':
+    case '\\':
+      body << '\\' << text[i];
+      break;
+    default:
+      body << text[i];
+    }
+  }
+  body << "\"";
+}
+
 string stub_name(string name)
 {
   underscorize(name);
@@ -27,11 +27,15 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <vector>
 
 const char *atomic_type_to_string(char t);
 std::string stub_name(std::string name);
 std::string signature_to_type(const std::string &signature);
 void underscorize(std::string &str);
+void generate_name_switch(std::ostringstream &body, const std::vector<std::string> &names,
+                          const std::string &slots, const std::string &indent);
+void generate_string_literal(std::ostringstream &body, const std::string &text, const std::string &indent);
 
 /// create std::string from any number
 template <typename T>